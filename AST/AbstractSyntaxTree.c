@@ -1,8 +1,22 @@
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 
-int error = 0;
-FILE * file;
+#include "Context.c"
+#include "Arena.c"
+#include "Intern.c"
+#include "Object.c"
+#include "Emitter.c"
+#include "Encoder.c"
+#include "Allocator.c"
+#include "Cache.c"
+#include "Interface.c"
+#include "Pool.c"
+#include "Jit.c"
+#include "Stream.c"
+#include "Server.c"
+#include "Source.c"
+#include "Report.c"
 
 
 // Symbol
@@ -24,6 +38,21 @@ struct symbol
     int position;
     int size;
     int isParam;
+
+    struct symbol * shadowed;
+    int level;
+
+    struct operand operand;
+
+    // The virtual register a scalar local or parameter is kept in while its
+    // function is generated; 0 for one that lives in memory.
+    int vreg;
+
+    // How many assignments name the symbol. A local that is declared with a
+    // constant and never assigned is folded to that constant, its value.
+    int assignments;
+    int constant;
+    long value;
 };
 
 // Identifier
@@ -32,8 +61,10 @@ struct ident
 {
     struct symbol * sym;
     struct type * type_;
-    const char * name;
+    const char * name; // interned
+    unsigned int hash;
     int offset;
+    struct expr * index; // subscript only known at run time
 };
 
 // Type
@@ -70,6 +101,8 @@ struct type
 
     union type_type * type_;
     struct type_spec * type_specifier;
+
+    unsigned int hash;
 };
 
 // Function Call
@@ -137,7 +170,7 @@ struct expr
         struct ident * identifier;
         struct expr_assign * assign;
         struct expr_bool_expression;
-        int * integer_value; 
+        long integer_value;
         // more
     };
 
@@ -145,6 +178,8 @@ struct expr
     int reg;
     int size;
 
+    struct type * checked_type; // set the first time the type is derived
+
     struct expr * next;
     
 };
@@ -171,6 +206,13 @@ struct decl_function
     int variable_count;
     int parameter_count;
     int return_size;
+
+    // The function's cache key, and the fragment the cache had for it; both
+    // null without --cache.
+    const char * cache_key;
+    size_t cache_key_length;
+    const char * cached;
+    size_t cached_length;
 };
 
 // Var
@@ -253,7 +295,9 @@ struct decl
     union decl_type * decl_;
 
     struct decl * next;
-    
+
+    // Declared pub: modules that include this one can use it.
+    int exported;
 };
 
 // Statement
@@ -321,27 +365,28 @@ struct expr_assign
 
 void throw_error()
 {
-    error = 1;
+    ctx->error = 1;
 }
 
 // Functions
 
 struct decl * decl_create(decl_t kind)
 {
-    struct decl * d = malloc(sizeof(*d));
+    struct decl * d = node_alloc(d);
     d->kind = kind;
+    d->exported = 0;
 
     return d;
 }
 
 struct stmt * stmt_create_for(struct decl * d, struct expr * e1, struct expr * e2, struct stmt * body, struct stmt * next)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_FOR;
     
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
     
-    struct for_stmt * f = malloc(sizeof(*f));
+    struct for_stmt * f = arena_alloc(ctx->arena, sizeof(*f));
     f->declaration = d;
     f->expression1 = e1;
     f->expression2 = e2;
@@ -356,12 +401,12 @@ struct stmt * stmt_create_for(struct decl * d, struct expr * e1, struct expr * e
 
 struct stmt * stmt_create_if(struct expr * expression, struct stmt * statement, struct stmt * else_stmt, struct stmt * next)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_IF;
 
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
 
-    struct if_stmt * i = malloc(sizeof(*i));
+    struct if_stmt * i = arena_alloc(ctx->arena, sizeof(*i));
     i->expression = expression;
     i->statement = statement;
 
@@ -380,12 +425,12 @@ struct stmt * stmt_create_if(struct expr * expression, struct stmt * statement,
 
 struct stmt * stmt_create_while(struct expr * e, struct stmt * body, struct stmt * next)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_WHILE;
 
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
     
-    struct while_stmt * w = malloc(sizeof(*w));
+    struct while_stmt * w = arena_alloc(ctx->arena, sizeof(*w));
     w->expression = e;
     w->body = body;
 
@@ -398,12 +443,12 @@ struct stmt * stmt_create_while(struct expr * e, struct stmt * body, struct stmt
 
 struct stmt * stmt_create_else_if(struct expr * expression, struct stmt * statement, struct stmt * else_stmt)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_ELSE_IF;
 
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
 
-    struct if_stmt * i = malloc(sizeof(*i));
+    struct if_stmt * i = arena_alloc(ctx->arena, sizeof(*i));
     i->expression = expression;
     i->statement = statement;
 
@@ -421,12 +466,12 @@ struct stmt * stmt_create_else_if(struct expr * expression, struct stmt * statem
 
 struct stmt * stmt_create_else(struct stmt * statement)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_ELSE;
 
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
 
-    struct if_stmt * i = malloc(sizeof(*i));
+    struct if_stmt * i = arena_alloc(ctx->arena, sizeof(*i));
     i->statement = statement;
 
     s->stmt_->if_stmt = i;
@@ -437,15 +482,19 @@ struct stmt * stmt_create_else(struct stmt * statement)
 struct decl * decl_create_function(struct ident * name, struct function_param * params, struct type * return_type, struct stmt * body)
 {
     struct decl * d = decl_create(DECL_FUNCTION);
-    d->decl_ = malloc(sizeof(*d->decl_));
+    d->decl_ = arena_alloc(ctx->arena, sizeof(*d->decl_));
 
-    struct decl_function * f = malloc(sizeof(*f));
+    struct decl_function * f = arena_alloc(ctx->arena, sizeof(*f));
     f->identifier = name;
     f->param = params;
     f->return_type = return_type;
     f->body = body;
     f->parameter_count = 0;
     f->variable_count = 0;
+    f->cache_key = 0;
+    f->cache_key_length = 0;
+    f->cached = 0;
+    f->cached_length = 0;
 
     if (return_type->kind == TYPE_PRIMITIVE)
     {
@@ -465,7 +514,7 @@ struct decl * decl_create_function(struct ident * name, struct function_param *
 
 struct array_sub * array_sub_create(int i, struct array_sub * next)
 {
-    struct array_sub * a = malloc(sizeof(*a));
+    struct array_sub * a = arena_alloc(ctx->arena, sizeof(*a));
     a->i = i;
     a->next = next;
 
@@ -474,7 +523,7 @@ struct array_sub * array_sub_create(int i, struct array_sub * next)
 
 struct type_spec * type_spec_create_pointer()
 {
-    struct type_spec * s = malloc(sizeof(*s));
+    struct type_spec * s = arena_alloc(ctx->arena, sizeof(*s));
     s->kind = TYPE_SPEC_POINTER;
 
     return s;
@@ -482,7 +531,7 @@ struct type_spec * type_spec_create_pointer()
 
 struct type_spec * type_spec_create_array(struct array_sub * sub)
 {
-    struct type_spec * s = malloc(sizeof(*s));
+    struct type_spec * s = arena_alloc(ctx->arena, sizeof(*s));
     s->kind = TYPE_SPEC_ARRAY;
     s->sub = sub;
 
@@ -492,7 +541,7 @@ struct type_spec * type_spec_create_array(struct array_sub * sub)
 
 struct function_param * function_create_param(struct ident * name, struct type * type_, struct expr * value, struct function_para * next)
 {
-    struct function_param * p = malloc(sizeof(*p));
+    struct function_param * p = arena_alloc(ctx->arena, sizeof(*p));
     
     p->identifier = name;
     p->type_ = type_;
@@ -509,12 +558,13 @@ struct function_param * function_create_param(struct ident * name, struct type *
 
 struct expr * expr_create_name(const char * name, int offset)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_IDENTIFIER;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct ident * i = malloc(sizeof(*i));
+    struct ident * i = node_alloc(i);
     i->name = name;
+    i->hash = intern_hash(name);
     i->offset = offset;
 
     e->expr_->identifier = i;
@@ -522,11 +572,21 @@ struct expr * expr_create_name(const char * name, int offset)
     return e;
 }
 
+struct expr * expr_create_identifier(struct ident * i)
+{
+    struct expr * e = node_alloc(e);
+    e->kind = EXPR_IDENTIFIER;
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
+    e->expr_->identifier = i;
+
+    return e;
+}
+
 struct expr * expr_create_integer(int i)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_INTEGER;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
     e->expr_->integer_value = i;
 
@@ -535,11 +595,11 @@ struct expr * expr_create_integer(int i)
 
 struct expr * expr_create_equal(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_EQUAL;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -549,11 +609,11 @@ struct expr * expr_create_equal(struct expr * L, struct expr * R)
 
 struct expr * expr_create_not_equal(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_NOT_EQUAL;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -563,11 +623,11 @@ struct expr * expr_create_not_equal(struct expr * L, struct expr * R)
 
 struct expr * expr_create_greater(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_GREATER;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -577,11 +637,11 @@ struct expr * expr_create_greater(struct expr * L, struct expr * R)
 
 struct expr * expr_create_less(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_LESS;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -591,11 +651,11 @@ struct expr * expr_create_less(struct expr * L, struct expr * R)
 
 struct expr * expr_create_greater_equal(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_GREATER_EQUAL;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -605,11 +665,11 @@ struct expr * expr_create_greater_equal(struct expr * L, struct expr * R)
 
 struct expr * expr_create_less_equal(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_LESS_EQUAL;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -619,9 +679,9 @@ struct expr * expr_create_less_equal(struct expr * L, struct expr * R)
 
 struct expr * expr_create_bool(int b)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_BOOL;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
     e->expr_->integer_value = b;
 
@@ -630,11 +690,11 @@ struct expr * expr_create_bool(int b)
 
 struct expr * expr_create_assign(struct ident * identifier, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_ASSIGN;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_assign * a = malloc(sizeof(*a));
+    struct expr_assign * a = arena_alloc(ctx->arena, sizeof(*a));
 
     a->identifier = identifier;
     a->expression = R;
@@ -646,11 +706,11 @@ struct expr * expr_create_assign(struct ident * identifier, struct expr * R)
 
 struct expr * expr_create_add(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_ADD;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -661,11 +721,11 @@ struct expr * expr_create_add(struct expr * L, struct expr * R)
 
 struct expr * expr_create_sub(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_SUB;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -676,11 +736,11 @@ struct expr * expr_create_sub(struct expr * L, struct expr * R)
 
 struct expr * expr_create_mul(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_MUL;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -691,11 +751,11 @@ struct expr * expr_create_mul(struct expr * L, struct expr * R)
 
 struct expr * expr_create_div(struct expr * L, struct expr * R)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_DIV;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_operation * o = malloc(sizeof(*o));
+    struct expr_operation * o = arena_alloc(ctx->arena, sizeof(*o));
     o->left = L;
     o->right = R;
 
@@ -706,7 +766,7 @@ struct expr * expr_create_div(struct expr * L, struct expr * R)
 
 struct expr_function_arg * expr_function_create_arg(struct expr * value, struct expr_function_arg * next)
 {
-    struct expr_function_arg * a = malloc(sizeof(*a));
+    struct expr_function_arg * a = arena_alloc(ctx->arena, sizeof(*a));
     a->value = value;
     a->next = next;
 
@@ -715,11 +775,11 @@ struct expr_function_arg * expr_function_create_arg(struct expr * value, struct
 
 struct expr * expr_create_call(struct ident * name, struct expr_function_arg * args)
 {
-    struct expr * e = malloc(sizeof(*e));
+    struct expr * e = node_alloc(e);
     e->kind = EXPR_FUNCTION_CALL;
-    e->expr_ = malloc(sizeof(*e->expr_));
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
 
-    struct expr_function_call * c = malloc(sizeof(*c));
+    struct expr_function_call * c = arena_alloc(ctx->arena, sizeof(*c));
     c->identifier = name;
     c->arguments = args;
 
@@ -728,47 +788,206 @@ struct expr * expr_create_call(struct ident * name, struct expr_function_arg * a
     return e;
 }
 
-struct type * type_create_primitive(primitives_t kind, struct type_spec * spec)
+// Types are hash-consed: each distinct type (primitive kind or name plus the
+// shape of its specifier) exists exactly once, so two types are the same type
+// exactly when they are the same pointer. Canonical types live in storage of
+// their own, apart from the context's arena.
+
+struct type_table
 {
-    struct type * t = malloc(sizeof(*t));
-    t->kind = TYPE_PRIMITIVE;
+    struct type ** slots;
+    int capacity;
+    int count;
 
-    t->type_ = malloc(sizeof(*t->type_));
+    struct arena * storage;
 
-    t->type_->kind = kind;
-    t->type_specifier = spec;
+    // Set while the table is shared between threads.
+    pthread_mutex_t * lock;
+};
 
-    return t;
+unsigned int type_spec_hash(struct type_spec * spec)
+{
+    if (!spec) return 0;
+
+    unsigned int hash = spec->kind + 1;
+    if (spec->kind == TYPE_SPEC_ARRAY)
+    {
+        for (struct array_sub * a = spec->sub; a; a = a->next)
+        {
+            hash = hash * 31 + (unsigned int)a->i;
+        }
+    }
+    return hash;
 }
 
-struct type * type_create_name(const char * name)
+int type_spec_same(struct type_spec * L, struct type_spec * R)
+{
+    if (!L || !R) return L == R;
+    if (L->kind != R->kind) return 0;
+    if (L->kind != TYPE_SPEC_ARRAY) return 1;
+
+    struct array_sub * a = L->sub;
+    struct array_sub * b = R->sub;
+    while (a && b)
+    {
+        if (a->i != b->i) return 0;
+        a = a->next;
+        b = b->next;
+    }
+    return a == b;
+}
+
+struct type_spec * type_spec_copy(struct type_spec * spec)
+{
+    if (!spec) return 0;
+
+    struct type_spec * s = arena_alloc(ctx->types->storage, sizeof(*s));
+    s->kind = spec->kind;
+
+    struct array_sub ** tail = &s->sub;
+    if (spec->kind == TYPE_SPEC_ARRAY)
+    {
+        for (struct array_sub * a = spec->sub; a; a = a->next)
+        {
+            *tail = arena_alloc(ctx->types->storage, sizeof(**tail));
+            (*tail)->i = a->i;
+            tail = &(*tail)->next;
+        }
+    }
+    return s;
+}
+
+unsigned int type_hash(type_t kind, primitives_t primitive, const char * name, struct type_spec * spec)
+{
+    unsigned int hash = kind == TYPE_NAME ? intern_hash(name) : (unsigned int)primitive;
+    return (hash * 31 + kind) * 31 + type_spec_hash(spec);
+}
+
+int type_same(struct type * t, type_t kind, primitives_t primitive, const char * name, struct type_spec * spec)
+{
+    if (t->kind != kind) return 0;
+    if (kind == TYPE_NAME ? t->type_->name != name : t->type_->kind != primitive) return 0;
+    return type_spec_same(t->type_specifier, spec);
+}
+
+void type_table_grow()
+{
+    struct type ** old = ctx->types->slots;
+    int old_capacity = ctx->types->capacity;
+
+    ctx->types->capacity = old_capacity ? old_capacity * 2 : 64;
+    ctx->types->slots = calloc(ctx->types->capacity, sizeof(*ctx->types->slots));
+
+    int mask = ctx->types->capacity - 1;
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (!old[i]) continue;
+
+        int j = old[i]->hash & mask;
+        while (ctx->types->slots[j])
+        {
+            j = (j + 1) & mask;
+        }
+        ctx->types->slots[j] = old[i];
+    }
+
+    free(old);
+}
+
+void type_table_release(struct type_table * t)
+{
+    if (!t) return;
+
+    free(t->slots);
+    arena_release(t->storage);
+    free(t);
+}
+
+struct type * type_intern_locked(type_t kind, primitives_t primitive, const char * name, struct type_spec * spec)
 {
-    struct type * t = malloc(sizeof(*t));
-    t->kind = TYPE_NAME;
+    if (!ctx->types->storage)
+    {
+        ctx->types->storage = arena_create();
+    }
+    if ((ctx->types->count + 1) * 2 > ctx->types->capacity)
+    {
+        type_table_grow();
+    }
+
+    unsigned int hash = type_hash(kind, primitive, name, spec);
+    int mask = ctx->types->capacity - 1;
+    int i = hash & mask;
+    while (ctx->types->slots[i])
+    {
+        if (ctx->types->slots[i]->hash == hash && type_same(ctx->types->slots[i], kind, primitive, name, spec))
+        {
+            return ctx->types->slots[i];
+        }
+        i = (i + 1) & mask;
+    }
+
+    struct type * t = arena_alloc(ctx->types->storage, sizeof(*t));
+    t->kind = kind;
+    t->type_ = arena_alloc(ctx->types->storage, sizeof(*t->type_));
+    if (kind == TYPE_NAME)
+    {
+        t->type_->name = name;
+    }
+    else
+    {
+        t->type_->kind = primitive;
+    }
+    t->type_specifier = type_spec_copy(spec);
+    t->hash = hash;
+
+    ctx->types->slots[i] = t;
+    ctx->types->count++;
 
-    t->type_ = malloc(sizeof(*t->type_));
+    return t;
+}
 
-    t->type_->name = name;
+struct type * type_intern(type_t kind, primitives_t primitive, const char * name, struct type_spec * spec)
+{
+    if (!ctx->types->lock) return type_intern_locked(kind, primitive, name, spec);
 
+    pthread_mutex_lock(ctx->types->lock);
+    struct type * t = type_intern_locked(kind, primitive, name, spec);
+    pthread_mutex_unlock(ctx->types->lock);
     return t;
 }
 
+struct type * type_create_primitive(primitives_t kind, struct type_spec * spec)
+{
+    return type_intern(TYPE_PRIMITIVE, kind, 0, spec);
+}
+
+struct type * type_create_name(const char * name)
+{
+    return type_intern(TYPE_NAME, 0, name, 0);
+}
+
 struct decl * decl_create_global_variable_value(struct type * type_, struct ident * i, struct expr * value, struct decl * next)
 {
-    struct decl * d = malloc(sizeof(*d));
+    struct decl * d = node_alloc(d);
     d->kind = DECL_VARIABLE_GLOBAL;
 
-    d->decl_ = malloc(sizeof(*d->decl_));
+    d->decl_ = arena_alloc(ctx->arena, sizeof(*d->decl_));
 
-    struct decl_variable * v = malloc(sizeof(*v));
+    struct decl_variable * v = arena_alloc(ctx->arena, sizeof(*v));
 
     v->name = i;
     v->value = value;
 
     d->decl_->variable = v;
     d->next = next;
+    d->exported = 0;
     v->type_ = type_;
 
+    if (type_->kind == TYPE_PRIMITIVE)
+    {
+        v->size = get_primitive_size(type_->type_->kind);
+    }
+
     return d;
 }
 
@@ -802,12 +1021,12 @@ int get_primitive_size(type_t t)
 
 struct decl * decl_create_local_variable_value(struct type * type_, struct ident * i, struct expr * value, struct decl * next)
 {
-    struct decl * d = malloc(sizeof(*d));
+    struct decl * d = node_alloc(d);
     d->kind = DECL_VARIABLE_LOCAL;
 
-    d->decl_ = malloc(sizeof(*d->decl_));
+    d->decl_ = arena_alloc(ctx->arena, sizeof(*d->decl_));
 
-    struct decl_variable * v = malloc(sizeof(*v));
+    struct decl_variable * v = arena_alloc(ctx->arena, sizeof(*v));
 
     v->name = i;
     v->value = value;
@@ -827,9 +1046,9 @@ struct decl * decl_create_local_variable_value(struct type * type_, struct ident
 
 struct stmt * stmt_create_return(struct expr * return_value)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_RETURN;
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
 
     s->stmt_->expression = return_value;
 
@@ -838,9 +1057,9 @@ struct stmt * stmt_create_return(struct expr * return_value)
 
 struct stmt * stmt_create_expr(struct expr * expression, struct expr * next)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_EXPR;
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
 
     s->stmt_->expression = expression;
     s->next = next;
@@ -850,10 +1069,10 @@ struct stmt * stmt_create_expr(struct expr * expression, struct expr * next)
 
 struct stmt * stmt_create_decl(struct decl * declaration, struct stmt * next)
 {
-    struct stmt * s = malloc(sizeof(*s));
+    struct stmt * s = node_alloc(s);
     s->kind = STMT_DECL;
 
-    s->stmt_ = malloc(sizeof(*s->stmt_));
+    s->stmt_ = arena_alloc(ctx->arena, sizeof(*s->stmt_));
 
     s->stmt_->declaration = declaration;
     s->next = next;
@@ -861,257 +1080,696 @@ struct stmt * stmt_create_decl(struct decl * declaration, struct stmt * next)
     return s;
 }
 
+// The parser builds lists newest first; these put them back in source order.
+struct stmt * stmt_list_reverse(struct stmt * s)
+{
+    struct stmt * reversed = 0;
+    while (s)
+    {
+        struct stmt * next = s->next;
+        s->next = reversed;
+        reversed = s;
+        s = next;
+    }
+
+    return reversed;
+}
+
+// Else-if links are chained through else_stmt rather than next. The closing
+// else, if any, is hung off the end once the chain is back in order.
+struct stmt * stmt_else_chain_reverse(struct stmt * s, struct stmt * else_stmt)
+{
+    struct stmt * reversed = else_stmt;
+    while (s)
+    {
+        struct stmt * next = s->stmt_->if_stmt->else_stmt;
+        s->stmt_->if_stmt->else_stmt = reversed;
+        reversed = s;
+        s = next;
+    }
+
+    return reversed;
+}
+
+struct decl * decl_list_reverse(struct decl * d)
+{
+    struct decl * reversed = 0;
+    while (d)
+    {
+        struct decl * next = d->next;
+        d->next = reversed;
+        reversed = d;
+        d = next;
+    }
+
+    return reversed;
+}
+
 struct ident * ident_create(const char * name, int offset)
 {
-    struct ident * i = malloc(sizeof(*i));
+    struct ident * i = node_alloc(i);
     i->name = name;
+    i->hash = intern_hash(name);
     i->offset = offset;
 
     return i;
 }
 
-// Semantic Analysis
+// Constant subscripts fold into the offset; anything else is computed when
+// the element is accessed.
+struct ident * ident_create_index(const char * name, struct expr * index)
+{
+    if (index && index->kind == EXPR_INTEGER)
+    {
+        return ident_create(name, index->expr_->integer_value);
+    }
 
-// Scope
+    struct ident * i = ident_create(name, 0);
+    i->index = index;
+
+    return i;
+}
 
-struct scopeStack * scope;
+// Semantic Analysis
 
-struct symbolTableEntry
+// Scope
+//
+// A single open-addressing table maps each interned name to its innermost
+// binding; bindings it shadows hang off symbol->shadowed. Every bind is pushed
+// on an undo log and scope_exit() rolls the log back to the mark taken by
+// scope_enter(), so entering or leaving a block is O(1) and a lookup is one
+// probe sequence however deep the nesting is.
+
+struct scopeSlot
 {
+    const char * name;
+    unsigned int hash;
     struct symbol * sym;
-    struct symbolTableEntry * next;
 };
 
-struct symbolTable
+struct scopeUndo
 {
-    struct symbolTableEntry ** table;
-    int size;
+    struct ident * identifier;
+    struct symbol * sym;
 };
 
-struct scopeStackElement
+struct scopeStack
 {
-    struct symbolTable * symbolTable;
+    struct scopeSlot * slots;
+    int capacity;
+    int count;
+
+    struct scopeUndo * log;
+    int log_size;
+    int log_capacity;
+
+    int * marks;
     int level;
-    struct scopeStackElement * next;
+    int marks_capacity;
 };
 
-struct scopeStack
-{
-    struct scopeStackElement * top;
-};
+void symbol_layout(struct symbol * s);
 
 struct symbol * symbol_create( symbol_t kind, struct type * type, struct ident * name, int position, int size)
 {
-    struct symbol * s = malloc(sizeof(*s));
+    struct symbol * s = arena_alloc(ctx->arena, sizeof(*s));
     s->identifier = name;
     s->kind = kind;
     s->type = type;
     s->position = position;
     s->size = size;
+    s->vreg = 0;
+    symbol_layout(s);
 
     return s;
 }
 
-struct symbolTable * symbol_table_create(int size)
+struct scopeStack * scope_stack_create()
 {
-    struct symbolTable * t= malloc(sizeof(*t));
-    t->size = size;
-    t->table = (struct symbolTableEntry **)malloc(sizeof(struct symbolTableEntry*) * size);
-
-    for (int i = 0; i < size; i++)
-    {
-        t->table[i] = 0;
-    }
+    struct scopeStack * s = calloc(1, sizeof(*s));
+    s->level = -1;
 
-    return t;
+    return s;
 }
 
-void symbol_insert(struct symbolTable * table, struct ident * identifier, struct symbol * sym)
-{  
-    if (!table || !identifier || !sym) return;
-
-    if (!identifier->name) return;
-    unsigned int hash = 0;
-    for (const char * p = identifier->name; *p != '\0'; p++)
-    {
-        hash = hash * 31 + (unsigned int)*p;
-    }
-    hash = hash % table->size;
+void scope_stack_release(struct scopeStack * s)
+{
+    if (!s) return;
 
-    struct symbolTableEntry * entry = malloc(sizeof(*entry));
-    entry->sym = sym;
-    entry->next = 0;
+    free(s->slots);
+    free(s->log);
+    free(s->marks);
+    free(s);
+}
 
-    if (table->table[hash] == 0)
+// Drops every binding but keeps the storage for the next compile.
+void scope_stack_reset(struct scopeStack * s)
+{
+    if (s->slots)
     {
-        table->table[hash] = entry;
+        memset(s->slots, 0, s->capacity * sizeof(*s->slots));
     }
-    else
+    s->count = 0;
+    s->log_size = 0;
+    s->level = -1;
+}
+
+struct scopeSlot * scope_slot(struct ident * identifier)
+{
+    int mask = ctx->scope->capacity - 1;
+    int i = identifier->hash & mask;
+    while (ctx->scope->slots[i].name)
     {
-        struct symbolTableEntry * current = table->table[hash];
-        while (current->next != 0)
+        if (ctx->scope->slots[i].name == identifier->name)
         {
-            current = current->next;
+            return &ctx->scope->slots[i];
         }
-        current->next = entry;
+        i = (i + 1) & mask;
     }
+    return &ctx->scope->slots[i];
 }
 
-struct symbol * symbol_find(struct symbolTable * table, struct ident * identifier)
+void scope_grow()
 {
-    if (!table || !identifier) return 0;
+    struct scopeSlot * old = ctx->scope->slots;
+    int old_capacity = ctx->scope->capacity;
 
-    unsigned int hash = 0;
-    for (const char * p = identifier->name; * p != '\0'; p++)
-    {
-        hash = hash * 31 + (unsigned int)*p;
-    }
-    hash = hash % table->size;
+    ctx->scope->capacity = old_capacity ? old_capacity * 2 : 256;
+    ctx->scope->slots = calloc(ctx->scope->capacity, sizeof(*ctx->scope->slots));
+    ctx->scope->count = 0;
 
-    struct symbolTableEntry * current = table->table[hash];
-    while (current != 0)
+    // Slots whose binding has been rolled back are dropped here; nothing on
+    // the undo log refers to them any more.
+    int mask = ctx->scope->capacity - 1;
+    for (int i = 0; i < old_capacity; i++)
     {
-        if (strcmp(current->sym->identifier->name, identifier->name) == 0)
+        if (!old[i].sym) continue;
+
+        int j = old[i].hash & mask;
+        while (ctx->scope->slots[j].name)
         {
-            return current->sym;
+            j = (j + 1) & mask;
         }
-        current = current->next;
+        ctx->scope->slots[j] = old[i];
+        ctx->scope->count++;
     }
 
-    return 0;
-}
-
-struct scopeStack * scope_stack_create()
-{
-    struct scopeStack * s = malloc(sizeof(*s));
-    s->top = 0;
-
-    return s;
+    free(old);
 }
 
 void scope_enter()
 {
-    struct scopeStackElement * e = malloc(sizeof(*e));
-    e->symbolTable = symbol_table_create(256);
-    e->level = (scope->top == 0) ? 0 : (scope->top->level + 1);
-    e->next = scope->top;
-    scope->top = e;
+    if (ctx->scope->level + 1 == ctx->scope->marks_capacity)
+    {
+        ctx->scope->marks_capacity = ctx->scope->marks_capacity ? ctx->scope->marks_capacity * 2 : 64;
+        ctx->scope->marks = realloc(ctx->scope->marks, sizeof(*ctx->scope->marks) * ctx->scope->marks_capacity);
+    }
+    ctx->scope->marks[++ctx->scope->level] = ctx->scope->log_size;
 }
 
 void scope_exit()
 {
-    if (scope->top != 0)
+    if (ctx->scope->level < 0) return;
+
+    int mark = ctx->scope->marks[ctx->scope->level--];
+    while (ctx->scope->log_size > mark)
     {
-        struct scopeStackElement * e = scope->top;
-        scope->top = e->next;
-        free(e);
+        struct scopeUndo * u = &ctx->scope->log[--ctx->scope->log_size];
+        scope_slot(u->identifier)->sym = u->sym->shadowed;
     }
 }
 
 int scope_level()
 {
-    if (scope->top != 0)
-    {
-        return scope->top->level;
-    }
-    return -1;
+    return ctx->scope->level;
 }
 
 void scope_bind(struct ident * identifier, struct symbol *sym)
 {
-    if (scope->top != 0)
+    if (ctx->scope->level < 0 || !identifier || !sym) return;
+
+    if ((ctx->scope->count + 1) * 2 > ctx->scope->capacity)
+    {
+        scope_grow();
+    }
+    if (ctx->scope->log_size == ctx->scope->log_capacity)
     {
-        struct symbolTable * s = scope->top->symbolTable;
-        symbol_insert(s, identifier, sym);
+        ctx->scope->log_capacity = ctx->scope->log_capacity ? ctx->scope->log_capacity * 2 : 256;
+        ctx->scope->log = realloc(ctx->scope->log, sizeof(*ctx->scope->log) * ctx->scope->log_capacity);
     }
+
+    struct scopeSlot * slot = scope_slot(identifier);
+    if (!slot->name)
+    {
+        slot->name = identifier->name;
+        slot->hash = identifier->hash;
+        ctx->scope->count++;
+    }
+
+    sym->shadowed = slot->sym;
+    sym->level = ctx->scope->level;
+    slot->sym = sym;
+
+    ctx->scope->log[ctx->scope->log_size].identifier = identifier;
+    ctx->scope->log[ctx->scope->log_size].sym = sym;
+    ctx->scope->log_size++;
 }
 
 struct symbol * scope_lookup(struct ident * identifier)
 {
-    struct scopeStackElement * s = scope->top;
-    while (s != 0)
-    {
-        struct symbolTable * t = s->symbolTable;
-        struct symbol * sym = symbol_find(t, identifier);
-        if (sym != 0)
-        {
-            return sym;
-        }
-        s = s->next;
-    }
-    return 0;
+    if (!ctx->scope->capacity) return 0;
+
+    return scope_slot(identifier)->sym;
 }
 
 struct symbol * scope_lookup_current(struct ident * identifier)
 {
-    if (scope->top != 0)
+    struct symbol * sym = scope_lookup(identifier);
+    if (sym && sym->level == ctx->scope->level)
     {
-        struct symbolTable * t = scope->top->symbolTable;
-        return symbol_find(t, identifier);
+        return sym;
     }
     return 0;
 }
 
-// Resolve
+// Modules
+//
+// A program of several files is compiled one module per file. `mod name;`
+// names a module (it is named after its file otherwise), `include name;`
+// brings another module's pub declarations into its global scope, and a
+// declaration is private to its module unless marked pub. Every module's
+// interface is taken from its tree as soon as it is parsed, so modules can
+// be resolved in any order, and include each other, once all are parsed.
+// Generated code refers to functions and globals by name, so names have to
+// be unique across the program, private ones included.
+
+// One pub declaration: what an including module binds its name to.
+struct module_symbol
+{
+    struct ident * identifier;
+    struct type * type;
+    int size;
+    decl_t kind;
 
-void expr_function_call_arg_resolve(struct expr_function_arg * a, struct decl_function * f)
+    struct module_symbol * next;
+};
+
+struct module_include
 {
-    if (!a || error) return;
+    const char * name;
 
-    symbol_t kind = scope_level() > 0 ? SYMBOL_LOCAL : SYMBOL_GLOBAL;
+    // Found when the including module is resolved.
+    struct module * module;
 
-    
-    expr_resolve(a->value, f);
+    struct module_include * next;
+};
+
+struct module
+{
+    const char * path;
+    const char * name;
+
+    // The context borrows the program's intern and type tables through a
+    // session of its own.
+    struct hend_session session;
+    struct hend_context * context;
+
+    // Parsing failed.
+    int failed;
 
-    expr_function_call_arg_resolve(a->next, f);
+    // Loaded from an interface file: not compiled here, only included.
+    int external;
 
+    struct module_include * includes;
+    struct module_symbol * interface;
+
+    // The module's own diagnostics, gathered into the program's at the end.
+    char * diagnostics;
+    size_t diagnostics_length;
+};
+
+void module_name(const char * name)
+{
+    if (ctx->module)
+    {
+        ctx->module->name = name;
+    }
 }
 
-void expr_function_call_resolve(struct expr_function_call * c, struct decl_function * f)
+void module_include(const char * name)
 {
-    expr_function_call_arg_resolve(c->arguments, f);
+    if (!ctx->module)
+    {
+        fprintf(ctx->diagnostics, "error: include %s needs the other files of the program or their interfaces.\n", name);
+        ctx->error = 1;
+        return;
+    }
+
+    struct module_include * i = arena_alloc(ctx->arena, sizeof(*i));
+    i->name = name;
+    i->module = 0;
+    i->next = ctx->module->includes;
+    ctx->module->includes = i;
 }
 
-void ident_resolve(struct ident * i)
+// Collects the module's pub declarations, in the module's own arena.
+void module_interface(struct module * m)
 {
-    if (!i) return;
+    struct module_symbol ** tail = &m->interface;
+    for (struct decl * d = ctx->code; d; d = d->next)
+    {
+        if (!d->exported) continue;
 
-    i->sym = scope_lookup(i);
-    if (!i->sym)
+        struct module_symbol * s = arena_alloc(ctx->arena, sizeof(*s));
+        s->kind = d->kind;
+        if (d->kind == DECL_FUNCTION)
+        {
+            s->identifier = d->decl_->function->identifier;
+            s->type = d->decl_->function->return_type;
+            s->size = 0;
+        }
+        else
+        {
+            s->identifier = d->decl_->variable->name;
+            s->type = d->decl_->variable->type_;
+            s->size = d->decl_->variable->size;
+        }
+        s->next = 0;
+
+        *tail = s;
+        tail = &s->next;
+    }
+}
+
+struct module * module_find(struct module * modules, int count, const char * name)
+{
+    for (int i = 0; i < count; i++)
     {
-        printf("error: '%s' is not defined.\n", i->name);
-        throw_error();
+        if (modules[i].name == name) return &modules[i];
     }
+    return 0;
 }
 
-void expr_resolve(struct expr * e, struct decl_function * f)
+// Binds the interfaces of the modules m includes in its global scope. The
+// other modules are being resolved at the same time, so nothing of theirs
+// is written to; m gets identifiers and symbols of its own. m's own
+// functions are bound first, so a call to one declared further down is
+// found too; a callee that is found nowhere is then an error. Every
+// include has been found by now.
+void module_import(struct module * m)
 {
-    if (!e || error) return;
+    for (struct decl * d = ctx->code; d; d = d->next)
+    {
+        if (d->kind != DECL_FUNCTION) continue;
 
-    switch (e->kind)
+        struct decl_function * f = d->decl_->function;
+        scope_bind(f->identifier, symbol_create(SYMBOL_GLOBAL, f->return_type, f->identifier, 0, 0));
+    }
+
+    for (struct module_include * i = m->includes; i; i = i->next)
     {
-    case EXPR_ADD:
-        expr_resolve(e->expr_->operation->left, f);
-        expr_resolve(e->expr_->operation->right, f);
-        break;
-    case EXPR_SUB:
-        expr_resolve(e->expr_->operation->left, f);
-        expr_resolve(e->expr_->operation->right, f);
-        break;
-    case EXPR_MUL:
-        expr_resolve(e->expr_->operation->left, f);
-        expr_resolve(e->expr_->operation->right, f);
-        break;
-    case EXPR_DIV:
-        expr_resolve(e->expr_->operation->left, f);
-        expr_resolve(e->expr_->operation->right, f);
-        break;
-    case EXPR_EQUAL:
-        expr_resolve(e->expr_->operation->left, f);
-        expr_resolve(e->expr_->operation->right, f);
-        break;
-    case EXPR_NOT_EQUAL:
-        expr_resolve(e->expr_->operation->left, f);
+        for (struct module_symbol * s = i->module->interface; s; s = s->next)
+        {
+            struct ident * name = ident_create(s->identifier->name, 0);
+            scope_bind(name, symbol_create(SYMBOL_GLOBAL, s->type, name, 0, s->size));
+        }
+    }
+}
+
+// Reports top-level names declared by more than one module, using the
+// program's own scope: each name is bound to a symbol whose position is
+// the module that declared it first.
+int module_duplicates(struct module * modules, int count)
+{
+    int duplicates = 0;
+
+    scope_enter();
+    for (int i = 0; i < count; i++)
+    {
+        for (struct decl * d = modules[i].context->code; d; d = d->next)
+        {
+            struct ident * name = d->kind == DECL_FUNCTION ? d->decl_->function->identifier : d->decl_->variable->name;
+            struct symbol * first = scope_lookup_current(name);
+            if (first && first->position != i)
+            {
+                fprintf(ctx->diagnostics, "error: %s is declared in both %s and %s.\n", name->name, modules[first->position].path, modules[i].path);
+                duplicates++;
+            }
+            else if (!first)
+            {
+                scope_bind(name, symbol_create(SYMBOL_GLOBAL, 0, name, i, 0));
+            }
+        }
+    }
+    scope_exit();
+
+    return duplicates;
+}
+
+// Module interfaces
+//
+// -I DIR keeps every module's interface in DIR/name.hmi once the module is
+// resolved, and loads the interface of an included module that is not
+// among the files from there; its code comes from a unit compiled on its
+// own and linked in. A loaded interface is turned into module symbols once,
+// its names interned and its types found in the shared table, so including
+// it costs what including a module of the program does.
+
+void module_interface_path(char * path, size_t size, const char * dir, const char * name)
+{
+    snprintf(path, size, "%s/%s.hmi", dir, name);
+}
+
+// Writes m's interface to dir. Returns -1 if it cannot be written.
+int module_interface_store(struct module * m, const char * dir)
+{
+    struct interface_writer w = { 0 };
+    for (struct module_symbol * s = m->interface; s; s = s->next)
+    {
+        struct interface_symbol r = { 0 };
+        r.name_length = strlen(s->identifier->name);
+        r.name = interface_put_string(&w, s->identifier->name, r.name_length);
+        r.size = s->size;
+        r.kind = s->kind;
+
+        struct type * t = s->type;
+        if (t && t->type_)
+        {
+            r.type = 1 + t->kind;
+            if (t->kind == TYPE_NAME)
+            {
+                r.type_name_length = strlen(t->type_->name);
+                r.type_name = interface_put_string(&w, t->type_->name, r.type_name_length);
+            }
+            else
+            {
+                r.primitive = t->type_->kind;
+            }
+
+            struct type_spec * spec = t->type_specifier;
+            r.spec = spec ? spec->kind : TYPE_SPEC_NONE;
+            r.dimensions = w.dimension_count;
+            for (struct array_sub * a = spec ? spec->sub : 0; a; a = a->next)
+            {
+                interface_put_dimension(&w, a->i);
+                r.dimension_count++;
+            }
+        }
+
+        interface_put_symbol(&w, &r);
+    }
+
+    char path[4096];
+    module_interface_path(path, sizeof(path), dir, m->name);
+    int failed = interface_write(&w, dir, path, m->name);
+    interface_writer_release(&w);
+    return failed;
+}
+
+struct type * module_symbol_type(const struct interface_image * image, const struct interface_symbol * r)
+{
+    if (!r->type) return 0;
+
+    struct type_spec * spec = 0;
+    if (r->spec == TYPE_SPEC_POINTER)
+    {
+        spec = type_spec_create_pointer();
+    }
+    else if (r->spec == TYPE_SPEC_ARRAY)
+    {
+        struct array_sub * sub = 0;
+        for (uint32_t i = r->dimension_count; i > 0; i--)
+        {
+            sub = array_sub_create(image->dimensions[r->dimensions + i - 1], sub);
+        }
+        spec = type_spec_create_array(sub);
+    }
+
+    if (r->type - 1 == TYPE_NAME)
+    {
+        return type_intern(TYPE_NAME, 0, intern(image->strings + r->type_name, r->type_name_length), spec);
+    }
+    return type_intern(TYPE_PRIMITIVE, r->primitive, 0, spec);
+}
+
+// Loads the interface of the module called name from dir into a module of
+// its own. Returns -1 if there is none, -2 if the file is damaged or is the
+// interface of another module.
+int module_load(struct module ** loaded, const char * dir, const char * name)
+{
+    char path[4096];
+    module_interface_path(path, sizeof(path), dir, name);
+
+    struct interface_image image;
+    int failed = interface_open(&image, path);
+    if (failed) return failed;
+
+    const struct interface_header * h = image.header;
+    if (intern(image.strings + h->name, h->name_length) != name)
+    {
+        interface_close(&image);
+        return -2;
+    }
+    for (uint32_t i = 0; i < h->symbol_count; i++)
+    {
+        const struct interface_symbol * r = &image.symbols[i];
+        if ((r->kind != DECL_FUNCTION && r->kind != DECL_VARIABLE_GLOBAL) || r->type > 1 + TYPE_NAME
+            || r->primitive > PRIMITIVE_CHAR || r->spec > TYPE_SPEC_ARRAY)
+        {
+            interface_close(&image);
+            return -2;
+        }
+    }
+
+    struct module * m = arena_alloc(ctx->arena, sizeof(*m));
+    memset(m, 0, sizeof(*m));
+    size_t length = strlen(path) + 1;
+    m->path = memcpy(arena_alloc(ctx->arena, length), path, length);
+    m->name = name;
+    m->external = 1;
+
+    struct module_symbol ** tail = &m->interface;
+    for (uint32_t i = 0; i < h->symbol_count; i++)
+    {
+        const struct interface_symbol * r = &image.symbols[i];
+        struct module_symbol * s = arena_alloc(ctx->arena, sizeof(*s));
+        s->identifier = ident_create(intern(image.strings + r->name, r->name_length), 0);
+        s->type = module_symbol_type(&image, r);
+        s->size = r->size;
+        s->kind = r->kind;
+        s->next = 0;
+
+        *tail = s;
+        tail = &s->next;
+    }
+
+    interface_close(&image);
+    *loaded = m;
+    return 0;
+}
+
+// The code of a loaded module's declarations is in another unit.
+void module_externs(struct module * m)
+{
+    for (struct module_symbol * s = m->interface; s; s = s->next)
+    {
+        emit_extern(s->kind == DECL_FUNCTION ? "function_" : "global_", s->identifier->name);
+    }
+}
+
+// Resolve
+
+void expr_function_call_arg_resolve(struct expr_function_arg * a, struct decl_function * f)
+{
+    for (; a && !ctx->error; a = a->next)
+    {
+        expr_resolve(a->value, f);
+    }
+}
+
+void expr_function_call_resolve(struct expr_function_call * c, struct decl_function * f)
+{
+    // The runtime's print and printNum are not declared anywhere, so a
+    // callee that is not found is left alone here.
+    struct symbol * callee = scope_lookup(c->identifier);
+    if (callee)
+    {
+        c->identifier->sym = callee;
+        c->return_type = callee->type;
+    }
+    else if (ctx->module && strcmp(c->identifier->name, "print") && strcmp(c->identifier->name, "printNum"))
+    {
+        // In a program of several files every function has been bound by
+        // now, so this is a name that is undefined or private to another
+        // module, which would otherwise link.
+        fprintf(ctx->diagnostics, "error: '%s' is not defined.\n", c->identifier->name);
+        throw_error();
+        return;
+    }
+
+    expr_function_call_arg_resolve(c->arguments, f);
+}
+
+void ident_resolve(struct ident * i, struct decl_function * f)
+{
+    if (!i) return;
+
+    i->sym = scope_lookup(i);
+    if (!i->sym)
+    {
+        fprintf(ctx->diagnostics, "error: '%s' is not defined.\n", i->name);
+        throw_error();
+    }
+
+    expr_resolve(i->index, f);
+}
+
+// The grammar lets any expression be empty, so an operator can end up with
+// nothing on one side (the second = of x == 1) and an assignment or a
+// statement with nothing at all. Codegen needs every one of them.
+int expr_operand_missing(struct expr * e)
+{
+    if (e->kind == EXPR_ASSIGN) return !e->expr_->assign->expression;
+
+    int binary = e->kind <= EXPR_DIV || e->kind >= EXPR_EQUAL;
+    return binary && (!e->expr_->operation->left || !e->expr_->operation->right);
+}
+
+void expr_resolve(struct expr * e, struct decl_function * f)
+{
+    if (!e || ctx->error) return;
+
+    if (expr_operand_missing(e))
+    {
+        fprintf(ctx->diagnostics, "error: missing operand.\n");
+        throw_error();
+        return;
+    }
+
+    switch (e->kind)
+    {
+    case EXPR_ADD:
+        expr_resolve(e->expr_->operation->left, f);
+        expr_resolve(e->expr_->operation->right, f);
+        break;
+    case EXPR_SUB:
+        expr_resolve(e->expr_->operation->left, f);
+        expr_resolve(e->expr_->operation->right, f);
+        break;
+    case EXPR_MUL:
+        expr_resolve(e->expr_->operation->left, f);
+        expr_resolve(e->expr_->operation->right, f);
+        break;
+    case EXPR_DIV:
+        expr_resolve(e->expr_->operation->left, f);
+        expr_resolve(e->expr_->operation->right, f);
+        break;
+    case EXPR_EQUAL:
+        expr_resolve(e->expr_->operation->left, f);
+        expr_resolve(e->expr_->operation->right, f);
+        break;
+    case EXPR_NOT_EQUAL:
+        expr_resolve(e->expr_->operation->left, f);
         expr_resolve(e->expr_->operation->right, f);
         break;
     case EXPR_GREATER:
@@ -1132,7 +1790,7 @@ void expr_resolve(struct expr * e, struct decl_function * f)
         break;
     case EXPR_IDENTIFIER:
         
-        ident_resolve(e->expr_->identifier);
+        ident_resolve(e->expr_->identifier, f);
         break;
     case EXPR_INTEGER:
         e->size = 8;
@@ -1141,7 +1799,11 @@ void expr_resolve(struct expr * e, struct decl_function * f)
         e->size = 8;
         break;
     case EXPR_ASSIGN:
-        ident_resolve(e->expr_->assign->identifier);
+        ident_resolve(e->expr_->assign->identifier, f);
+        if (e->expr_->assign->identifier->sym)
+        {
+            e->expr_->assign->identifier->sym->assignments++;
+        }
         expr_resolve(e->expr_->assign->expression, f);
         break;
     case EXPR_FUNCTION_CALL:
@@ -1155,175 +1817,202 @@ void expr_resolve(struct expr * e, struct decl_function * f)
 
 struct symbol * param_resolve(struct function_param * p, struct decl_function * f)
 {
-    if (!p || error) return;
+    struct symbol * first = 0;
+    struct symbol ** link = &first;
+
+    // Arguments are pushed first to last, so the last parameter sits right
+    // above the return address and the first one furthest from it.
+    int count = 0;
+    for (struct function_param * q = p; q; q = q->next)
+    {
+        count++;
+    }
 
-    p->sym = symbol_create(SYMBOL_LOCAL, p->type_, p->identifier, f->variable_count, p->size);
-    p->sym->isParam = 1;
+    for (; p && !ctx->error; p = p->next)
+    {
+        p->sym = symbol_create(SYMBOL_LOCAL, p->type_, p->identifier, f->variable_count, p->size);
+        p->sym->isParam = 1;
 
-    expr_resolve(p->value, f);
-    scope_bind(p->identifier, p->sym);
-    
-    p->sym->position = f->parameter_count;
+        expr_resolve(p->value, f);
+        scope_bind(p->identifier, p->sym);
 
-    f->parameter_count += 8;
+        p->sym->position = (count - 1) * 8 - f->parameter_count;
+        symbol_layout(p->sym);
 
-    p->sym->next = param_resolve(p->next, f);
+        f->parameter_count += 8;
 
-    return p->sym;
+        *link = p->sym;
+        link = &p->sym->next;
+    }
+
+    return first;
 }
 
 int get_array_size(struct array_sub * sub)
 {
-    if (!sub) return 1;
-    return sub->i * get_array_size(sub->next);
+    int size = 1;
+    for (; sub; sub = sub->next)
+    {
+        size *= sub->i;
+    }
+    return size;
 }
 
 void decl_resolve(struct decl * d, struct decl_function * f)
 {
-    if (!d || error) return;
-
-    symbol_t kind = scope_level() > 0 ? SYMBOL_LOCAL : SYMBOL_GLOBAL;
-
-    switch (d->kind)
+    for (; d && !ctx->error; d = d->next)
     {
-    case DECL_VARIABLE_GLOBAL:
-        if (d->decl_->variable->type_->type_specifier)
+        symbol_t kind = scope_level() > 0 ? SYMBOL_LOCAL : SYMBOL_GLOBAL;
+
+        switch (d->kind)
         {
-            switch (d->decl_->variable->type_->type_specifier->kind)
+        case DECL_VARIABLE_GLOBAL:
+            if (d->decl_->variable->type_->type_specifier)
             {
-            case TYPE_SPEC_ARRAY:
-                f->variable_count += d->decl_->variable->size * get_array_size(d->decl_->variable->type_->type_specifier->sub);
-                d->decl_->variable->sym = symbol_create(kind, d->decl_->variable->type_, d->decl_->variable->name, f ? f->variable_count : 0, d->decl_->variable->size * get_array_size(d->decl_->variable->type_->type_specifier->sub));
-                expr_resolve(d->decl_->variable->value, f);
+                switch (d->decl_->variable->type_->type_specifier->kind)
+                {
+                case TYPE_SPEC_ARRAY:
+                    d->decl_->variable->sym = symbol_create(kind, d->decl_->variable->type_, d->decl_->variable->name, 0, d->decl_->variable->size);
+                    expr_resolve(d->decl_->variable->value, f);
+                    scope_bind(d->decl_->variable->name, d->decl_->variable->sym);
+                    break;
+                case TYPE_SPEC_POINTER:
+                    /* code */
+                    break;
+
+                default:
+                    break;
+                }
+            }
+            else
+            {
+                d->decl_->variable->sym = symbol_create(kind, d->decl_->variable->type_, d->decl_->variable->name, 0, d->decl_->variable->size);
+                expr_resolve(d->decl_->variable->value, 0);
                 scope_bind(d->decl_->variable->name, d->decl_->variable->sym);
-                break;
-            case TYPE_SPEC_POINTER:
-                /* code */
-                break;
-            
-            default:
-                break;
             }
-        }
-        else
-        {
-            d->decl_->variable->sym = symbol_create(kind, d->decl_->variable->type_, d->decl_->variable->name, 0, d->decl_->variable->size);
-            expr_resolve(d->decl_->variable->value, 0);
-            scope_bind(d->decl_->variable->name, d->decl_->variable->sym);
-        }
-        break;
-    case DECL_VARIABLE_LOCAL:
-        if (d->decl_->variable->type_->type_specifier)
-        {   
-            switch (d->decl_->variable->type_->type_specifier->kind)
+            break;
+        case DECL_VARIABLE_LOCAL:
+            if (d->decl_->variable->type_->type_specifier)
+            {   
+                switch (d->decl_->variable->type_->type_specifier->kind)
+                {
+                case TYPE_SPEC_ARRAY:
+                    f->variable_count += d->decl_->variable->size * get_array_size(d->decl_->variable->type_->type_specifier->sub);
+                    d->decl_->variable->sym = symbol_create(kind, d->decl_->variable->type_, d->decl_->variable->name, f ? f->variable_count : 0, d->decl_->variable->size);
+                    expr_resolve(d->decl_->variable->value, f);
+                    scope_bind(d->decl_->variable->name, d->decl_->variable->sym);
+                    break;
+                case TYPE_SPEC_POINTER:
+                    /* code */
+                    break;
+
+                default:
+                    break;
+                }
+            }
+            else
             {
-            case TYPE_SPEC_ARRAY:
-                f->variable_count += d->decl_->variable->size * get_array_size(d->decl_->variable->type_->type_specifier->sub);
+                f->variable_count += d->decl_->variable->size;
                 d->decl_->variable->sym = symbol_create(kind, d->decl_->variable->type_, d->decl_->variable->name, f ? f->variable_count : 0, d->decl_->variable->size);
                 expr_resolve(d->decl_->variable->value, f);
                 scope_bind(d->decl_->variable->name, d->decl_->variable->sym);
-                break;
-            case TYPE_SPEC_POINTER:
-                /* code */
-                break;
-            
-            default:
-                break;
             }
-        }
-        else
-        {
-            f->variable_count += d->decl_->variable->size;
-            d->decl_->variable->sym = symbol_create(kind, d->decl_->variable->type_, d->decl_->variable->name, f ? f->variable_count : 0, d->decl_->variable->size);
-            expr_resolve(d->decl_->variable->value, f);
-            scope_bind(d->decl_->variable->name, d->decl_->variable->sym);
-        }
-        break;
-    case DECL_FUNCTION:
+            break;
+        case DECL_FUNCTION:
 
-        symbol_t kind = scope_level() > 0 ? SYMBOL_LOCAL : SYMBOL_GLOBAL;
+            symbol_t kind = scope_level() > 0 ? SYMBOL_LOCAL : SYMBOL_GLOBAL;
 
-        d->decl_->function->identifier->sym = symbol_create(kind, d->decl_->function->return_type, d->decl_->function->identifier, 0, 0);
+            d->decl_->function->identifier->sym = symbol_create(kind, d->decl_->function->return_type, d->decl_->function->identifier, 0, 0);
 
-        scope_bind(d->decl_->function->identifier, d->decl_->function->identifier->sym);
-        
-        if (d->decl_->function->body)
-        {
-            scope_enter();
-            d->decl_->function->identifier->sym->next = param_resolve(d->decl_->function->param, d->decl_->function);
-            stmt_resolve(d->decl_->function->body, d->decl_->function);
-            scope_exit();
+            scope_bind(d->decl_->function->identifier, d->decl_->function->identifier->sym);
+
+            // A cached function is only ever called, so its symbol is all
+            // the rest of the unit needs of it.
+            if (d->decl_->function->body && !d->decl_->function->cached)
+            {
+                scope_enter();
+                d->decl_->function->identifier->sym->next = param_resolve(d->decl_->function->param, d->decl_->function);
+                stmt_resolve(d->decl_->function->body, d->decl_->function);
+                scope_exit();
+            }
+            break;
+
+        default:
+            break;
         }
+    }
+}
 
-        decl_resolve(d->next, f);
-        break;
-    
-    default:
-        break;
+void expr_resolve_required(struct expr * e, struct decl_function * f)
+{
+    if (!e && !ctx->error)
+    {
+        fprintf(ctx->diagnostics, "error: missing expression.\n");
+        throw_error();
     }
+    expr_resolve(e, f);
 }
 
 void stmt_resolve(struct stmt * s, struct decl_function * f)
 {
-    if (!s || error) return;
-
-    switch (s->kind)
+    for (; s && !ctx->error; s = s->next)
     {
-    case STMT_DECL:
-        decl_resolve(s->stmt_->declaration, f);
-        break;
-    case STMT_EXPR:
-        expr_resolve(s->stmt_->expression, f);
-        break;
-    case STMT_RETURN:
-        expr_resolve(s->stmt_->expression, f);
-        break;
-    case STMT_IF:
-        scope_enter();
-        expr_resolve(s->stmt_->if_stmt->expression, f);
-        stmt_resolve(s->stmt_->if_stmt->statement, f);
-        stmt_resolve(s->stmt_->if_stmt, f);
-        scope_exit();
-        break;
-    case STMT_ELSE_IF:
-        scope_enter();
-        expr_resolve(s->stmt_->if_stmt->expression, f);
-        stmt_resolve(s->stmt_->if_stmt->statement, f);
-        stmt_resolve(s->stmt_->if_stmt, f);
-        scope_exit();
-        break;
-    case STMT_ELSE:
-        scope_enter();
-        expr_resolve(s->stmt_->if_stmt->expression, f);
-        stmt_resolve(s->stmt_->if_stmt->statement, f);
-        scope_exit();
-        break;
-    case STMT_WHILE:
-        scope_enter();
-        expr_resolve(s->stmt_->while_stmt->expression, f);
-        stmt_resolve(s->stmt_->while_stmt->body, f);
-        scope_exit();
-        break;
-    case STMT_FOR:
-        scope_enter();
-        decl_resolve(s->stmt_->for_stmt->declaration, f);
-        expr_resolve(s->stmt_->for_stmt->expression1, f);
-        expr_resolve(s->stmt_->for_stmt->expression2, f);
-        stmt_resolve(s->stmt_->for_stmt->body, f);
-        scope_exit();
-        break;
-    default:
-        break;
+        switch (s->kind)
+        {
+        case STMT_DECL:
+            decl_resolve(s->stmt_->declaration, f);
+            break;
+        case STMT_EXPR:
+            expr_resolve_required(s->stmt_->expression, f);
+            break;
+        case STMT_RETURN:
+            expr_resolve_required(s->stmt_->expression, f);
+            break;
+        case STMT_IF:
+            scope_enter();
+            expr_resolve_required(s->stmt_->if_stmt->expression, f);
+            stmt_resolve(s->stmt_->if_stmt->statement, f);
+            stmt_resolve(s->stmt_->if_stmt->else_stmt, f);
+            scope_exit();
+            break;
+        case STMT_ELSE_IF:
+            scope_enter();
+            expr_resolve_required(s->stmt_->if_stmt->expression, f);
+            stmt_resolve(s->stmt_->if_stmt->statement, f);
+            stmt_resolve(s->stmt_->if_stmt->else_stmt, f);
+            scope_exit();
+            break;
+        case STMT_ELSE:
+            scope_enter();
+            expr_resolve(s->stmt_->if_stmt->expression, f);
+            stmt_resolve(s->stmt_->if_stmt->statement, f);
+            scope_exit();
+            break;
+        case STMT_WHILE:
+            scope_enter();
+            expr_resolve_required(s->stmt_->while_stmt->expression, f);
+            stmt_resolve(s->stmt_->while_stmt->body, f);
+            scope_exit();
+            break;
+        case STMT_FOR:
+            scope_enter();
+            decl_resolve(s->stmt_->for_stmt->declaration, f);
+            expr_resolve(s->stmt_->for_stmt->expression1, f);
+            expr_resolve(s->stmt_->for_stmt->expression2, f);
+            stmt_resolve(s->stmt_->for_stmt->body, f);
+            scope_exit();
+            break;
+        default:
+            break;
+        }
     }
-
-    stmt_resolve(s->next, f);
 }
 
 // Type Check
 
 int is_num(struct type * t)
 {
-    if (!t->kind) return;
+    if (!t) return 0;
     if (t->kind == TYPE_PRIMITIVE)
     {
         if (t->type_->kind == PRIMITIVE_INTEGER_8 ||
@@ -1338,45 +2027,55 @@ int is_num(struct type * t)
     return 0;
 }
 
-void type_print(struct type * e)
+// Types are canonical, so identity is a pointer compare; on top of that any
+// integer type is assignable to any other.
+int type_equal(struct type * L, struct type * R)
 {
-    if (!e)
-    {
-        printf("NOT DEFINED");
+    if (!L || !R) return 0;
+    if (L == R) return 1;
+    if (is_num(L) && is_num(R)) return 1;
+    return 0;
+}
+
+void type_print(struct type * e)
+{
+    if (!e)
+    {
+        fprintf(ctx->diagnostics, "NOT DEFINED");
         return;
     }
     switch (e->kind)
     {
     case TYPE_NAME:
-        printf( e->type_->name);
+        fprintf(ctx->diagnostics, e->type_->name);
         break;
     case TYPE_PRIMITIVE:
         switch (e->type_->kind)
         {
         case PRIMITIVE_VOID:
-            printf( "void");
+            fprintf(ctx->diagnostics, "void");
             break;
         case PRIMITIVE_BOOL:
-            printf("bool");
+            fprintf(ctx->diagnostics, "bool");
             break;
         case PRIMITIVE_CHAR:
-            printf("char");
+            fprintf(ctx->diagnostics, "char");
             break;
         case PRIMITIVE_INTEGER_8:
-            printf("int8");
+            fprintf(ctx->diagnostics, "int8");
             break;
         case PRIMITIVE_INTEGER_16:
-            printf("int16");
+            fprintf(ctx->diagnostics, "int16");
             break;
         case PRIMITIVE_INTEGER_32:
-            printf("int32");
+            fprintf(ctx->diagnostics, "int32");
             break;
         case PRIMITIVE_INTEGER_64:
-            printf("int64");
+            fprintf(ctx->diagnostics, "int64");
             break;
         
         default:
-            printf("%i", e->type_->kind);
+            fprintf(ctx->diagnostics, "%i", e->type_->kind);
             break;
         }
         
@@ -1391,25 +2090,49 @@ void expr_print(struct expr * e)
     switch (e->kind)
     {
     case EXPR_IDENTIFIER:
-        printf(e->expr_->identifier->name);
+        fprintf(ctx->diagnostics, e->expr_->identifier->name);
         break;
     case EXPR_INTEGER:
-        printf("%i", e->expr_->integer_value);
+        fprintf(ctx->diagnostics, "%li", e->expr_->integer_value);
         break;
     case EXPR_BOOL:
-        printf("%s", e->expr_->integer_value ? "true" : "false");
+        fprintf(ctx->diagnostics, "%s", e->expr_->integer_value ? "true" : "false");
         break;
     
     default:
-        printf("%i", e->kind);
+        fprintf(ctx->diagnostics, "%i", e->kind);
         break;
     }
 }
 
+struct type * expr_derive_type(struct expr * e);
+
+// Each node's type is derived once and kept on the node, so any later query
+// (a parent's check, diagnostics, codegen) costs nothing.
 struct type * expr_typecheck(struct expr * e)
 {
-    if (!e || error) return;
+    if (!e || ctx->error) return 0;
+
+    if (!e->checked_type)
+    {
+        e->checked_type = expr_derive_type(e);
+    }
+    return e->checked_type;
+}
+
+void ident_typecheck(struct ident * i)
+{
+    if (!i->index) return;
 
+    if (!is_num(expr_typecheck(i->index)))
+    {
+        fprintf(ctx->diagnostics, "error: the index of %s must be a number.\n", i->name);
+        throw_error();
+    }
+}
+
+struct type * expr_derive_type(struct expr * e)
+{
     switch (e->kind)
     {
     case EXPR_ADD:
@@ -1417,15 +2140,15 @@ struct type * expr_typecheck(struct expr * e)
         struct type * a_rt = expr_typecheck(e->expr_->operation->right);
         if (!is_num(a_lt) || !is_num(a_rt))
         {
-            printf("error: cannot add ");
+            fprintf(ctx->diagnostics, "error: cannot add ");
             expr_print(e->expr_->operation->left);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(a_lt);
-            printf(") to ");
+            fprintf(ctx->diagnostics, ") to ");
             expr_print(e->expr_->operation->right);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(a_rt);
-            printf(")\n");
+            fprintf(ctx->diagnostics, ")\n");
             throw_error();
         }
         return type_create_primitive(PRIMITIVE_INTEGER, 0);
@@ -1434,15 +2157,15 @@ struct type * expr_typecheck(struct expr * e)
         struct type * s_rt = expr_typecheck(e->expr_->operation->right);
         if (!is_num(s_lt) || !is_num(s_rt))
         {
-            printf("error: cannot subtract ");
+            fprintf(ctx->diagnostics, "error: cannot subtract ");
             expr_print(e->expr_->operation->right);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(s_rt);
-            printf(") from ");
+            fprintf(ctx->diagnostics, ") from ");
             expr_print(e->expr_->operation->left);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(s_lt);
-            printf(")\n");
+            fprintf(ctx->diagnostics, ")\n");
             throw_error();
         }
         return type_create_primitive(PRIMITIVE_INTEGER, 0);
@@ -1451,15 +2174,15 @@ struct type * expr_typecheck(struct expr * e)
         struct type * m_rt = expr_typecheck(e->expr_->operation->right);
         if (!is_num(m_lt) || !is_num(m_rt))
         {
-            printf("error: cannot multiply ");
+            fprintf(ctx->diagnostics, "error: cannot multiply ");
             expr_print(e->expr_->operation->left);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(m_lt);
-            printf(") by ");
+            fprintf(ctx->diagnostics, ") by ");
             expr_print(e->expr_->operation->right);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(m_rt);
-            printf(")\n");
+            fprintf(ctx->diagnostics, ")\n");
             throw_error();
         }
         return type_create_primitive(PRIMITIVE_INTEGER, 0);
@@ -1468,15 +2191,15 @@ struct type * expr_typecheck(struct expr * e)
         struct type * d_rt = expr_typecheck(e->expr_->operation->right);
         if (!is_num(d_lt) || !is_num(d_rt))
         {
-            printf("error: cannot divide ");
+            fprintf(ctx->diagnostics, "error: cannot divide ");
             expr_print(e->expr_->operation->left);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(d_lt);
-            printf(") by ");
+            fprintf(ctx->diagnostics, ") by ");
             expr_print(e->expr_->operation->right);
-            printf(" (");
+            fprintf(ctx->diagnostics, " (");
             type_print(d_rt);
-            printf(")\n");
+            fprintf(ctx->diagnostics, ")\n");
             throw_error();
         }
         return type_create_primitive(PRIMITIVE_INTEGER, 0);
@@ -1511,18 +2234,20 @@ struct type * expr_typecheck(struct expr * e)
         // DO SOMETHING HERE
         return type_create_primitive(PRIMITIVE_BOOL, 0);
     case EXPR_ASSIGN:
-        if (e->expr_->assign->identifier->sym->type != expr_typecheck(e->expr_->assign->expression))
+        ident_typecheck(e->expr_->assign->identifier);
+        struct type * as_rt = expr_typecheck(e->expr_->assign->expression);
+        if (!type_equal(e->expr_->assign->identifier->sym->type, as_rt))
         {
-            printf("error: cannot assign ");
+            fprintf(ctx->diagnostics, "error: cannot assign ");
             expr_print(e->expr_->assign->expression);
-            printf(" (");
-            type_print(expr_typecheck(e->expr_->assign->expression));
-            printf(") to %s (", e->expr_->assign->identifier->name);
+            fprintf(ctx->diagnostics, " (");
+            type_print(as_rt);
+            fprintf(ctx->diagnostics, ") to %s (", e->expr_->assign->identifier->name);
             type_print(e->expr_->assign->identifier->sym->type);
-            printf(").\n");
+            fprintf(ctx->diagnostics, ").\n");
             throw_error();
         }
-        return expr_typecheck(e->expr_->assign->expression);
+        return as_rt;
     case EXPR_INTEGER:
         return type_create_primitive(PRIMITIVE_INTEGER, 0);
     case EXPR_BOOL:
@@ -1530,6 +2255,7 @@ struct type * expr_typecheck(struct expr * e)
     case EXPR_FUNCTION_CALL:
         return e->expr_->function_call->return_type;
     case EXPR_IDENTIFIER:
+        ident_typecheck(e->expr_->identifier);
         return e->expr_->identifier->sym->type;
     default:
         return 0;
@@ -1538,547 +2264,1470 @@ struct type * expr_typecheck(struct expr * e)
 
 void param_typecheck(struct function_param * p)
 {
-    if (!p || error) return;
-
-    if (!p->value) return;
-
-    if (expr_typecheck(p->value) != p->type_)
+    for (; p && !ctx->error; p = p->next)
     {
-        printf("error: cannod assign ");
-        expr_print(p->value);
-        printf(" of type (");
-        type_print(expr_typecheck(p->value));
-        printf(") to %s of type (", p->identifier->name);
-        type_print(p->type_);
-        printf(").\n");
-        throw_error();
-    }
+        if (!p->value) continue;
 
-    param_typecheck(p->next);
+        if (!type_equal(p->type_, expr_typecheck(p->value)))
+        {
+            fprintf(ctx->diagnostics, "error: cannod assign ");
+            expr_print(p->value);
+            fprintf(ctx->diagnostics, " of type (");
+            type_print(expr_typecheck(p->value));
+            fprintf(ctx->diagnostics, ") to %s of type (", p->identifier->name);
+            type_print(p->type_);
+            fprintf(ctx->diagnostics, ").\n");
+            throw_error();
+        }
+    }
 }
 
-int type_equal(struct type * L, struct type * R)
+void decl_typecheck(struct decl * d)
 {
-    if (!L || !R) return 0;
-    if (is_num(L) && is_num(R)) return 1;
-    if (L->kind == TYPE_PRIMITIVE && R->kind == TYPE_PRIMITIVE)
-    {
-        if ((is_num(L) && is_num(R)) ||
-             (L->type_->kind == R->type_->kind)) return 1;
-    }
-    else if (L->kind == TYPE_NAME && R->kind == TYPE_NAME)
+    for (; d && !ctx->error; d = d->next)
     {
-        if (L->type_->name == R->type_->name) return 1;
+        switch (d->kind)
+        {
+        case DECL_FUNCTION:
+            if (!d->decl_->function->return_type) 
+            {
+                fprintf(ctx->diagnostics, "error: you must specify a return type. If there is no return type, specify 'void' for the return type.\n");
+                throw_error();
+            }
+            if (d->decl_->function->cached) break;
+            param_typecheck(d->decl_->function->param);
+            stmt_typecheck(d->decl_->function->body);
+            break;
+        case DECL_VARIABLE_GLOBAL: // FIX THIS
+            if (!d->decl_->variable->value) break;
+            if (!type_equal(d->decl_->variable->type_, expr_typecheck(d->decl_->variable->value)))
+            {
+                fprintf(ctx->diagnostics, "error: cannot assign ");
+                expr_print(d->decl_->variable->value);
+                fprintf(ctx->diagnostics, " (");
+                type_print(expr_typecheck(d->decl_->variable->value));
+                fprintf(ctx->diagnostics, ") to %s (", d->decl_->variable->name->name);
+                type_print(d->decl_->variable->type_);
+                fprintf(ctx->diagnostics, ").\n");
+                throw_error();
+            }
+            break;
+        case DECL_VARIABLE_LOCAL: // FIX THIS
+            if (!d->decl_->variable->value) break;
+            if (!type_equal(d->decl_->variable->type_, expr_typecheck(d->decl_->variable->value)))
+            {
+                fprintf(ctx->diagnostics, "error: cannot assign ");
+                expr_print(d->decl_->variable->value);
+                fprintf(ctx->diagnostics, " (");
+                type_print(expr_typecheck(d->decl_->variable->value));
+                fprintf(ctx->diagnostics, ") to %s (", d->decl_->variable->name->name);
+                type_print(d->decl_->variable->type_);
+                fprintf(ctx->diagnostics, ").\n");
+                throw_error();
+            }
+            break;
+
+        default:
+            break;
+        }
     }
-    return 0;
 }
 
-void decl_typecheck(struct decl * d)
+void stmt_typecheck(struct stmt * s)
 {
-    if (!d || error) return;
-
-    switch (d->kind)
+    for (; s && !ctx->error; s = s->next)
     {
-    case DECL_FUNCTION:
-        if (!d->decl_->function->return_type) 
+        switch (s->kind)
         {
-            printf("error: you must specify a return type. If there is no return type, specify 'void' for the return type.\n");
-            throw_error();
-        }
-        param_typecheck(d->decl_->function->param);
-        stmt_typecheck(d->decl_->function->body);
-        break;
-    case DECL_VARIABLE_GLOBAL: // FIX THIS
-        if (!d->decl_->variable->value) return;
-        if (!type_equal(d->decl_->variable->type_, expr_typecheck(d->decl_->variable->value)))
-        {
-            printf("error: cannot assign ");
-            expr_print(d->decl_->variable->value);
-            printf(" (");
-            type_print(expr_typecheck(d->decl_->variable->value));
-            printf(") to %s (", d->decl_->variable->name->name);
-            type_print(d->decl_->variable->type_);
-            printf(").\n");
-            throw_error();
-        }
-        break;
-    case DECL_VARIABLE_LOCAL: // FIX THIS
-        if (!d->decl_->variable->value) return;
-        if (!type_equal(d->decl_->variable->type_, expr_typecheck(d->decl_->variable->value)))
-        {
-            printf("error: cannot assign ");
-            expr_print(d->decl_->variable->value);
-            printf(" (");
-            type_print(expr_typecheck(d->decl_->variable->value));
-            printf(") to %s (", d->decl_->variable->name->name);
-            type_print(d->decl_->variable->type_);
-            printf(").\n");
-            throw_error();
+        case STMT_DECL:
+            decl_typecheck(s->stmt_->declaration);
+            break;
+        case STMT_EXPR:
+            expr_typecheck(s->stmt_->expression);
+            break;
+        case STMT_RETURN:
+            expr_typecheck(s->stmt_->expression);
+            break;
+        case STMT_IF:
+            // if (!(expr_typecheck(s->stmt_->if_stmt->expression)->kind != TYPE_PRIMITIVE && expr_typecheck(s->stmt_->if_stmt->expression)->type_->kind != PRIMITIVE_BOOL))
+            // {
+            //     printf("error: cannot perform an if statement with a non bool expression");
+            // }
+            stmt_typecheck(s->stmt_->if_stmt->statement);
+            stmt_typecheck(s->stmt_->if_stmt->else_stmt);
+            break;
+        case STMT_ELSE_IF:
+            // if (!(expr_typecheck(s->stmt_->if_stmt->expression)->kind != TYPE_PRIMITIVE && expr_typecheck(s->stmt_->if_stmt->expression)->type_->kind != PRIMITIVE_BOOL))
+            // {
+            //     printf("error: cannot perform an if statement with a non bool expression");
+            // }
+            stmt_typecheck(s->stmt_->if_stmt->statement);
+            stmt_typecheck(s->stmt_->if_stmt->else_stmt);
+            break;
+        case STMT_ELSE:
+            stmt_typecheck(s->stmt_->if_stmt->statement);
+            break;
+        case STMT_WHILE:
+            // PUT SOMETHING HERER
+            stmt_typecheck(s->stmt_->while_stmt->body);
+            break;
+        case STMT_FOR:
+            // DO SOMETHING HERE
+            decl_typecheck(s->stmt_->for_stmt->declaration);
+            expr_typecheck(s->stmt_->for_stmt->expression1);
+            expr_typecheck(s->stmt_->for_stmt->expression2);
+            stmt_typecheck(s->stmt_->for_stmt->body);
+            break;
+
+        default:
+            break;
         }
-        break;
-    
-    default:
-        break;
     }
 }
 
-void stmt_typecheck(struct stmt * s)
+// Folding
+//
+// Between typecheck and codegen every subexpression whose operands are known
+// is replaced, in place, by its value, so codegen only ever sees one integer
+// or bool for it. Arithmetic wraps the way the 64-bit registers it stands
+// for do, and compares signed. A scalar local that is given a constant where
+// it is declared and never assigned is read as that constant and not stored
+// at all. x + 0, x - 0, x * 1, x / 1 and, when x has no effect, x * 0 lose
+// their operation.
+
+int symbol_registerable(struct symbol * s);
+
+int expr_constant(struct expr * e)
 {
-    if (!s || error) return;
+    return e && (e->kind == EXPR_INTEGER || e->kind == EXPR_BOOL);
+}
+
+long expr_value(struct expr * e)
+{
+    return e->expr_->integer_value;
+}
+
+int expr_is_value(struct expr * e, long value)
+{
+    return e && e->kind == EXPR_INTEGER && expr_value(e) == value;
+}
+
+// Nothing but reads: no call and no assignment anywhere in it.
+int expr_pure(struct expr * e)
+{
+    if (!e) return 1;
 
-    switch (s->kind)
+    switch (e->kind)
     {
-    case STMT_DECL:
-        decl_typecheck(s->stmt_->declaration);
-        break;
-    case STMT_EXPR:
-        expr_typecheck(s->stmt_->expression);
-    case STMT_RETURN:
-        expr_typecheck(s->stmt_->expression);
-    case STMT_IF:
-        // if (!(expr_typecheck(s->stmt_->if_stmt->expression)->kind != TYPE_PRIMITIVE && expr_typecheck(s->stmt_->if_stmt->expression)->type_->kind != PRIMITIVE_BOOL))
-        // {
-        //     printf("error: cannot perform an if statement with a non bool expression");
-        // }
-        stmt_typecheck(s->stmt_->if_stmt->statement);
-        stmt_typecheck(s->stmt_->if_stmt->else_stmt);
-        break;
-    case STMT_ELSE_IF:
-        // if (!(expr_typecheck(s->stmt_->if_stmt->expression)->kind != TYPE_PRIMITIVE && expr_typecheck(s->stmt_->if_stmt->expression)->type_->kind != PRIMITIVE_BOOL))
-        // {
-        //     printf("error: cannot perform an if statement with a non bool expression");
-        // }
-        stmt_typecheck(s->stmt_->if_stmt->statement);
-        stmt_typecheck(s->stmt_->if_stmt->else_stmt);
-        break;
-    case STMT_ELSE:
-        stmt_typecheck(s->stmt_->if_stmt->statement);
-        break;
-    case STMT_WHILE:
-        // PUT SOMETHING HERER
-        stmt_typecheck(s->stmt_->while_stmt->body);
-        break;
-    case STMT_FOR:
-        // DO SOMETHING HERE
-        decl_typecheck(s->stmt_->for_stmt->declaration);
-        expr_typecheck(s->stmt_->for_stmt->expression1);
-        expr_typecheck(s->stmt_->for_stmt->expression2);
-        stmt_typecheck(s->stmt_->for_stmt->body);
-        break;
-    
+    case EXPR_FUNCTION_CALL:
+    case EXPR_ASSIGN:
+        return 0;
+    case EXPR_IDENTIFIER:
+        return expr_pure(e->expr_->identifier->index);
+    case EXPR_INTEGER:
+    case EXPR_BOOL:
+        return 1;
     default:
-        break;
+        return expr_pure(e->expr_->operation->left) && expr_pure(e->expr_->operation->right);
     }
-
-    stmt_typecheck(s->next);
 }
 
-int registers[7];
+void expr_set_constant(struct expr * e, expr_t kind, long value)
+{
+    e->kind = kind;
+    e->expr_ = arena_alloc(ctx->arena, sizeof(*e->expr_));
+    e->expr_->integer_value = value;
+}
 
-int label_counter = 0;
+// The node becomes the operand it reduces to, keeping its own place in the
+// tree and the type it was checked as.
+void expr_replace(struct expr * e, struct expr * by)
+{
+    struct expr * next = e->next;
+    struct type * type = e->checked_type;
+    *e = *by;
+    e->next = next;
+    e->checked_type = type;
+}
 
-void code_gen(struct Decl * d)
+// What reading the symbol gives back once value is stored in it, narrowed
+// and widened again as load_codegen() does.
+long symbol_narrow(struct symbol * s, long value)
 {
-    registers[0] = 0;
-    registers[1] = 0;
-    registers[2] = 0;
-    registers[3] = 0;
-    registers[4] = 0;
-    registers[5] = 0;
-    registers[6] = 0;
+    if (s->size >= 8) return value;
 
-    //test();
-    fprintf(file, "\tsection\t.text\n");
-    fprintf(file, "\tdefault rel\n");
-    fprintf(file, "\textern printf\n");
-    fprintf(file, "\tglobal\tmain\n");
-
-    fprintf(file, "function_printNum:\n");
-    fprintf(file, "\tpush\trbp\n");
-    fprintf(file, "\tmov\trbp,\trsp\n");
-    fprintf(file, "\tmov\trdi,\tnum_fmt\n");
-    fprintf(file, "\tmov\trsi,\t[rbp + 16]\n");
-    fprintf(file, "\tmov\trax,\t0\n");
-    fprintf(file, "\tcall\tprintf\twrt\t..plt\n");
-    fprintf(file, "\tpop\trbp\n");
-    fprintf(file, "\tmov\trax,\t1\n");
-    fprintf(file, "\tret\n");
+    int is_signed = s->type->type_->kind != PRIMITIVE_BOOL && s->type->type_->kind != PRIMITIVE_CHAR;
 
-    
+    switch (s->size)
+    {
+    case 4:
+        return is_signed ? (long)(int32_t)value : (long)(uint32_t)value;
+    case 2:
+        return is_signed ? (long)(int16_t)value : (long)(uint16_t)value;
+    case 1:
+        return is_signed ? (long)(int8_t)value : (long)(uint8_t)value;
+    default:
+        return value;
+    }
+}
 
-    //print function
-    // fprintf(file, "printNum:\n");
-    // fprintf(file, "    PUSH rbx\n");
-    // fprintf(file, "    LEA print_number_format(rip), rdi\n");
-    // fprintf(file, "    XOR eax, eax\n");
-    // fprintf(file, "    CALL printf\n");
-    // fprintf(file, "    POP rbx\n");
-    // fprintf(file, "    RET\n");
+void expr_fold(struct expr * e);
 
-    decl_codegen(d);
+// A subscript that folds to a constant moves the displacement, as one
+// written as a number does.
+void ident_fold(struct ident * i)
+{
+    if (!i->index) return;
 
-    fprintf(file, "\n\tsection .data\n\n");
-    fprintf(file, "num_fmt: db\t\"%%i\", 10, 0\n");
+    expr_fold(i->index);
+    if (i->index->kind == EXPR_INTEGER)
+    {
+        i->offset += expr_value(i->index);
+        i->index = 0;
+    }
 }
 
-int scratch_alloc()
+void operation_fold(struct expr * e)
 {
-    for (int i = 0; i < 7; i++)
+    struct expr * left = e->expr_->operation->left;
+    struct expr * right = e->expr_->operation->right;
+    expr_fold(left);
+    expr_fold(right);
+
+    if (expr_constant(left) && expr_constant(right))
     {
-        if (!registers[i])
+        unsigned long l = expr_value(left);
+        unsigned long r = expr_value(right);
+        long sl = l;
+        long sr = r;
+
+        switch (e->kind)
         {
-            registers[i] = 1;
-            return i;
+        case EXPR_ADD:
+            expr_set_constant(e, EXPR_INTEGER, l + r);
+            return;
+        case EXPR_SUB:
+            expr_set_constant(e, EXPR_INTEGER, l - r);
+            return;
+        case EXPR_MUL:
+            expr_set_constant(e, EXPR_INTEGER, l * r);
+            return;
+        case EXPR_DIV:
+            // Left for the program to fault on.
+            if (sr == 0 || (sl == INT64_MIN && sr == -1)) break;
+            expr_set_constant(e, EXPR_INTEGER, sl / sr);
+            return;
+        case EXPR_EQUAL:
+            expr_set_constant(e, EXPR_BOOL, sl == sr);
+            return;
+        case EXPR_NOT_EQUAL:
+            expr_set_constant(e, EXPR_BOOL, sl != sr);
+            return;
+        case EXPR_GREATER:
+            expr_set_constant(e, EXPR_BOOL, sl > sr);
+            return;
+        case EXPR_LESS:
+            expr_set_constant(e, EXPR_BOOL, sl < sr);
+            return;
+        case EXPR_GREATER_EQUAL:
+            expr_set_constant(e, EXPR_BOOL, sl >= sr);
+            return;
+        case EXPR_LESS_EQUAL:
+            expr_set_constant(e, EXPR_BOOL, sl <= sr);
+            return;
+        default:
+            break;
         }
     }
-    printf("Error: ran out of registers");
-    return -1;
-}
 
+    switch (e->kind)
+    {
+    case EXPR_ADD:
+        if (expr_is_value(right, 0)) expr_replace(e, left);
+        else if (expr_is_value(left, 0)) expr_replace(e, right);
+        break;
+    case EXPR_SUB:
+        if (expr_is_value(right, 0)) expr_replace(e, left);
+        break;
+    case EXPR_MUL:
+        if (expr_is_value(right, 1)) expr_replace(e, left);
+        else if (expr_is_value(left, 1)) expr_replace(e, right);
+        else if ((expr_is_value(right, 0) && expr_pure(left)) || (expr_is_value(left, 0) && expr_pure(right))) expr_set_constant(e, EXPR_INTEGER, 0);
+        break;
+    case EXPR_DIV:
+        if (expr_is_value(right, 1)) expr_replace(e, left);
+        break;
+    default:
+        break;
+    }
+}
 
-const char * scratch_name(int r, int size)
+void expr_fold(struct expr * e)
 {
+    if (!e) return;
 
-    switch (size)
+    switch (e->kind)
     {
-    case 1:
-        switch (r)
-        {
-        case 0:
-            return "bl";
-        case 1:
-            return "r10b";
-        case 2:
-            return "r11b";
-        case 3:
-            return "r12b";
-        case 4:
-            return "r13b";
-        case 5:
-            return "r14b";
-        case 6:
-            return "r15b";
-        
-        default:
-            break;
-        }
+    case EXPR_ADD:
+    case EXPR_SUB:
+    case EXPR_MUL:
+    case EXPR_DIV:
+    case EXPR_EQUAL:
+    case EXPR_NOT_EQUAL:
+    case EXPR_GREATER:
+    case EXPR_LESS:
+    case EXPR_GREATER_EQUAL:
+    case EXPR_LESS_EQUAL:
+        operation_fold(e);
         break;
-    case 2:
-        switch (r)
-        {
-        case 0:
-            return "bx";
-        case 1:
-            return "r10w";
-        case 2:
-            return "r11w";
-        case 3:
-            return "r12w";
-        case 4:
-            return "r13w";
-        case 5:
-            return "r14w";
-        case 6:
-            return "r15w";
-        
-        default:
+    case EXPR_IDENTIFIER:
+        struct symbol * s = e->expr_->identifier->sym;
+        if (s && s->constant)
+        {
+            int is_bool = s->type->type_->kind == PRIMITIVE_BOOL;
+            expr_set_constant(e, is_bool ? EXPR_BOOL : EXPR_INTEGER, s->value);
             break;
         }
+        ident_fold(e->expr_->identifier);
         break;
-    case 4:
-        switch (r)
-        {
-        case 0:
-            return "ebx";
-        case 1:
-            return "r10d";
-        case 2:
-            return "r11d";
-        case 3:
-            return "r12d";
-        case 4:
-            return "r13d";
-        case 5:
-            return "r14d";
-        case 6:
-            return "r15d";
-        
-        default:
-            break;
-        }
+    case EXPR_ASSIGN:
+        ident_fold(e->expr_->assign->identifier);
+        expr_fold(e->expr_->assign->expression);
         break;
-    case 8:
-        switch (r)
-        {
-        case 0:
-            return "rbx";
-        case 1:
-            return "r10";
-        case 2:
-            return "r11";
-        case 3:
-            return "r12";
-        case 4:
-            return "r13";
-        case 5:
-            return "r14";
-        case 6:
-            return "r15";
-        
-        default:
-            break;
+    case EXPR_FUNCTION_CALL:
+        for (struct expr_function_arg * a = e->expr_->function_call->arguments; a; a = a->next)
+        {
+            expr_fold(a->value);
         }
         break;
-    
     default:
         break;
     }
-
-    
-
-    return 0;
 }
 
-const char * get_argument_reg(int i)
+void stmt_fold(struct stmt * s);
+
+void decl_fold(struct decl * d)
 {
-    switch (i)
+    for (; d; d = d->next)
     {
-    case 0:
-        return "rdx";
-    case 1:
-        return "rsi";
-    case 2:
-        return "rdx";
-    case 3:
-        return "rcx";
-    case 4:
-        return "r8";
-    case 5:
-        return "r9";
-    case 6:
-        return "rax";
-    
-    default:
-        break;
+        switch (d->kind)
+        {
+        case DECL_FUNCTION:
+            if (d->decl_->function->cached) break;
+            stmt_fold(d->decl_->function->body);
+            break;
+        case DECL_VARIABLE_GLOBAL:
+            expr_fold(d->decl_->variable->value);
+            break;
+        case DECL_VARIABLE_LOCAL:
+            expr_fold(d->decl_->variable->value);
+            struct symbol * s = d->decl_->variable->sym;
+            if (s && !s->assignments && symbol_registerable(s) && expr_constant(d->decl_->variable->value))
+            {
+                s->constant = 1;
+                s->value = symbol_narrow(s, expr_value(d->decl_->variable->value));
+            }
+            break;
+        default:
+            break;
+        }
     }
 }
 
-void scratch_free(int r)
+void stmt_fold(struct stmt * s)
 {
-    registers[r] = 0;
+    for (; s; s = s->next)
+    {
+        switch (s->kind)
+        {
+        case STMT_DECL:
+            decl_fold(s->stmt_->declaration);
+            break;
+        case STMT_EXPR:
+        case STMT_RETURN:
+            expr_fold(s->stmt_->expression);
+            break;
+        case STMT_IF:
+        case STMT_ELSE_IF:
+            expr_fold(s->stmt_->if_stmt->expression);
+            stmt_fold(s->stmt_->if_stmt->statement);
+            stmt_fold(s->stmt_->if_stmt->else_stmt);
+            break;
+        case STMT_ELSE:
+            stmt_fold(s->stmt_->if_stmt->statement);
+            break;
+        case STMT_WHILE:
+            expr_fold(s->stmt_->while_stmt->expression);
+            stmt_fold(s->stmt_->while_stmt->body);
+            break;
+        case STMT_FOR:
+            decl_fold(s->stmt_->for_stmt->declaration);
+            expr_fold(s->stmt_->for_stmt->expression1);
+            expr_fold(s->stmt_->for_stmt->expression2);
+            stmt_fold(s->stmt_->for_stmt->body);
+            break;
+        default:
+            break;
+        }
+    }
 }
 
-int label_create()
-{
-    return label_counter++;
-}
+// Cache keys
+//
+// A function's key is its tree with names spelled out, plus the signature
+// of every top-level declaration in order. Its code depends on the
+// functions it calls and the globals it uses, and which those are depends
+// on what was declared before it, so all of them are part of the key; a
+// change to any signature misses every function, a change to one body
+// only that function. In a program of several files the interfaces of the
+// modules a module includes are part of its functions' keys as well.
 
-const char * label_name(int label)
-{
-    const char* text;
-    sprintf(text, 8, ".L%i", label);
+// Bumped whenever codegen changes what it makes of the same tree, so entries
+// an older compiler wrote miss.
+#define CACHE_KEY_VERSION 7
 
-    return text;
-}
+void key_expr(struct cache_buffer * b, struct expr * e);
 
-const char * symbol_codegen(struct symbol * s, int offset)
+void key_type(struct cache_buffer * b, struct type * t)
 {
-    if (!s) return;
+    if (!t || !t->type_)
+    {
+        cache_put_byte(b, 0);
+        return;
+    }
 
-    char *code = (char *)malloc(100);
+    cache_put_byte(b, 1 + t->kind);
+    if (t->kind == TYPE_PRIMITIVE)
+    {
+        cache_put_byte(b, t->type_->kind);
+    }
+    else
+    {
+        cache_put_string(b, t->type_->name);
+    }
 
-    if (code)
+    struct type_spec * spec = t->type_specifier;
+    cache_put_byte(b, spec ? spec->kind : TYPE_SPEC_NONE);
+    for (struct array_sub * a = spec ? spec->sub : 0; a; a = a->next)
     {
-        if (!s->isParam)
-        {
-            if (s->type == SYMBOL_GLOBAL)
-            {
-                snprintf(code, 100, "%s", s->identifier->name);
-            }
-            else if (s->position != 0)
-            {
-                const char * type;
-                switch (s->size)
-                {
-                case 1:
-                    type = "byte";
-                    break;
-                case 2:
-                    type = "word";
-                    break;
-                case 4:
-                    type = "dword";
-                    break;
-                case 8:
-                    type = "qword";
-                    break;
-                
-                default:
-                    break;
-                }
-                snprintf(code, 100, "%s [rbp - %i]", type, s->position - (offset * s->size));
-            }
-            else
-            {
-                const char * type;
-                switch (s->size)
-                {
-                case 1:
-                    type = "byte";
-                    break;
-                case 2:
-                    type = "word";
-                    break;
-                case 4:
-                    type = "dword";
-                    break;
-                case 8:
-                    type = "qword";
-                    break;
-                
-                default:
-                    break;
-                }
-                if (offset != 0)
-                {
-                    snprintf(code, 100, "%s [rbp + %i]", type, (offset * s->size));
-                }
-                else
-                {
-                    snprintf(code, 100, "%s [rbp]", type);
-                }
-            }
+        cache_put_byte(b, 1);
+        cache_put_int(b, a->i);
+    }
+    cache_put_byte(b, 0);
+}
+
+void key_ident(struct cache_buffer * b, struct ident * i)
+{
+    cache_put_string(b, i ? i->name : 0);
+    if (!i) return;
+    cache_put_int(b, i->offset);
+    key_expr(b, i->index);
+}
+
+void key_expr(struct cache_buffer * b, struct expr * e)
+{
+    if (!e)
+    {
+        cache_put_byte(b, 0xff);
+        return;
+    }
+
+    cache_put_byte(b, e->kind);
+    switch (e->kind)
+    {
+    case EXPR_ADD:
+    case EXPR_SUB:
+    case EXPR_MUL:
+    case EXPR_DIV:
+    case EXPR_EQUAL:
+    case EXPR_NOT_EQUAL:
+    case EXPR_GREATER:
+    case EXPR_LESS:
+    case EXPR_GREATER_EQUAL:
+    case EXPR_LESS_EQUAL:
+        key_expr(b, e->expr_->operation->left);
+        key_expr(b, e->expr_->operation->right);
+        break;
+    case EXPR_FUNCTION_CALL:
+        key_ident(b, e->expr_->function_call->identifier);
+        for (struct expr_function_arg * a = e->expr_->function_call->arguments; a; a = a->next)
+        {
+            cache_put_byte(b, 1);
+            key_expr(b, a->value);
+        }
+        cache_put_byte(b, 0);
+        break;
+    case EXPR_IDENTIFIER:
+        key_ident(b, e->expr_->identifier);
+        break;
+    case EXPR_BOOL:
+    case EXPR_INTEGER:
+        cache_put_int(b, e->expr_->integer_value);
+        break;
+    case EXPR_ASSIGN:
+        key_ident(b, e->expr_->assign->identifier);
+        key_expr(b, e->expr_->assign->expression);
+        break;
+    default:
+        break;
+    }
+}
+
+void key_variable(struct cache_buffer * b, struct decl_variable * v)
+{
+    key_ident(b, v->name);
+    key_type(b, v->type_);
+    cache_put_int(b, v->size);
+}
+
+void key_stmt(struct cache_buffer * b, struct stmt * s);
+
+void key_decl(struct cache_buffer * b, struct decl * d)
+{
+    for (; d; d = d->next)
+    {
+        cache_put_byte(b, 1 + d->kind);
+        if (d->kind != DECL_FUNCTION)
+        {
+            key_variable(b, d->decl_->variable);
+            key_expr(b, d->decl_->variable->value);
+        }
+    }
+    cache_put_byte(b, 0);
+}
+
+void key_stmt(struct cache_buffer * b, struct stmt * s)
+{
+    for (; s; s = s->next)
+    {
+        cache_put_byte(b, 1 + s->kind);
+        switch (s->kind)
+        {
+        case STMT_EXPR:
+        case STMT_RETURN:
+            key_expr(b, s->stmt_->expression);
+            break;
+        case STMT_DECL:
+            key_decl(b, s->stmt_->declaration);
+            break;
+        case STMT_IF:
+        case STMT_ELSE_IF:
+        case STMT_ELSE:
+            key_expr(b, s->stmt_->if_stmt->expression);
+            key_stmt(b, s->stmt_->if_stmt->statement);
+            key_stmt(b, s->stmt_->if_stmt->else_stmt);
+            break;
+        case STMT_WHILE:
+            key_expr(b, s->stmt_->while_stmt->expression);
+            key_stmt(b, s->stmt_->while_stmt->body);
+            break;
+        case STMT_FOR:
+            key_decl(b, s->stmt_->for_stmt->declaration);
+            key_expr(b, s->stmt_->for_stmt->expression1);
+            key_expr(b, s->stmt_->for_stmt->expression2);
+            key_stmt(b, s->stmt_->for_stmt->body);
+            break;
+        default:
+            break;
+        }
+    }
+    cache_put_byte(b, 0);
+}
+
+void key_params(struct cache_buffer * b, struct function_param * p)
+{
+    for (; p; p = p->next)
+    {
+        cache_put_byte(b, 1);
+        key_ident(b, p->identifier);
+        key_type(b, p->type_);
+        key_expr(b, p->value);
+        cache_put_int(b, p->size);
+    }
+    cache_put_byte(b, 0);
+}
+
+void key_signatures(struct cache_buffer * b, struct decl * d)
+{
+    cache_put_int(b, CACHE_KEY_VERSION);
+    for (; d; d = d->next)
+    {
+        cache_put_byte(b, 1 + d->kind);
+        if (d->kind == DECL_FUNCTION)
+        {
+            struct decl_function * f = d->decl_->function;
+            cache_put_string(b, f->identifier->name);
+            key_type(b, f->return_type);
+            key_params(b, f->param);
+            cache_put_byte(b, f->body != 0);
         }
         else
         {
-            
-            if (s->position != 0)
-            {
-                const char * type;
-                switch (s->size)
-                {
-                case 1:
-                    type = "byte";
-                    break;
-                case 2:
-                    type = "word";
-                    break;
-                case 4:
-                    type = "dword";
-                    break;
-                case 8:
-                    type = "qword";
-                    break;
-                
-                default:
-                    break;
-                }
-                snprintf(code, 100, "%s [rbp + %i]", type, s->position + 16 + (offset * s->size));
-            }
-            else
-            {
-                const char * type;
-                switch (s->size)
-                {
-                case 1:
-                    type = "byte";
-                    break;
-                case 2:
-                    type = "word";
-                    break;
-                case 4:
-                    type = "dword";
-                    break;
-                case 8:
-                    type = "qword";
-                    break;
-                
-                default:
-                    break;
-                }
-                snprintf(code, 100, "%s [rbp + %i]", type, 16 + (offset * s->size));
-            }
-            
+            key_variable(b, d->decl_->variable);
+        }
+    }
+    cache_put_byte(b, 0);
+}
+
+// What a module's code can see of the modules it includes.
+void key_includes(struct cache_buffer * b, struct module * m)
+{
+    for (struct module_include * i = m->includes; i; i = i->next)
+    {
+        cache_put_string(b, i->name);
+        for (struct module_symbol * s = i->module ? i->module->interface : 0; s; s = s->next)
+        {
+            cache_put_byte(b, 1 + s->kind);
+            cache_put_string(b, s->identifier->name);
+            key_type(b, s->type);
+            cache_put_int(b, s->size);
+        }
+        cache_put_byte(b, 0);
+    }
+    cache_put_byte(b, 0);
+}
+
+// Keys every function with a body and looks it up in the cache at dir.
+void cache_lookup(struct decl * d, const char * dir)
+{
+    struct cache_buffer signatures = { 0 };
+    key_signatures(&signatures, d);
+    if (ctx->module)
+    {
+        key_includes(&signatures, ctx->module);
+    }
+
+    struct cache_buffer key = { 0 };
+    for (; d; d = d->next)
+    {
+        if (d->kind != DECL_FUNCTION || !d->decl_->function->body) continue;
+        struct decl_function * f = d->decl_->function;
+
+        key.length = 0;
+        cache_put(&key, signatures.data, signatures.length);
+        cache_put_string(&key, f->identifier->name);
+        key_params(&key, f->param);
+        key_stmt(&key, f->body);
+
+        f->cached = cache_load(dir, key.data, key.length, &f->cached_length);
+        if (!f->cached)
+        {
+            char * k = arena_alloc(ctx->arena, key.length);
+            memcpy(k, key.data, key.length);
+            f->cache_key = k;
+            f->cache_key_length = key.length;
+        }
+    }
+
+    cache_buffer_release(&key);
+    cache_buffer_release(&signatures);
+}
+
+void decl_codegen_parallel(struct decl * d);
+
+void code_gen(struct decl * d)
+{
+    ctx->registers[0] = 0;
+    ctx->registers[1] = 0;
+    ctx->registers[2] = 0;
+    ctx->registers[3] = 0;
+    ctx->registers[4] = 0;
+    ctx->registers[5] = 0;
+    ctx->registers[6] = 0;
+
+    //test();
+    emit_section(OBJECT_TEXT);
+    emit_directive(
+        "\tdefault rel\n"
+        "\textern printf\n"
+        "\textern exit\n"
+    );
+    // main and every pub declaration are seen by the units linked with this
+    // one.
+    for (struct decl * g = d; g; g = g->next)
+    {
+        if (g->kind == DECL_FUNCTION && !strcmp(g->decl_->function->identifier->name, "main"))
+        {
+            emit_global(0, "main");
+        }
+        else if (g->exported)
+        {
+            int function = g->kind == DECL_FUNCTION;
+            emit_global(function ? "function_" : "global_", function ? g->decl_->function->identifier->name : g->decl_->variable->name->name);
+        }
+    }
+
+    emit_label("function_", "printNum", -1);
+    emit_op1(OP_PUSH, op_reg(REG_RBP, 8));
+    emit_op2(OP_MOV, op_reg(REG_RBP, 8), op_reg(REG_RSP, 8));
+    emit_op2(OP_MOV, op_reg(REG_RDI, 8), op_symbol("num_fmt", 0));
+    emit_op2(OP_MOV, op_reg(REG_RSI, 8), op_mem(REG_RBP, 16, 0));
+    emit_op2(OP_MOV, op_reg(REG_RAX, 8), op_imm(0));
+    emit_op1(OP_CALL, op_symbol("printf", 0));
+    emit_op1(OP_POP, op_reg(REG_RBP, 8));
+    emit_op2(OP_MOV, op_reg(REG_RAX, 8), op_imm(1));
+    emit_op0(OP_RET);
+
+    //print function
+    // fprintf(file, "printNum:\n");
+    // fprintf(file, "    PUSH rbx\n");
+    // fprintf(file, "    LEA print_number_format(rip), rdi\n");
+    // fprintf(file, "    XOR eax, eax\n");
+    // fprintf(file, "    CALL printf\n");
+    // fprintf(file, "    POP rbx\n");
+    // fprintf(file, "    RET\n");
+
+    decl_codegen_parallel(d);
+
+    static const char num_fmt[] = "%i\n";
+    emit_section(OBJECT_DATA);
+    emit_data("num_fmt", 0, num_fmt, sizeof(num_fmt));
+
+    for (struct decl * g = d; g; g = g->next)
+    {
+        if (g->kind != DECL_VARIABLE_GLOBAL || !g->decl_->variable->sym) continue;
+
+        struct type_spec * spec = g->decl_->variable->type_->type_specifier;
+        int count = spec && spec->kind == TYPE_SPEC_ARRAY ? get_array_size(spec->sub) : 1;
+
+        emit_zeros("global_", g->decl_->variable->name->name, g->decl_->variable->sym->size * count);
+    }
+}
+
+// Inside a function every scratch value gets a virtual register of its own
+// and the allocator finds it a home. Global initializers are generated
+// outside any function and still draw on the seven fixed registers.
+int scratch_alloc()
+{
+    if (ctx->emitter->allocating)
+    {
+        return allocator_vreg(0);
+    }
+
+    for (int i = 0; i < 7; i++)
+    {
+        if (!ctx->registers[i])
+        {
+            ctx->registers[i] = 1;
+            return i;
+        }
+    }
+    fprintf(ctx->diagnostics, "Error: ran out of registers");
+    return -1;
+}
+
+
+static const reg_t scratch_registers[7] =
+{
+    REG_RBX, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15
+};
+
+struct operand scratch_operand(int r, int size)
+{
+    if (r >= VREG_FIRST)
+    {
+        return op_reg(r, size);
+    }
+    if (r < 0 || r >= 7)
+    {
+        return op_reg(REG_NONE, size);
+    }
+    return op_reg(scratch_registers[r], size);
+}
+
+const char * get_argument_reg(int i)
+{
+    switch (i)
+    {
+    case 0:
+        return "rdx";
+    case 1:
+        return "rsi";
+    case 2:
+        return "rdx";
+    case 3:
+        return "rcx";
+    case 4:
+        return "r8";
+    case 5:
+        return "r9";
+    case 6:
+        return "rax";
+    
+    default:
+        break;
+    }
+}
+
+void scratch_free(int r)
+{
+    if (r >= 0 && r < 7)
+    {
+        ctx->registers[r] = 0;
+    }
+}
+
+int label_create()
+{
+    return ctx->label_counter++;
+}
+
+const char * label_name(int label)
+{
+    const char* text;
+    sprintf(text, 8, ".L%i", label);
+
+    return text;
+}
+
+// Where a symbol lives, worked out once per symbol. Array elements only
+// move the displacement, so no operand is ever built per reference.
+void symbol_layout(struct symbol * s)
+{
+    if (!s) return;
+
+    if (s->kind == SYMBOL_GLOBAL && !s->isParam)
+    {
+        s->operand = op_global("global_", s->identifier->name, 0, s->size);
+    }
+    else if (s->isParam)
+    {
+        s->operand = op_mem(REG_RBP, s->position + 16, s->size);
+    }
+    else
+    {
+        s->operand = op_mem(REG_RBP, -s->position, s->size);
+    }
+}
+
+// Scalar locals and parameters are kept in registers; arrays, globals and
+// anything not one of the integer sizes stay in memory.
+int symbol_registerable(struct symbol * s)
+{
+    if (!s || s->kind != SYMBOL_LOCAL || !s->type || s->type->kind != TYPE_PRIMITIVE || s->type->type_specifier) return 0;
+    return s->size == 1 || s->size == 2 || s->size == 4 || s->size == 8;
+}
+
+struct operand symbol_codegen(struct symbol * s, int offset)
+{
+    struct operand o = s->operand;
+    o.value += offset * s->size;
+
+    return o;
+}
+
+// A subscript only known at run time is computed into a scratch register and
+// used as the operand's index; ident_release() gives that register back. A
+// variable kept in a register is its own index.
+struct operand ident_codegen(struct ident * i)
+{
+    struct operand o = symbol_codegen(i->sym, i->offset);
+    if (!i->index) return o;
+
+    if (i->index->kind == EXPR_IDENTIFIER && i->index->expr_->identifier->sym->vreg)
+    {
+        i->index->reg = -1;
+        return op_indexed(o, i->index->expr_->identifier->sym->vreg, i->sym->size);
+    }
+    expr_codegen(i->index);
+    return op_indexed(o, scratch_operand(i->index->reg, 8).reg, i->sym->size);
+}
+
+void ident_release(struct ident * i)
+{
+    if (i->index)
+    {
+        scratch_free(i->index->reg);
+    }
+}
+
+// Narrow values are widened to the full register on load, so the 64-bit
+// arithmetic and compares that follow see a negative int4 as negative.
+void load_codegen(int reg, struct operand source, struct type * t)
+{
+    int is_signed = t && t->kind == TYPE_PRIMITIVE && t->type_->kind != PRIMITIVE_BOOL && t->type_->kind != PRIMITIVE_CHAR;
+
+    switch (source.size)
+    {
+    case 4:
+        if (is_signed)
+        {
+            emit_op2(OP_MOVSXD, scratch_operand(reg, 8), source);
+        }
+        else
+        {
+            emit_op2(OP_MOV, scratch_operand(reg, 4), source);
+        }
+        break;
+    case 2:
+    case 1:
+        emit_op2(is_signed ? OP_MOVSX : OP_MOVZX, scratch_operand(reg, 8), source);
+        break;
+    default:
+        emit_op2(OP_MOV, scratch_operand(reg, source.size), source);
+        break;
+    }
+}
+
+// Gives a register-resident symbol a value, narrowed to its size and widened
+// back the way a store and a load through memory would have.
+void variable_store(struct symbol * s, struct operand value)
+{
+    if (value.kind == OPERAND_IMM)
+    {
+        emit_op2(OP_MOV, scratch_operand(s->vreg, 8), op_imm(symbol_narrow(s, value.value)));
+        return;
+    }
+    value.size = s->size;
+    load_codegen(s->vreg, value, s->type);
+}
+
+// A value that an instruction can take as it is, with no register loaded
+// for it: a constant that fits an immediate, a variable kept in a register,
+// or, inside a function, a whole-register variable in memory. Returns 0 for
+// anything that has to be computed first.
+int expr_operand(struct expr * e, struct operand * o)
+{
+    if (expr_constant(e))
+    {
+        if (!fits_int32(expr_value(e))) return 0;
+        *o = op_imm(expr_value(e));
+        return 1;
+    }
+    if (e->kind != EXPR_IDENTIFIER) return 0;
+
+    struct ident * i = e->expr_->identifier;
+    if (i->sym->vreg)
+    {
+        *o = scratch_operand(i->sym->vreg, 8);
+        return 1;
+    }
+    // Memory to memory only works out where the allocator can go through
+    // r11 for it.
+    if (i->index || i->sym->size != 8 || !ctx->emitter->allocating) return 0;
+
+    *o = symbol_codegen(i->sym, i->offset);
+    return 1;
+}
+
+// The same operand, read or written at another width.
+struct operand operand_sized(struct operand o, int size)
+{
+    if (o.kind != OPERAND_IMM)
+    {
+        o.size = size;
+    }
+    return o;
+}
+
+void push_padding(int size)
+{
+    int s = size;
+    if (s >= 8)
+    {
+        emit_op1(OP_PUSH, op_sized_imm(0, 8));
+        size-=8;
+    }
+    if (s >= 4)
+    {
+        emit_op1(OP_PUSH, op_sized_imm(0, 4));
+        size-=4;
+    }
+    if (s >= 2)
+    {
+        emit_op1(OP_PUSH, op_sized_imm(0, 2));
+        size-=2;
+    }
+    if (s >= 1)
+    {
+        emit_op1(OP_PUSH, op_sized_imm(0, 1));
+        size-=1;
+    }
+}
+
+int get_num_args(struct expr_function_arg * arg)
+{
+    int count = 0;
+    for (; arg; arg = arg->next)
+    {
+        count++;
+    }
+    return count;
+}
+
+void expr_function_call_arg_codegen(struct expr_function_arg * a)
+{
+    for (; a; a = a->next)
+    {
+        struct operand o;
+        if (expr_operand(a->value, &o))
+        {
+            emit_op1(OP_PUSH, o);
+            continue;
+        }
+        expr_codegen(a->value);
+        emit_op1(OP_PUSH, scratch_operand(a->value->reg, 8));
+        scratch_free(a->value->reg);
+    }
+}
+
+
+
+void expr_function_call_codegen(struct expr *e)
+{
+    if (!e) return;
+
+    const char * name = e->expr_->function_call->identifier->name;
+
+    if (!strcmp(name, "print"))
+    {      
+        struct operand o;
+        if (expr_operand(e->expr_->function_call->arguments->value, &o))
+        {
+            emit_op2(OP_MOV, op_reg(REG_RDI, 8), op_symbol("num_fmt", 0));
+            emit_op2(OP_MOV, op_reg(REG_RSI, 8), o);
+            emit_op2(OP_MOV, op_reg(REG_RAX, 8), op_imm(0));
+            emit_op1(OP_CALL, op_symbol("printf", 0));
+            return;
+        }
+        expr_codegen(e->expr_->function_call->arguments->value);
+        emit_op2(OP_MOV, op_reg(REG_RDI, 8), op_symbol("num_fmt", 0)); // 4 is print
+        emit_op2(OP_MOV, op_reg(REG_RSI, 8), scratch_operand(e->expr_->function_call->arguments->value->reg, 8));
+        emit_op2(OP_MOV, op_reg(REG_RAX, 8), op_imm(0));
+        emit_op1(OP_CALL, op_symbol("printf", 0));
+        scratch_free(e->expr_->function_call->arguments->value->reg);
+    }
+    else
+    {
+        if (get_num_args(e->expr_->function_call->arguments)%2 == 1)
+        emit_op1(OP_PUSH, op_sized_imm(0, 8));
+        expr_function_call_arg_codegen(e->expr_->function_call->arguments);
+
+        emit_op1(OP_CALL, op_symbol("function_", e->expr_->function_call->identifier->name));
+        emit_op2(OP_ADD, op_reg(REG_RSP, 8), op_imm((get_num_args(e->expr_->function_call->arguments) * 8)%16 > 0 ? get_num_args(e->expr_->function_call->arguments) * 8 + 8 : get_num_args(e->expr_->function_call->arguments) * 8));
+    }
+}
+
+// Comparisons set the flags once and are then either branched on or turned
+// into 0 or 1. Each has the jump taken when it does not hold and the setcc
+// for its value.
+opcode_t comparison_jump_false(expr_t kind)
+{
+    switch (kind)
+    {
+    case EXPR_EQUAL:
+        return OP_JNE;
+    case EXPR_NOT_EQUAL:
+        return OP_JE;
+    case EXPR_GREATER:
+        return OP_JNG;
+    case EXPR_LESS:
+        return OP_JNL;
+    case EXPR_GREATER_EQUAL:
+        return OP_JL;
+    default:
+        return OP_JG;
+    }
+}
+
+opcode_t comparison_set(expr_t kind)
+{
+    switch (kind)
+    {
+    case EXPR_EQUAL:
+        return OP_SETE;
+    case EXPR_NOT_EQUAL:
+        return OP_SETNE;
+    case EXPR_GREATER:
+        return OP_SETG;
+    case EXPR_LESS:
+        return OP_SETL;
+    case EXPR_GREATER_EQUAL:
+        return OP_SETNL;
+    default:
+        return OP_SETNG;
+    }
+}
+
+// The comparison that holds with its operands swapped.
+expr_t comparison_mirror(expr_t kind)
+{
+    switch (kind)
+    {
+    case EXPR_GREATER:
+        return EXPR_LESS;
+    case EXPR_LESS:
+        return EXPR_GREATER;
+    case EXPR_GREATER_EQUAL:
+        return EXPR_LESS_EQUAL;
+    case EXPR_LESS_EQUAL:
+        return EXPR_GREATER_EQUAL;
+    default:
+        return kind;
+    }
+}
+
+int is_comparison(struct expr * e)
+{
+    return e && (e->kind == EXPR_EQUAL || e->kind == EXPR_NOT_EQUAL || e->kind == EXPR_GREATER
+        || e->kind == EXPR_LESS || e->kind == EXPR_GREATER_EQUAL || e->kind == EXPR_LESS_EQUAL);
+}
+
+// Compares the operands, the right one used in place when it can be. The
+// left one is computed into e->reg, unless it is a variable kept in a
+// register and not changed by the right one: that is compared where it is
+// and leaves e->reg at -1. A constant on the left is moved to the right,
+// which turns the comparison around; what it reads as then is returned.
+expr_t comparison_codegen(struct expr * e)
+{
+    struct expr * left = e->expr_->operation->left;
+    struct expr * right = e->expr_->operation->right;
+    expr_t kind = e->kind;
+    if (expr_constant(left) && !expr_constant(right))
+    {
+        left = e->expr_->operation->right;
+        right = e->expr_->operation->left;
+        kind = comparison_mirror(kind);
+    }
+
+    struct operand l;
+    if (left->kind == EXPR_IDENTIFIER && left->expr_->identifier->sym->vreg && expr_pure(right))
+    {
+        l = scratch_operand(left->expr_->identifier->sym->vreg, 8);
+        e->reg = -1;
+    }
+    else
+    {
+        expr_codegen(left);
+        e->reg = left->reg;
+        l = scratch_operand(e->reg, 8);
+    }
+
+    struct operand o;
+    if (expr_operand(right, &o))
+    {
+        emit_op2(OP_CMP, l, o);
+        return kind;
+    }
+    expr_codegen(right);
+    emit_op2(OP_CMP, l, scratch_operand(right->reg, 8));
+    scratch_free(right->reg);
+    return kind;
+}
+
+// The left operand is computed into the register the result ends up in and
+// the right one used in place when it can be. An operator that commutes
+// takes its operands the other way round when only the left one can be;
+// the left is then read after the right is computed, so only if that
+// cannot change it.
+void operation_codegen(struct expr * e, opcode_t op, int commutes)
+{
+    struct expr * left = e->expr_->operation->left;
+    struct expr * right = e->expr_->operation->right;
+    struct operand o;
+    if (commutes && !expr_operand(right, &o) && expr_operand(left, &o) && (expr_constant(left) || expr_pure(right)))
+    {
+        left = e->expr_->operation->right;
+        right = e->expr_->operation->left;
+    }
+
+    expr_codegen(left);
+    e->reg = left->reg;
+
+    if (expr_operand(right, &o))
+    {
+        emit_op2(op, scratch_operand(e->reg, 8), o);
+        return;
+    }
+    expr_codegen(right);
+    emit_op2(op, scratch_operand(e->reg, 8), scratch_operand(right->reg, 8));
+    scratch_free(right->reg);
+}
+
+// Multiplication and division
+//
+// A multiply by a constant is a shift for a power of two and an lea for
+// 3, 5 or 9 times one, either negated for a negative constant, and imul
+// with an immediate for anything else. Division by a constant never
+// divides: a power of two is an arithmetic shift, corrected so that it
+// rounds toward zero as idiv does, and any other divisor a multiply by its
+// magic number, keeping the high half. Only a divisor known at run time
+// goes through cqo and idiv, with the dividend in rax.
+
+void mul_constant_codegen(struct operand r, long c)
+{
+    if (c == 0)
+    {
+        emit_op2(OP_MOV, r, op_imm(0));
+        return;
+    }
+
+    unsigned long m = c < 0 ? -(unsigned long)c : (unsigned long)c;
+    int shift = __builtin_ctzl(m);
+    unsigned long odd = m >> shift;
+
+    if (odd == 3 || odd == 5 || odd == 9)
+    {
+        if (c < 0 && fits_int32(c))
+        {
+            emit_op2(OP_IMUL, r, op_imm(c));
+            return;
+        }
+        emit_op2(OP_LEA, r, op_indexed(op_mem(r.reg, 0, 0), r.reg, odd - 1));
+    }
+    else if (odd != 1)
+    {
+        if (fits_int32(c))
+        {
+            emit_op2(OP_IMUL, r, op_imm(c));
+            return;
+        }
+        int t = scratch_alloc();
+        emit_op2(OP_MOV, scratch_operand(t, 8), op_imm(c));
+        emit_op2(OP_IMUL, r, scratch_operand(t, 8));
+        scratch_free(t);
+        return;
+    }
+
+    if (shift)
+    {
+        emit_op2(OP_SHL, r, op_imm(shift));
+    }
+    if (c < 0)
+    {
+        emit_op1(OP_NEG, r);
+    }
+}
+
+void mul_codegen(struct expr * e)
+{
+    struct expr * left = e->expr_->operation->left;
+    struct expr * right = e->expr_->operation->right;
+    if (expr_constant(left) && !expr_constant(right))
+    {
+        left = e->expr_->operation->right;
+        right = e->expr_->operation->left;
+    }
+    if (!expr_constant(right))
+    {
+        operation_codegen(e, OP_IMUL, 1);
+        return;
+    }
+
+    expr_codegen(left);
+    e->reg = left->reg;
+    mul_constant_codegen(scratch_operand(e->reg, 8), expr_value(right));
+}
+
+// The multiplier and shift that divide by d, for 2 < d < 2^63 and not a
+// power of two: the quotient is the high half of the dividend times the
+// multiplier, shifted right (Hacker's Delight, 10-1).
+void division_magic(unsigned long d, long * multiplier, int * shift)
+{
+    const unsigned long two63 = 1ul << 63;
+    unsigned long anc = two63 - 1 - two63 % d;
+    unsigned long q1 = two63 / anc;
+    unsigned long r1 = two63 - q1 * anc;
+    unsigned long q2 = two63 / d;
+    unsigned long r2 = two63 - q2 * d;
+    unsigned long delta;
+    int p = 63;
+
+    do
+    {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= d)
+        {
+            q2++;
+            r2 -= d;
+        }
+        delta = d - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    *multiplier = q2 + 1;
+    *shift = p - 64;
+}
+
+// Leaves x / d in a register of its own and returns it; x's is the
+// caller's to free.
+int div_constant_codegen(struct operand x, long d)
+{
+    unsigned long m = d < 0 ? -(unsigned long)d : (unsigned long)d;
+    int q = scratch_alloc();
+    struct operand r = scratch_operand(q, 8);
+
+    if (m == 1)
+    {
+        emit_op2(OP_MOV, r, x);
+    }
+    else if (!(m & (m - 1)))
+    {
+        // A negative dividend is biased by d - 1 first.
+        int k = __builtin_ctzl(m);
+        emit_op2(OP_MOV, r, x);
+        emit_op2(OP_SAR, r, op_imm(63));
+        emit_op2(OP_SHR, r, op_imm(64 - k));
+        emit_op2(OP_ADD, r, x);
+        emit_op2(OP_SAR, r, op_imm(k));
+    }
+    else
+    {
+        long multiplier;
+        int shift;
+        division_magic(m, &multiplier, &shift);
+
+        // rdx is only read the once, straight after the imul.
+        emit_op2(OP_MOV, op_reg(REG_RAX, 8), op_imm(multiplier));
+        emit_op1(OP_IMUL, x);
+        emit_op2(OP_MOV, r, op_reg(REG_RDX, 8));
+        if (multiplier < 0)
+        {
+            emit_op2(OP_ADD, r, x);
+        }
+        if (shift)
+        {
+            emit_op2(OP_SAR, r, op_imm(shift));
         }
-        
 
-        return code;
+        // One more for a negative dividend, so the quotient rounds toward
+        // zero.
+        int t = scratch_alloc();
+        emit_op2(OP_MOV, scratch_operand(t, 8), x);
+        emit_op2(OP_SHR, scratch_operand(t, 8), op_imm(63));
+        emit_op2(OP_ADD, r, scratch_operand(t, 8));
+        scratch_free(t);
     }
-    else
+
+    if (d < 0)
     {
-        printf("Memory allocation failed for symbol code.\n");
-        return 0;
+        emit_op1(OP_NEG, r);
     }
+    return q;
 }
 
-void push_padding(int size)
+void div_codegen(struct expr * e)
 {
-    int s = size;
-    if (s >= 8)
-    {
-        fprintf(file, "\tpush\tqword\t0\n");
-        size-=8;
-    }
-    if (s >= 4)
+    struct expr * left = e->expr_->operation->left;
+    struct expr * right = e->expr_->operation->right;
+
+    if (expr_constant(right) && expr_value(right) != 0)
     {
-        fprintf(file, "\tpush\tdword\t0\n");
-        size-=4;
+        expr_codegen(left);
+        e->reg = div_constant_codegen(scratch_operand(left->reg, 8), expr_value(right));
+        scratch_free(left->reg);
+        return;
     }
-    if (s >= 2)
+
+    expr_codegen(left);
+    e->reg = left->reg;
+
+    struct operand o;
+    int computed = !expr_operand(right, &o) || o.kind == OPERAND_IMM;
+    if (computed)
     {
-        fprintf(file, "\tpush\tword\t0\n");
-        size-=2;
+        expr_codegen(right);
+        o = scratch_operand(right->reg, 8);
     }
-    if (s >= 1)
+    emit_op2(OP_MOV, op_reg(REG_RAX, 8), scratch_operand(e->reg, 8));
+    emit_op0(OP_CQO);
+    emit_op1(OP_IDIV, o);
+    emit_op2(OP_MOV, scratch_operand(e->reg, 8), op_reg(REG_RAX, 8));
+    if (computed)
     {
-        fprintf(file, "\tpush\tbyte\t0\n");
-        size-=1;
+        scratch_free(right->reg);
     }
 }
 
-int get_num_args(struct expr_function_arg * arg)
+int ident_same(struct ident * i, struct expr * e)
 {
-    if (!arg) return 0;
-    return 1 + get_num_args(arg->next);
+    return e->kind == EXPR_IDENTIFIER && e->expr_->identifier->sym == i->sym
+        && !e->expr_->identifier->index && e->expr_->identifier->offset == i->offset;
 }
 
-void expr_function_call_arg_codegen(struct expr_function_arg * a)
+// k: k + x and k: k - x change k where it is, register or memory, when x
+// cannot change k.
+int assign_in_place(struct expr * e)
 {
-    if (!a) return;
-
-    expr_codegen(a->value);
-    fprintf(file, "\tpush\t%s\n", scratch_name(a->value->reg, 8));
-    scratch_free(a->value->reg);
-
-    expr_function_call_arg_codegen(a->next);
-}
-
+    struct ident * target = e->expr_->assign->identifier;
+    struct expr * value = e->expr_->assign->expression;
+    if (target->index || (value->kind != EXPR_ADD && value->kind != EXPR_SUB)) return 0;
 
+    struct expr * left = value->expr_->operation->left;
+    struct expr * right = value->expr_->operation->right;
+    if (value->kind == EXPR_ADD && !ident_same(target, left))
+    {
+        left = value->expr_->operation->right;
+        right = value->expr_->operation->left;
+    }
+    if (!ident_same(target, left) || !expr_pure(right)) return 0;
 
-void expr_function_call_codegen(struct expr *e)
-{
-    if (!e) return;
+    opcode_t op = value->kind == EXPR_ADD ? OP_ADD : OP_SUB;
+    struct symbol * s = target->sym;
 
-    const char * name = e->expr_->function_call->identifier->name;
+    struct operand o;
+    int computed = !expr_operand(right, &o);
+    if (computed)
+    {
+        expr_codegen(right);
+        o = scratch_operand(right->reg, 8);
+    }
 
-    if (!strcmp(name, "print"))
-    {      
-        expr_codegen(e->expr_->function_call->arguments->value);
-        fprintf(file, "\tmov\trdi,\tnum_fmt\n"); // 4 is print
-        fprintf(file, "\tmov\trsi,\t%s\n", scratch_name(e->expr_->function_call->arguments->value->reg, 8));
-        fprintf(file, "\tmov\trax,\t0\n");
-        fprintf(file, "\tcall\tprintf\n");
-        scratch_free(e->expr_->function_call->arguments->value->reg);
+    if (s->vreg)
+    {
+        emit_op2(op, scratch_operand(s->vreg, 8), o);
+        if (s->size < 8)
+        {
+            variable_store(s, scratch_operand(s->vreg, 8));
+        }
     }
     else
     {
-        if (get_num_args(e->expr_->function_call->arguments)%2 == 1)
-        fprintf(file, "\tpush\tqword\t0\n");
-        expr_function_call_arg_codegen(e->expr_->function_call->arguments);
+        emit_op2(op, symbol_codegen(s, target->offset), operand_sized(o, s->size));
+    }
+
+    if (computed)
+    {
+        scratch_free(right->reg);
+    }
+    return 1;
+}
+
+// Jumps to the label when the condition does not hold. A comparison is one
+// cmp and one jump, a folded condition a jump or nothing; anything else
+// holds when it is 1.
+void condition_codegen(struct expr * e, const char * prefix, int label)
+{
+    if (expr_constant(e))
+    {
+        if (expr_value(e) != 1)
+        {
+            emit_op1(OP_JMP, op_label(prefix, label));
+        }
+        return;
+    }
 
-        fprintf(file, "\tcall\t%s%s\n", "function_", e->expr_->function_call->identifier->name);
-        fprintf(file, "\tadd\trsp,\t%i\n", (get_num_args(e->expr_->function_call->arguments) * 8)%16 > 0 ? get_num_args(e->expr_->function_call->arguments) * 8 + 8 : get_num_args(e->expr_->function_call->arguments) * 8);
+    if (is_comparison(e))
+    {
+        expr_t kind = comparison_codegen(e);
+        scratch_free(e->reg);
+        emit_op1(comparison_jump_false(kind), op_label(prefix, label));
+        return;
     }
+
+    expr_codegen(e);
+    emit_op2(OP_CMP, scratch_operand(e->reg, 8), op_imm(1));
+    scratch_free(e->reg);
+    emit_op1(OP_JNE, op_label(prefix, label));
 }
 
 void expr_codegen(struct expr * e)
@@ -2088,149 +3737,91 @@ void expr_codegen(struct expr * e)
     switch (e->kind)
     {
     case EXPR_ADD:
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        fprintf(file, "\tadd\t%s,\t%s\n", scratch_name(e->expr_->operation->right->reg, 8), scratch_name(e->expr_->operation->left->reg, 8));
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = e->expr_->operation->right->reg;
+        operation_codegen(e, OP_ADD, 1);
         break;
     case EXPR_SUB:
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        fprintf(file, "\tsub\t%s,\t%s\n", scratch_name(e->expr_->operation->left->reg, 8), scratch_name(e->expr_->operation->right->reg, 8));
-        scratch_free(e->expr_->operation->right->reg);
-        e->reg = e->expr_->operation->left->reg;
+        operation_codegen(e, OP_SUB, 0);
         break;
     case EXPR_MUL:
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        fprintf(file, "\tmov\trax,\t%s\n", scratch_name(e->expr_->operation->right->reg, 8));
-        fprintf(file, "\tmul\t%s\n", scratch_name(e->expr_->operation->left->reg, 8));
-        scratch_free(e->expr_->operation->right->reg);
-        e->reg = e->expr_->operation->right->reg;
+        mul_codegen(e);
         break;
     case EXPR_DIV:
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        fprintf(file, "\tdiv\t%s,\t%s\n", scratch_name(e->expr_->operation->right->reg, 8), scratch_name(e->expr_->operation->left->reg, 8));
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = e->expr_->operation->right->reg;
+        div_codegen(e);
         break;
     case EXPR_EQUAL:
-        int equalLabel = label_create();
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        int equalReg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t0\n", scratch_name(equalReg, 8));
-        fprintf(file, "\tcmp\t%s,\t%s\n", scratch_name(e->expr_->operation->left->reg, 8), scratch_name(e->expr_->operation->right->reg, 8));
-        fprintf(file, "\tjne\tend_%i\n", equalLabel);
-        fprintf(file, "\tmov\t%s,\t1\n", scratch_name(equalReg, 8));
-        fprintf(file, "end_%i:\n", equalLabel);
-        scratch_free(e->expr_->operation->right->reg);
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = equalReg;
-        break;
-    case EXPR_NOT_EQUAL: // THESE CAN BE OPTIMIZED A LOT
-        int notEqualLabel = label_create();
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        int notEqualReg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t0\n", scratch_name(notEqualReg, 8));
-        fprintf(file, "\tcmp\t%s,\t%s\n", scratch_name(e->expr_->operation->left->reg, 8), scratch_name(e->expr_->operation->right->reg, 8));
-        fprintf(file, "\tje\tend_%i\n", notEqualLabel);
-        fprintf(file, "\tmov\t%s,\t1\n", scratch_name(notEqualReg, 8));
-        fprintf(file, "end_%i:\n", notEqualLabel);
-        scratch_free(e->expr_->operation->right->reg);
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = notEqualReg;
-        break;
-    case EXPR_GREATER: // THESE CAN BE OPTIMIZED A LOT
-        int greaterLabel = label_create();
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        int greatReg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t0\n", scratch_name(greatReg, 8));
-        fprintf(file, "\tcmp\t%s,\t%s\n", scratch_name(e->expr_->operation->left->reg, 8), scratch_name(e->expr_->operation->right->reg, 8));
-        fprintf(file, "\tjng\tend_%i\n", greaterLabel);
-        fprintf(file, "\tmov\t%s,\t1\n", scratch_name(greatReg, 8));
-        fprintf(file, "end_%i:\n", greaterLabel);
-        scratch_free(e->expr_->operation->right->reg);
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = greatReg;
-        break;
-    case EXPR_LESS: // THESE CAN BE OPTIMIZED A LOT
-        int lessLabel = label_create();
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        int lessReg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t0\n", scratch_name(lessReg, 8));
-        fprintf(file, "\tcmp\t%s,\t%s\n", scratch_name(e->expr_->operation->left->reg, 8), scratch_name(e->expr_->operation->right->reg, 8));
-        fprintf(file, "\tjnl\tend_%i\n", lessLabel);
-        fprintf(file, "\tmov\t%s,\t1\n", scratch_name(lessReg, 8));
-        fprintf(file, "end_%i:\n", lessLabel);
-        scratch_free(e->expr_->operation->right->reg);
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = lessReg;
-        break;
-    case EXPR_GREATER_EQUAL: // THESE CAN BE OPTIMIZED A LOT
-        int notGreaterLabel = label_create();
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        int notGreaterReg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t0\n", scratch_name(notGreaterReg, 8));
-        fprintf(file, "\tcmp\t%s,\t%s\n", scratch_name(e->expr_->operation->left->reg, 8), scratch_name(e->expr_->operation->right->reg, 8));
-        fprintf(file, "\tjl\tend_%i\n", notGreaterLabel);
-        fprintf(file, "\tmov\t%s,\t1\n", scratch_name(notGreaterReg, 8));
-        fprintf(file, "end_%i:\n", notGreaterLabel);
-        scratch_free(e->expr_->operation->right->reg);
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = notGreaterReg;
-        break;
-    case EXPR_LESS_EQUAL: // THESE CAN BE OPTIMIZED A LOT
-        int notLessLabel = label_create();
-        expr_codegen(e->expr_->operation->left);
-        expr_codegen(e->expr_->operation->right);
-        int notLessReg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t0\n", scratch_name(notLessReg, 8));
-        fprintf(file, "\tcmp\t%s,\t%s\n", scratch_name(e->expr_->operation->left->reg, 8), scratch_name(e->expr_->operation->right->reg, 8));
-        fprintf(file, "\tjg\tend_%i\n", notLessLabel);
-        fprintf(file, "\tmov\t%s,\t1\n", scratch_name(notLessReg, 8));
-        fprintf(file, "end_%i:\n", notLessLabel);
-        scratch_free(e->expr_->operation->right->reg);
-        scratch_free(e->expr_->operation->left->reg);
-        e->reg = notLessReg;
+    case EXPR_NOT_EQUAL:
+    case EXPR_GREATER:
+    case EXPR_LESS:
+    case EXPR_GREATER_EQUAL:
+    case EXPR_LESS_EQUAL:
+        // The flags straight into a register, no branch.
+        expr_t kind = comparison_codegen(e);
+        if (e->reg < 0)
+        {
+            e->reg = scratch_alloc();
+        }
+        emit_op1(comparison_set(kind), scratch_operand(e->reg, 1));
+        emit_op2(OP_MOVZX, scratch_operand(e->reg, 8), scratch_operand(e->reg, 1));
         break;
     case EXPR_ASSIGN:
-        if (e->expr_->assign->expression->kind != EXPR_IDENTIFIER)
+        if (assign_in_place(e)) break;
+
+        struct operand value;
+        if (expr_operand(e->expr_->assign->expression, &value))
         {
-            expr_codegen(e->expr_->assign->expression);
-            fprintf(file, "\tmov\t%s,\t%s\n", symbol_codegen(e->expr_->assign->identifier->sym, e->expr_->assign->identifier->offset), scratch_name(e->expr_->assign->expression->reg, e->expr_->assign->identifier->sym->size));
-            scratch_free(e->expr_->assign->expression->reg);
+            struct symbol * target = e->expr_->assign->identifier->sym;
+            if (target->vreg)
+            {
+                variable_store(target, value);
+                break;
+            }
+            if (value.kind == OPERAND_IMM)
+            {
+                value = op_imm(symbol_narrow(target, value.value));
+            }
+            emit_op2(OP_MOV, ident_codegen(e->expr_->assign->identifier), operand_sized(value, target->size));
+            ident_release(e->expr_->assign->identifier);
+            break;
         }
-        else
+
+        // Anything else through a register: x86 has no memory to memory mov.
+        expr_codegen(e->expr_->assign->expression);
+        if (e->expr_->assign->identifier->sym->vreg)
         {
-            fprintf(file, "\tmov\t%s,\t%s\n", symbol_codegen(e->expr_->assign->identifier->sym, e->expr_->assign->identifier->offset), symbol_codegen(e->expr_->assign->expression->expr_->identifier->sym, e->expr_->assign->expression->expr_->identifier->offset));
+            variable_store(e->expr_->assign->identifier->sym, scratch_operand(e->expr_->assign->expression->reg, 8));
+            scratch_free(e->expr_->assign->expression->reg);
+            break;
         }
+        emit_op2(OP_MOV, ident_codegen(e->expr_->assign->identifier), scratch_operand(e->expr_->assign->expression->reg, e->expr_->assign->identifier->sym->size));
+        ident_release(e->expr_->assign->identifier);
+        scratch_free(e->expr_->assign->expression->reg);
         break;
     case EXPR_FUNCTION_CALL:
         expr_function_call_codegen(e);
         
         e->reg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\trax\n", scratch_name(e->reg, 8));
+        emit_op2(OP_MOV, scratch_operand(e->reg, 8), op_reg(REG_RAX, 8));
         break;
     case EXPR_IDENTIFIER:
+        // A copy, as the value's register is the operators' to overwrite.
+        if (e->expr_->identifier->sym->vreg)
+        {
+            e->reg = scratch_alloc();
+            emit_op2(OP_MOV, scratch_operand(e->reg, 8), scratch_operand(e->expr_->identifier->sym->vreg, 8));
+            break;
+        }
+        struct operand source = ident_codegen(e->expr_->identifier);
+        ident_release(e->expr_->identifier);
         e->reg = scratch_alloc();
-        // fprintf(file, "%\n", e->expr_->identifier->offset);
-        
-        fprintf(file, "\tmov\t%s,\t%s\n", scratch_name(e->reg, e->expr_->identifier->sym->size), symbol_codegen(e->expr_->identifier->sym, e->expr_->identifier->offset));
+        load_codegen(e->reg, source, e->expr_->identifier->sym->type);
         break;
     case EXPR_INTEGER:
         e->reg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t%i\n", scratch_name(e->reg, 8), e->expr_->integer_value);
+        emit_op2(OP_MOV, scratch_operand(e->reg, 8), op_imm(e->expr_->integer_value));
         break;
     case EXPR_BOOL:
         e->reg = scratch_alloc();
-        fprintf(file, "\tmov\t%s,\t%i\n", scratch_name(e->reg, 8), e->expr_->integer_value);
+        emit_op2(OP_MOV, scratch_operand(e->reg, 8), op_imm(e->expr_->integer_value));
         break;
     
     default:
@@ -2247,97 +3838,82 @@ void if_codegen(struct stmt * s, struct decl_function * f)
         {
             int endLabel = label_create();
             int elseIfLabel = label_create();
-            expr_codegen(s->stmt_->if_stmt->expression);
-            fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->if_stmt->expression->reg, 8));
-            fprintf(file, "\tjne\telse_if_L%i\n", elseIfLabel);
-            scratch_free(s->stmt_->if_stmt->expression->reg);
+            condition_codegen(s->stmt_->if_stmt->expression, "else_if_L", elseIfLabel);
             stmt_codegen(s->stmt_->if_stmt->statement, f);
-            fprintf(file, "\tjmp\tend_L%i\n", endLabel);
-            fprintf(file, "else_if_L%i:\n", elseIfLabel);
+            emit_op1(OP_JMP, op_label("end_L", endLabel));
+            emit_label("else_if_L", 0, elseIfLabel);
             if_else_codegen(s->stmt_->if_stmt->else_stmt, f, endLabel);
-            fprintf(file, "end_L%i:\n", endLabel);
+            emit_label("end_L", 0, endLabel);
         }
         else
         {
             int endLabel = label_create();
             int elseLabel = label_create();
-            expr_codegen(s->stmt_->if_stmt->expression);
-            fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->if_stmt->expression->reg, 8));
-            fprintf(file, "\tjne\telse_L%i\n", elseLabel);
-            scratch_free(s->stmt_->if_stmt->expression->reg);
+            condition_codegen(s->stmt_->if_stmt->expression, "else_L", elseLabel);
             stmt_codegen(s->stmt_->if_stmt->statement, f);
-            fprintf(file, "\tjne\tend_L%i\n", endLabel);
-            fprintf(file, "else_L%i:\n", elseLabel);
+            emit_op1(OP_JMP, op_label("end_L", endLabel));
+            emit_label("else_L", 0, elseLabel);
             stmt_codegen(s->stmt_->if_stmt->else_stmt->stmt_->if_stmt->statement, f);
-            fprintf(file, "end_L%i:\n", endLabel);
+            emit_label("end_L", 0, endLabel);
         }
     }
     else
     {
         int endLabel = label_create();
-        expr_codegen(s->stmt_->if_stmt->expression);
-        fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->if_stmt->expression->reg, 8));
-        fprintf(file, "\tjne\tend_L%i\n", endLabel);
-        scratch_free(s->stmt_->if_stmt->expression->reg);
+        condition_codegen(s->stmt_->if_stmt->expression, "end_L", endLabel);
 
         stmt_codegen(s->stmt_->if_stmt->statement, f);
 
-        fprintf(file, "end_L%i:\n", endLabel);
+        emit_label("end_L", 0, endLabel);
     }
     
 }
 
 void if_else_codegen(struct stmt * s, struct decl_function * f, int end)
 {
-    if (s->stmt_->if_stmt->else_stmt)
+    // Walks the else-if chain in place rather than recursing per link.
+    for (;;)
     {
-        if (s->stmt_->if_stmt->else_stmt->kind == STMT_ELSE_IF)
+        if (s->stmt_->if_stmt->else_stmt)
         {
-            int elseIfLabel = label_create();
-            expr_codegen(s->stmt_->if_stmt->expression);
-            fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->if_stmt->expression->reg, 8));
-            fprintf(file, "\tjne\telse_if_L%i\n", elseIfLabel);
-            scratch_free(s->stmt_->if_stmt->expression->reg);
-            stmt_codegen(s->stmt_->if_stmt->statement, f);
-            fprintf(file, "\tjmp\tend_L%i\n", end);
-            fprintf(file, "else_if_L%i:\n", elseIfLabel);
-            if_else_codegen(s->stmt_->if_stmt->else_stmt, f, end);
-        
+            if (s->stmt_->if_stmt->else_stmt->kind == STMT_ELSE_IF)
+            {
+                int elseIfLabel = label_create();
+                condition_codegen(s->stmt_->if_stmt->expression, "else_if_L", elseIfLabel);
+                stmt_codegen(s->stmt_->if_stmt->statement, f);
+                emit_op1(OP_JMP, op_label("end_L", end));
+                emit_label("else_if_L", 0, elseIfLabel);
+                s = s->stmt_->if_stmt->else_stmt;
+                continue;
+            }
+            else
+            {
+                int elseLabel = label_create();
+                condition_codegen(s->stmt_->if_stmt->expression, "else_L", elseLabel);
+                stmt_codegen(s->stmt_->if_stmt->statement, f);
+                emit_op1(OP_JMP, op_label("end_L", end));
+                emit_label("else_L", 0, elseLabel);
+                stmt_codegen(s->stmt_->if_stmt->else_stmt->stmt_->if_stmt->statement, f);
+            }
         }
         else
         {
-            int elseLabel = label_create();
-            expr_codegen(s->stmt_->if_stmt->expression);
-            fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->if_stmt->expression->reg, 8));
-            fprintf(file, "\tjne\telse_L%i\n", elseLabel);
-            scratch_free(s->stmt_->if_stmt->expression->reg);
+            condition_codegen(s->stmt_->if_stmt->expression, "end_L", end);
             stmt_codegen(s->stmt_->if_stmt->statement, f);
-            fprintf(file, "\tjne\tend_L%i\n", end);
-            fprintf(file, "else_L%i:\n", elseLabel);
-            stmt_codegen(s->stmt_->if_stmt->else_stmt->stmt_->if_stmt->statement, f);
         }
+        break;
     }
-    else
-    {
-        expr_codegen(s->stmt_->if_stmt->expression);
-        fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->if_stmt->expression->reg, 8));
-        fprintf(file, "\tjne\tend_L%i\n", end);
-        stmt_codegen(s->stmt_->if_stmt->statement, f);
-    }
-    
 }
 
 void while_codegen(struct stmt * s, struct decl_function * f)
 {
     int startLabel = label_create();
     int endLabel = label_create();
-    fprintf(file, "while_start_%i:\n", startLabel);
-    expr_codegen(s->stmt_->while_stmt->expression);
-    fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->while_stmt->expression->reg, 4));
-    fprintf(file, "\tjne\twhile_end_%i\n", endLabel);
+    emit_label("while_start_", 0, startLabel);
+    condition_codegen(s->stmt_->while_stmt->expression, "while_end_", endLabel);
     stmt_codegen(s->stmt_->while_stmt->body, f);
-    fprintf(file, "\tjmp\twhile_start_%i\n", startLabel);
-    fprintf(file, "while_end_%i:\n", endLabel);
+    emit_op1(OP_JMP, op_label("while_start_", startLabel));
+    emit_label("while_end_", 0, endLabel);
 }
 
 void for_codegen(struct stmt * s, struct decl_function * f)
@@ -2346,155 +3922,410 @@ void for_codegen(struct stmt * s, struct decl_function * f)
     int endLabel = label_create();
 
     decl_codegen(s->stmt_->for_stmt->declaration);
-    fprintf(file, "for_start_%i:\n", startLabel);
+    emit_label("for_start_", 0, startLabel);
     
-    expr_codegen(s->stmt_->for_stmt->expression1);
-    fprintf(file, "\tcmp\t%s,\t1\n", scratch_name(s->stmt_->for_stmt->expression1->reg, 4));
-    fprintf(file, "\tjne\tfor_end_%i\n", endLabel);
+    condition_codegen(s->stmt_->for_stmt->expression1, "for_end_", endLabel);
 
     stmt_codegen(s->stmt_->for_stmt->body, f);
 
     expr_codegen(s->stmt_->for_stmt->expression2);
-    fprintf(file, "\tjmp\tfor_start_%i\n", startLabel);
-    fprintf(file, "for_end_%i:\n", endLabel);
+    emit_op1(OP_JMP, op_label("for_start_", startLabel));
+    emit_label("for_end_", 0, endLabel);
 }
 
 void stmt_codegen(struct stmt * s, struct decl_function * f)
 {
-    if (!s) return;
-
-    switch (s->kind)
+    for (; s; s = s->next)
     {
-    case STMT_DECL:
-        decl_codegen(s->stmt_->declaration);
-        break;
-    case STMT_EXPR:
-        expr_codegen(s->stmt_->expression);
-        break;
-    case STMT_RETURN:
-        expr_codegen(s->stmt_->expression);
-        fprintf(file, "\tmov\trax,\t%s\n", scratch_name(s->stmt_->expression->reg, 8));
-        // fprintf(file, "    JMP .%s_end\n", f->identifier->name);
-        scratch_free(s->stmt_->expression->reg);
-        break;
-    case STMT_IF:
-        if_codegen(s, f);
-        break;
-    case STMT_WHILE:
-        while_codegen(s, f);
-        break;
-    case STMT_FOR:
-        for_codegen(s, f);
-        break;    
-    default:
-        break;
+        switch (s->kind)
+        {
+        case STMT_DECL:
+            decl_codegen(s->stmt_->declaration);
+            break;
+        case STMT_EXPR:
+            expr_codegen(s->stmt_->expression);
+            // A call used as a statement still lands its result in a scratch
+            // register; nothing reads it, so give it back.
+            if (s->stmt_->expression->kind == EXPR_FUNCTION_CALL)
+            {
+                scratch_free(s->stmt_->expression->reg);
+            }
+            break;
+        case STMT_RETURN:
+            expr_codegen(s->stmt_->expression);
+            emit_op2(OP_MOV, op_reg(REG_RAX, 8), scratch_operand(s->stmt_->expression->reg, 8));
+            scratch_free(s->stmt_->expression->reg);
+            if (s != ctx->function_tail)
+            {
+                emit_op1(OP_JMP, op_symbol("return_", f->identifier->name));
+            }
+            break;
+        case STMT_IF:
+            if_codegen(s, f);
+            break;
+        case STMT_WHILE:
+            while_codegen(s, f);
+            break;
+        case STMT_FOR:
+            for_codegen(s, f);
+            break;    
+        default:
+            break;
+        }
     }
-
-    stmt_codegen(s->next, f);
 }
 
 void decl_function_arg_codegen(struct function_param * p)
 {
-    if (!p) return;
-
-    int reg = scratch_alloc();
-    fprintf(file, "\tmov\t%s,\t%s\n", scratch_name(reg, p->size), symbol_codegen(p->sym, 0));
-    fprintf(file, "\tmov\t%s,\t%s\n", symbol_codegen(p->sym, 0), scratch_name(reg, p->size));
-    decl_function_arg_codegen(p->next);
+    for (; p; p = p->next)
+    {
+        int reg = scratch_alloc();
+        emit_op2(OP_MOV, scratch_operand(reg, p->size), (symbol_codegen(p->sym, 0)));
+        emit_op2(OP_MOV, (symbol_codegen(p->sym, 0)), scratch_operand(reg, p->size));
+    }
 }
 
-void decl_function_codegen(struct decl_function * f)
+// Parameters arrive on the stack and are loaded into their registers on
+// the way in.
+void decl_function_params_codegen(struct function_param * p)
 {
-    if (!f) return;
+    for (; p; p = p->next)
+    {
+        if (!symbol_registerable(p->sym)) continue;
+
+        p->sym->vreg = allocator_vreg(1);
+        load_codegen(p->sym->vreg, symbol_codegen(p->sym, 0), p->sym->type);
+    }
+}
 
+void decl_function_generate(struct decl_function * f)
+{
     const char * start = "main";
 
-    if (strcmp(f->identifier->name, start) == 0)
+    ctx->function_tail = f->body;
+    while (ctx->function_tail && ctx->function_tail->next)
     {
-        fprintf(file, "main:\n");
+        ctx->function_tail = ctx->function_tail->next;
+    }
 
-        fprintf(file, "\tpush\trbp\n");
-        fprintf(file, "\tmov\trbp,\trsp\n");
+    int is_main = strcmp(f->identifier->name, start) == 0;
+    if (is_main)
+    {
+        emit_label("main", 0, -1);
+    }
+    else
+    {
+        emit_label("function_", f->identifier->name, -1);
+    }
 
-        int local_var_size = f->variable_count;
-        if (local_var_size%16 > 0)
-        local_var_size = local_var_size + 16 - local_var_size%16;
-        if (local_var_size > 0)
-        {
-            fprintf(file, "\tsub\trsp,\t%i\n", local_var_size);
-        }
+    emit_op1(OP_PUSH, op_reg(REG_RBP, 8));
+    emit_op2(OP_MOV, op_reg(REG_RBP, 8), op_reg(REG_RSP, 8));
 
-        stmt_codegen(f->body, f);
+    // The body is held back until its registers are allocated; the frame
+    // is only known then. main never returns, so it saves nothing.
+    allocator_begin();
+    decl_function_params_codegen(f->param);
+    stmt_codegen(f->body, f);
+    emit_label("return_", f->identifier->name, -1);
+    int frame = allocator_end(!is_main);
 
-        if (local_var_size > 0)
-        {
-            fprintf(file, "\tadd\trsp,\t%i\n", local_var_size);
-        }
+    allocator_restore();
+    if (frame > 0)
+    {
+        emit_op2(OP_ADD, op_reg(REG_RSP, 8), op_imm(frame));
+    }
 
-        fprintf(file, "\tpop\trbp\n");
-        fprintf(file, "\txor\trbx,\trbx\n"); // return code is 0 for now
-        fprintf(file, "\tint\t0x80\n");
+    if (is_main)
+    {
+        // Leave through exit() so stdio is flushed; rsp is back at rbp here,
+        // which keeps the call aligned.
+        emit_op2(OP_MOV, op_reg(REG_RDI, 8), op_reg(REG_RAX, 8));
+        emit_op1(OP_CALL, op_symbol("exit", 0));
     }
     else
     {
-        fprintf(file, "%s%s:\n", "function_", f->identifier->name);
+        emit_op1(OP_POP, op_reg(REG_RBP, 8));
+        emit_op0(OP_RET);
+    }
+}
 
-        fprintf(file, "\tpush\trbp\n");
-        fprintf(file, "\tmov\trbp,\trsp\n");
-        
-        int local_var_size = f->variable_count;
-        if (local_var_size%16 > 0)
-        local_var_size = local_var_size + 16 - local_var_size%16;
-        if (local_var_size > 0)
-        {
-            fprintf(file, "\tsub\trsp,\t%i\n", local_var_size);
-        }
+void decl_function_codegen(struct decl_function * f)
+{
+    if (!f) return;
 
-        stmt_codegen(f->body, f);
+    // Labels and scratch registers start over in every function, so its code
+    // is the same wherever it lands and can be cached.
+    ctx->label_counter = 0;
+    memset(ctx->registers, 0, sizeof(ctx->registers));
 
-        if (local_var_size > 0)
-        {
-            fprintf(file, "\tadd\trsp,\t%i\n", local_var_size);
-        }
+    if (f->cached)
+    {
+        fragment_replay(f->cached, f->cached_length, 1);
+        return;
+    }
+    if (!f->cache_key)
+    {
+        decl_function_generate(f);
+        return;
+    }
 
-        fprintf(file, "\tpop\trbp\n");
-        fprintf(file, "\tret\n");
+    // Only code generated without a complaint is worth keeping.
+    fflush(ctx->diagnostics);
+    long diagnostics = ftell(ctx->diagnostics);
+
+    // On a worker for -c the function is recorded anyway.
+    struct cache_buffer own = { 0 };
+    struct cache_buffer * recording = ctx->emitter->recording;
+    size_t start = recording ? recording->length : 0;
+    if (!recording)
+    {
+        recording = &own;
+        ctx->emitter->recording = &own;
     }
 
+    decl_function_generate(f);
+    if (recording == &own)
+    {
+        ctx->emitter->recording = 0;
+    }
 
+    fflush(ctx->diagnostics);
+    if (!ctx->error && ftell(ctx->diagnostics) == diagnostics)
+    {
+        cache_store(ctx->cache, f->cache_key, f->cache_key_length, recording->data + start, recording->length - start);
+    }
+    cache_buffer_release(&own);
 }
 
-void decl_codegen(struct decl * d)
+void decl_variable_codegen(struct decl * d)
 {
-    if (!d) return;
-
     switch (d->kind)
     {
-    case DECL_FUNCTION:
-        decl_function_codegen(d->decl_->function);
-        break;
     case DECL_VARIABLE_GLOBAL:
         if (d->decl_->variable->value)
         {
             expr_codegen(d->decl_->variable->value);
-            fprintf(file, "\tMOVQ\t%s,\t%s\n", scratch_name(d->decl_->variable->value->reg, 8), symbol_codegen(d->decl_->variable->sym, 0));
+            emit_op2(OP_MOVQ, scratch_operand(d->decl_->variable->value->reg, 8), (symbol_codegen(d->decl_->variable->sym, 0)));
             scratch_free(d->decl_->variable->value->reg);
         }
         break;
     case DECL_VARIABLE_LOCAL:
-        if (d->decl_->variable->value)
-        {   
+        // Every read of a folded local is its constant already.
+        if (d->decl_->variable->sym && d->decl_->variable->sym->constant) break;
+
+        if (ctx->emitter->allocating && symbol_registerable(d->decl_->variable->sym))
+        {
+            d->decl_->variable->sym->vreg = allocator_vreg(1);
+            struct operand value;
+            if (d->decl_->variable->value && expr_operand(d->decl_->variable->value, &value))
+            {
+                variable_store(d->decl_->variable->sym, value);
+            }
+            else if (d->decl_->variable->value)
+            {
+                expr_codegen(d->decl_->variable->value);
+                variable_store(d->decl_->variable->sym, scratch_operand(d->decl_->variable->value->reg, 8));
+                scratch_free(d->decl_->variable->value->reg);
+            }
+        }
+        else
+        {
+            if (ctx->emitter->allocating && d->decl_->variable->sym)
+            {
+                allocator_local(d->decl_->variable->sym->position);
+            }
+            if (!d->decl_->variable->value) break;
+
             expr_codegen(d->decl_->variable->value);
-            fprintf(file, "\tmov\t%s,\t%s\n", symbol_codegen(d->decl_->variable->sym, 0), scratch_name(d->decl_->variable->value->reg, d->decl_->variable->sym->size));
+            emit_op2(OP_MOV, (symbol_codegen(d->decl_->variable->sym, 0)), scratch_operand(d->decl_->variable->value->reg, d->decl_->variable->sym->size));
             scratch_free(d->decl_->variable->value->reg);
         }
-        
         break;
-
-    
     default:
         break;
     }
+}
+
+void decl_codegen(struct decl * d)
+{
+    for (; d; d = d->next)
+    {
+        switch (d->kind)
+        {
+        case DECL_FUNCTION:
+            decl_function_codegen(d->decl_->function);
+            break;
+        case DECL_VARIABLE_GLOBAL:
+        case DECL_VARIABLE_LOCAL:
+            decl_variable_codegen(d);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// Parallel codegen
+//
+// Once a unit is resolved its functions are independent: each starts with
+// fresh labels and registers and writes nothing outside its own tree. With
+// enough of them they are generated on a pool of threads, each thread into
+// a context of its own with its own buffers, and spliced into the unit in
+// declaration order, so the output is the same as a serial run's. For -c
+// the workers record each function's instructions instead of encoding
+// them, and the calling thread replays them into the object. Global
+// initializers between the functions are generated in order on the calling
+// thread, picking up labels and registers where the function before left
+// them, as they would serially.
+
+#define CODEGEN_PARALLEL_MIN_FUNCTIONS 64
+
+struct codegen_item
+{
+    struct decl_function * function;
+    int worker;
+
+    // Where the function's code and messages are in its worker's buffers.
+    size_t start;
+    size_t end;
+    long diagnostics_start;
+    long diagnostics_end;
+
+    int error;
+    int label_counter;
+    int registers[7];
+};
+
+struct codegen_worker
+{
+    struct hend_context context;
+    struct cache_buffer fragment;
+
+    char * diagnostics;
+    size_t diagnostics_length;
+};
+
+struct codegen_pool
+{
+    struct codegen_item * items;
+    struct codegen_worker * workers;
+};
+
+void codegen_work(void * arg, int worker, int item)
+{
+    struct codegen_pool * p = arg;
+    struct codegen_worker * w = &p->workers[worker];
+    struct codegen_item * i = &p->items[item];
+
+    ctx = &w->context;
+    ctx->error = 0;
+    fflush(ctx->diagnostics);
+    i->diagnostics_start = ftell(ctx->diagnostics);
+    i->start = ctx->emitter->recording ? w->fragment.length : ctx->emitter->length;
+
+    decl_function_codegen(i->function);
+
+    fflush(ctx->diagnostics);
+    i->diagnostics_end = ftell(ctx->diagnostics);
+    i->end = ctx->emitter->recording ? w->fragment.length : ctx->emitter->length;
+    i->worker = worker;
+    i->error = ctx->error;
+    i->label_counter = ctx->label_counter;
+    memcpy(i->registers, ctx->registers, sizeof(i->registers));
+}
+
+// Generates the top-level declarations d, on the pool when they are worth it.
+void decl_codegen_parallel(struct decl * d)
+{
+    int count = 0;
+    for (struct decl * e = d; e; e = e->next)
+    {
+        if (e->kind == DECL_FUNCTION) count++;
+    }
+
+    int workers = pool_workers(ctx->jobs, count);
+    if (workers < 2 || count < CODEGEN_PARALLEL_MIN_FUNCTIONS)
+    {
+        decl_codegen(d);
+        return;
+    }
+
+    struct codegen_pool p;
+    p.items = calloc(count, sizeof(*p.items));
+    p.workers = calloc(workers, sizeof(*p.workers));
+
+    int n = 0;
+    for (struct decl * e = d; e; e = e->next)
+    {
+        if (e->kind == DECL_FUNCTION) p.items[n++].function = e->decl_->function;
+    }
+
+    // A cached function's names are interned as it is replayed, so the
+    // tables take their locks while the workers run.
+    pthread_mutex_t interned_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t types_lock = PTHREAD_MUTEX_INITIALIZER;
+    int locked = !ctx->interned->lock;
+    if (locked)
+    {
+        ctx->interned->lock = &interned_lock;
+        ctx->types->lock = &types_lock;
+    }
+
+    for (int i = 0; i < workers; i++)
+    {
+        struct codegen_worker * w = &p.workers[i];
+        w->context = *ctx;
+        w->context.emitter = emitter_create();
+        if (ctx->emitter->object)
+        {
+            w->context.emitter->recording = &w->fragment;
+            w->context.emitter->record_only = 1;
+        }
+        w->context.diagnostics = open_memstream(&w->diagnostics, &w->diagnostics_length);
+    }
+
+    pool_run(workers, count, codegen_work, &p);
+
+    if (locked)
+    {
+        ctx->interned->lock = 0;
+        ctx->types->lock = 0;
+    }
+
+    n = 0;
+    for (; d; d = d->next)
+    {
+        if (d->kind != DECL_FUNCTION)
+        {
+            decl_variable_codegen(d);
+            continue;
+        }
+
+        struct codegen_item * i = &p.items[n++];
+        struct codegen_worker * w = &p.workers[i->worker];
+        fflush(w->context.diagnostics);
+        fwrite(w->diagnostics + i->diagnostics_start, 1, i->diagnostics_end - i->diagnostics_start, ctx->diagnostics);
+        if (ctx->emitter->object)
+        {
+            fragment_replay(w->fragment.data + i->start, i->end - i->start, 1);
+        }
+        else
+        {
+            emit_bytes(w->context.emitter->buffer + i->start, i->end - i->start);
+        }
+        ctx->error |= i->error;
+        ctx->label_counter = i->label_counter;
+        memcpy(ctx->registers, i->registers, sizeof(ctx->registers));
+    }
 
-    decl_codegen(d->next);
+    for (int i = 0; i < workers; i++)
+    {
+        struct codegen_worker * w = &p.workers[i];
+        fclose(w->context.diagnostics);
+        free(w->diagnostics);
+        emitter_release(w->context.emitter);
+        cache_buffer_release(&w->fragment);
+    }
+    free(p.workers);
+    free(p.items);
 }
\ No newline at end of file
@@ -0,0 +1,657 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Allocator
+//
+// Codegen writes a function's body against virtual registers, as many as it
+// likes, and the emitter holds the body back instead of writing it. Once the
+// body is complete every virtual register gets a live interval, from where
+// it is declared or first written to where it is last read, and a linear
+// scan over the intervals hands out physical registers. A register that is
+// clobbered somewhere inside an interval, by a call or by an instruction
+// that writes it by name, is never given to that interval, so values live
+// across a call end up in the callee-saved registers, which every function
+// but main saves in its frame and restores. When no register is left, the
+// interval that lasts longest goes to a stack slot below the locals.
+//
+// Locals are virtual registers too and are assigned more than once, so
+// their intervals are not enough around a loop: a local declared before a
+// loop and still in use inside it lives until the jump back. Temporaries
+// never outlive the statement that makes them.
+//
+// rax carries call results and the implicit operands of imul and idiv, and
+// with r11 loads what an instruction cannot take from a stack slot, so
+// neither is ever handed out. A physical register is only ever written right
+// before the instruction that reads it, with no virtual register defined in
+// between.
+
+#define VREG_FIRST 16
+
+#define REG_BIT(r) (1u << (r))
+#define CALLER_SAVED (REG_BIT(REG_RAX) | REG_BIT(REG_RCX) | REG_BIT(REG_RDX) | REG_BIT(REG_RSI) | REG_BIT(REG_RDI) \
+    | REG_BIT(REG_R8) | REG_BIT(REG_R9) | REG_BIT(REG_R10) | REG_BIT(REG_R11))
+#define CALLEE_SAVED (REG_BIT(REG_RBX) | REG_BIT(REG_R12) | REG_BIT(REG_R13) | REG_BIT(REG_R14) | REG_BIT(REG_R15))
+
+// Caller-saved registers first, so a function that makes no calls need not
+// save any; rdx last of them, as imul and idiv take it.
+static const reg_t allocatable[] =
+{
+    REG_RCX, REG_RSI, REG_RDI, REG_R8, REG_R9, REG_R10, REG_RDX,
+    REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15
+};
+
+#define ALLOCATABLE_COUNT (int)(sizeof(allocatable) / sizeof(*allocatable))
+
+struct allocator_insn
+{
+    // A label, named by a; otherwise an instruction.
+    int label;
+    opcode_t op;
+    struct operand a;
+    struct operand b;
+};
+
+struct vreg
+{
+    int start;
+    int end;
+
+    // A local, assigned any number of times.
+    int variable;
+
+    // Registers written somewhere strictly inside the interval.
+    unsigned forbidden;
+
+    // The physical register, or REG_NONE and a slot below rbp.
+    reg_t reg;
+    int slot;
+};
+
+// An instruction that writes physical registers.
+struct allocator_clobber
+{
+    int position;
+    unsigned mask;
+};
+
+struct allocator
+{
+    struct allocator_insn * code;
+    int length;
+    int capacity;
+
+    struct vreg * vregs;
+    int vreg_count;
+    int vreg_capacity;
+
+    // Scratch for the scan, kept between functions.
+    int * order;
+    int * active;
+    int * chain;
+    int * ending;
+    int ending_capacity;
+    int * label_positions;
+    int label_capacity;
+    struct allocator_clobber * clobbers;
+    int clobber_capacity;
+
+    // Bytes below rbp the locals kept in memory take.
+    int locals;
+
+    // Callee-saved registers handed out, and where they are kept.
+    unsigned saved;
+    int save_slot;
+};
+
+void * allocator_grow(void * data, int * capacity, int needed, size_t size)
+{
+    if (needed <= *capacity) return data;
+
+    int grown = *capacity ? *capacity : 256;
+    while (grown < needed)
+    {
+        grown *= 2;
+    }
+    data = realloc(data, grown * size);
+    if (!data)
+    {
+        printf("Memory allocation failed for allocator.\n");
+        exit(1);
+    }
+    *capacity = grown;
+    return data;
+}
+
+void allocator_release(struct allocator * a)
+{
+    if (!a) return;
+
+    free(a->code);
+    free(a->vregs);
+    free(a->order);
+    free(a->active);
+    free(a->chain);
+    free(a->ending);
+    free(a->label_positions);
+    free(a->clobbers);
+    free(a);
+}
+
+// Starts holding back the current function's body.
+void allocator_begin()
+{
+    if (!ctx->emitter->allocator)
+    {
+        ctx->emitter->allocator = calloc(1, sizeof(struct allocator));
+        if (!ctx->emitter->allocator)
+        {
+            printf("Memory allocation failed for allocator.\n");
+            exit(1);
+        }
+    }
+
+    struct allocator * a = ctx->emitter->allocator;
+    a->length = 0;
+    a->vreg_count = 0;
+    a->locals = 0;
+    a->saved = 0;
+    ctx->emitter->allocating = 1;
+}
+
+// A new virtual register, live from the next instruction on.
+int allocator_vreg(int variable)
+{
+    struct allocator * a = ctx->emitter->allocator;
+    int capacity = a->vreg_capacity;
+    a->vregs = allocator_grow(a->vregs, &a->vreg_capacity, a->vreg_count + 1, sizeof(*a->vregs));
+    if (capacity != a->vreg_capacity)
+    {
+        a->order = realloc(a->order, a->vreg_capacity * sizeof(*a->order));
+        a->active = realloc(a->active, a->vreg_capacity * sizeof(*a->active));
+        a->chain = realloc(a->chain, a->vreg_capacity * sizeof(*a->chain));
+        if (!a->order || !a->active || !a->chain)
+        {
+            printf("Memory allocation failed for allocator.\n");
+            exit(1);
+        }
+    }
+
+    struct vreg * v = &a->vregs[a->vreg_count];
+    v->start = a->length;
+    v->end = a->length;
+    v->variable = variable;
+    v->forbidden = 0;
+    v->reg = REG_NONE;
+    v->slot = 0;
+
+    return VREG_FIRST + a->vreg_count++;
+}
+
+// A local that stays in memory, its lowest byte position bytes below rbp.
+void allocator_local(int position)
+{
+    struct allocator * a = ctx->emitter->allocator;
+    if (position > a->locals) a->locals = position;
+}
+
+struct allocator_insn * allocator_append()
+{
+    struct allocator * a = ctx->emitter->allocator;
+    a->code = allocator_grow(a->code, &a->capacity, a->length + 1, sizeof(*a->code));
+    return &a->code[a->length++];
+}
+
+void allocator_insn(opcode_t op, struct operand x, struct operand y)
+{
+    struct allocator_insn * i = allocator_append();
+    i->label = 0;
+    i->op = op;
+    i->a = x;
+    i->b = y;
+}
+
+void allocator_label(const char * prefix, const char * name, long number)
+{
+    struct allocator_insn * i = allocator_append();
+    i->label = 1;
+    i->op = OP_JMP;
+    i->a = op_label(prefix, number);
+    i->a.name = name;
+    i->b = no_operand;
+}
+
+// Intervals
+
+static inline void allocator_touch(struct allocator * a, reg_t r, int position)
+{
+    if (r < VREG_FIRST) return;
+
+    struct vreg * v = &a->vregs[r - VREG_FIRST];
+    if (position < v->start) v->start = position;
+    if (position > v->end) v->end = position;
+}
+
+static inline int allocator_is_jump(opcode_t op)
+{
+    return op == OP_JMP || op == OP_JE || op == OP_JNE || op == OP_JG || op == OP_JNG || op == OP_JL || op == OP_JNL;
+}
+
+// Physical registers an instruction writes.
+unsigned allocator_clobbers(const struct allocator_insn * i)
+{
+    switch (i->op)
+    {
+    case OP_CALL:
+        return CALLER_SAVED;
+    case OP_IMUL:
+        if (i->b.kind != OPERAND_NONE) break;
+        return REG_BIT(REG_RAX) | REG_BIT(REG_RDX);
+    case OP_IDIV:
+    case OP_CQO:
+        return REG_BIT(REG_RAX) | REG_BIT(REG_RDX);
+    case OP_CMP:
+    case OP_PUSH:
+    case OP_JMP:
+    case OP_RET:
+        return 0;
+    default:
+        break;
+    }
+    if (i->a.kind == OPERAND_REG && i->a.reg != REG_NONE && i->a.reg < VREG_FIRST)
+    {
+        return REG_BIT(i->a.reg);
+    }
+    return 0;
+}
+
+void allocator_intervals(struct allocator * a)
+{
+    for (int p = 0; p < a->length; p++)
+    {
+        struct allocator_insn * i = &a->code[p];
+        if (i->label) continue;
+
+        struct operand * operands[2] = { &i->a, &i->b };
+        for (int k = 0; k < 2; k++)
+        {
+            struct operand * o = operands[k];
+            if (o->kind == OPERAND_REG) allocator_touch(a, o->reg, p);
+            if (o->kind == OPERAND_MEM && !o->name) allocator_touch(a, o->reg, p);
+            if (o->kind == OPERAND_MEM && o->scale) allocator_touch(a, o->index, p);
+        }
+    }
+
+    // Numbered labels are unique within a function; a jump to one already
+    // passed closes a loop.
+    a->label_positions = allocator_grow(a->label_positions, &a->label_capacity, ctx->label_counter + 1, sizeof(int));
+    for (int n = 0; n <= ctx->label_counter; n++)
+    {
+        a->label_positions[n] = -1;
+    }
+    for (int p = 0; p < a->length; p++)
+    {
+        struct allocator_insn * i = &a->code[p];
+        if (i->label && !i->a.name && i->a.value >= 0 && i->a.value <= ctx->label_counter)
+        {
+            a->label_positions[i->a.value] = p;
+        }
+    }
+
+    // The locals whose intervals end at each position, linked through chain.
+    // A loop only looks at the locals that end inside it, and one that is
+    // live at the loop's head, even if it only starts there, moves to the
+    // jump back, where an enclosing loop finds it again. That is the loop's
+    // length per loop it is nested in, instead of every local per loop.
+    a->ending = allocator_grow(a->ending, &a->ending_capacity, a->length + 1, sizeof(int));
+    for (int p = 0; p <= a->length; p++)
+    {
+        a->ending[p] = -1;
+    }
+    for (int r = 0; r < a->vreg_count; r++)
+    {
+        if (!a->vregs[r].variable) continue;
+
+        a->chain[r] = a->ending[a->vregs[r].end];
+        a->ending[a->vregs[r].end] = r;
+    }
+    for (int p = 0; p < a->length; p++)
+    {
+        struct allocator_insn * i = &a->code[p];
+        if (i->label || !allocator_is_jump(i->op) || i->a.kind != OPERAND_LABEL || i->a.name) continue;
+        if (i->a.value < 0 || i->a.value > ctx->label_counter) continue;
+
+        int head = a->label_positions[i->a.value];
+        if (head < 0 || head > p) continue;
+
+        for (int q = head; q < p; q++)
+        {
+            int * link = &a->ending[q];
+            while (*link >= 0)
+            {
+                int r = *link;
+                struct vreg * v = &a->vregs[r];
+                if (v->start <= head)
+                {
+                    *link = a->chain[r];
+                    v->end = p;
+                    a->chain[r] = a->ending[p];
+                    a->ending[p] = r;
+                }
+                else
+                {
+                    link = &a->chain[r];
+                }
+            }
+        }
+    }
+
+    int clobbers = 0;
+    for (int p = 0; p < a->length; p++)
+    {
+        if (a->code[p].label) continue;
+
+        unsigned mask = allocator_clobbers(&a->code[p]);
+        if (!mask) continue;
+
+        a->clobbers = allocator_grow(a->clobbers, &a->clobber_capacity, clobbers + 1, sizeof(*a->clobbers));
+        a->clobbers[clobbers].position = p;
+        a->clobbers[clobbers].mask = mask;
+        clobbers++;
+    }
+    for (int r = 0; r < a->vreg_count; r++)
+    {
+        struct vreg * v = &a->vregs[r];
+
+        int low = 0;
+        int high = clobbers;
+        while (low < high)
+        {
+            int middle = (low + high) / 2;
+            if (a->clobbers[middle].position <= v->start) low = middle + 1;
+            else high = middle;
+        }
+        for (int c = low; c < clobbers && a->clobbers[c].position < v->end; c++)
+        {
+            v->forbidden |= a->clobbers[c].mask;
+        }
+    }
+}
+
+// Scan
+
+static inline int allocator_before(struct allocator * a, int x, int y)
+{
+    if (a->vregs[x].start != a->vregs[y].start) return a->vregs[x].start < a->vregs[y].start;
+    return x < y;
+}
+
+// Registers are made mostly in the order they start; an insertion sort is
+// all it takes.
+void allocator_sort(struct allocator * a)
+{
+    for (int r = 0; r < a->vreg_count; r++)
+    {
+        int k = r;
+        while (k > 0 && allocator_before(a, r, a->order[k - 1]))
+        {
+            a->order[k] = a->order[k - 1];
+            k--;
+        }
+        a->order[k] = r;
+    }
+}
+
+// Returns the number of stack slots the spilled intervals take.
+int allocator_scan(struct allocator * a, int locals)
+{
+    allocator_sort(a);
+
+    unsigned free_registers = 0;
+    for (int k = 0; k < ALLOCATABLE_COUNT; k++)
+    {
+        free_registers |= REG_BIT(allocatable[k]);
+    }
+
+    int active = 0;
+    int slots = 0;
+    for (int n = 0; n < a->vreg_count; n++)
+    {
+        int r = a->order[n];
+        struct vreg * v = &a->vregs[r];
+
+        // Intervals that have ended give their registers back.
+        int kept = 0;
+        for (int k = 0; k < active; k++)
+        {
+            struct vreg * w = &a->vregs[a->active[k]];
+            if (w->end < v->start)
+            {
+                free_registers |= REG_BIT(w->reg);
+            }
+            else
+            {
+                a->active[kept++] = a->active[k];
+            }
+        }
+        active = kept;
+
+        for (int k = 0; k < ALLOCATABLE_COUNT && v->reg == REG_NONE; k++)
+        {
+            unsigned bit = REG_BIT(allocatable[k]);
+            if ((free_registers & bit) && !(v->forbidden & bit))
+            {
+                v->reg = allocatable[k];
+                free_registers &= ~bit;
+            }
+        }
+
+        if (v->reg == REG_NONE)
+        {
+            // Out of registers: whichever of v and the active intervals that
+            // could give v a register lasts longest goes to the stack.
+            int victim = -1;
+            for (int k = 0; k < active; k++)
+            {
+                struct vreg * w = &a->vregs[a->active[k]];
+                if (v->forbidden & REG_BIT(w->reg)) continue;
+                if (victim < 0 || w->end > a->vregs[a->active[victim]].end) victim = k;
+            }
+
+            if (victim >= 0 && a->vregs[a->active[victim]].end > v->end)
+            {
+                struct vreg * w = &a->vregs[a->active[victim]];
+                v->reg = w->reg;
+                w->reg = REG_NONE;
+                w->slot = locals + 8 * ++slots;
+                a->active[victim] = r;
+                continue;
+            }
+
+            v->slot = locals + 8 * ++slots;
+            continue;
+        }
+
+        a->active[active++] = r;
+    }
+
+    for (int r = 0; r < a->vreg_count; r++)
+    {
+        if (a->vregs[r].reg != REG_NONE)
+        {
+            a->saved |= REG_BIT(a->vregs[r].reg) & CALLEE_SAVED;
+        }
+    }
+
+    return slots;
+}
+
+// Rewrite
+
+// A stack slot's operand, sized as the register it stands for.
+static inline struct operand allocator_slot(const struct vreg * v, int size)
+{
+    return op_mem(REG_RBP, -v->slot, size);
+}
+
+struct operand allocator_operand(struct allocator * a, struct operand o)
+{
+    if (o.kind == OPERAND_REG && o.reg >= VREG_FIRST)
+    {
+        struct vreg * v = &a->vregs[o.reg - VREG_FIRST];
+        if (v->reg == REG_NONE) return allocator_slot(v, o.size ? o.size : 8);
+        o.reg = v->reg;
+    }
+    if (o.kind == OPERAND_MEM && !o.name && o.reg >= VREG_FIRST)
+    {
+        // A base, which only lea's address has: r11 holds one that was
+        // spilled, for the index as well when it is the same.
+        struct vreg * v = &a->vregs[o.reg - VREG_FIRST];
+        reg_t base = v->reg;
+        if (base == REG_NONE)
+        {
+            emit_op2(OP_MOV, op_reg(REG_R11, 8), allocator_slot(v, 8));
+            base = REG_R11;
+        }
+        if (o.scale && o.index == o.reg)
+        {
+            o.index = base;
+        }
+        o.reg = base;
+    }
+    if (o.kind == OPERAND_MEM && o.scale && o.index >= VREG_FIRST)
+    {
+        struct vreg * v = &a->vregs[o.index - VREG_FIRST];
+        if (v->reg == REG_NONE)
+        {
+            // The address needs a register: rax is free between statements.
+            emit_op2(OP_MOV, op_reg(REG_RAX, 8), allocator_slot(v, 8));
+            o.index = REG_RAX;
+        }
+        else
+        {
+            o.index = v->reg;
+        }
+    }
+    return o;
+}
+
+static inline int allocator_writes(opcode_t op)
+{
+    return op == OP_MOV || op == OP_MOVQ || op == OP_ADD || op == OP_SUB || op == OP_XOR
+        || op == OP_MOVSX || op == OP_MOVSXD || op == OP_MOVZX || op == OP_POP
+        || op == OP_IMUL || op == OP_SHL || op == OP_SAR || op == OP_SHR || op == OP_NEG || op == OP_LEA;
+}
+
+// Emits one instruction with its virtual registers replaced, going through
+// r11 where x86 cannot take a stack slot in place of a register.
+void allocator_emit(struct allocator * a, struct allocator_insn * i)
+{
+    if (i->label)
+    {
+        emit_label(i->a.prefix, i->a.name, i->a.value);
+        return;
+    }
+
+    int spilled = i->a.kind == OPERAND_REG && i->a.reg >= VREG_FIRST && a->vregs[i->a.reg - VREG_FIRST].reg == REG_NONE;
+    struct operand x = allocator_operand(a, i->a);
+    struct operand y = allocator_operand(a, i->b);
+    opcode_t op = i->op;
+
+    // A slot written as a whole register: sign and zero extension, the two
+    // operand imul and lea want a register, and a 32-bit write would leave
+    // the slot's high half alone.
+    int to_register = op == OP_MOVSX || op == OP_MOVSXD || op == OP_MOVZX || op == OP_LEA || (op == OP_IMUL && i->b.kind != OPERAND_NONE);
+    if (spilled && allocator_writes(op) && (to_register || x.size == 4))
+    {
+        struct operand wide = x;
+        wide.size = 8;
+        if (op != OP_MOV && op != OP_MOVSX && op != OP_MOVSXD && op != OP_MOVZX && op != OP_LEA)
+        {
+            emit_op2(OP_MOV, op_reg(REG_R11, 8), wide);
+        }
+        emit_op2(op, op_reg(REG_R11, op == OP_MOVSX || op == OP_MOVSXD || op == OP_MOVZX ? 8 : x.size), y);
+        emit_op2(OP_MOV, wide, op_reg(REG_R11, 8));
+        return;
+    }
+
+    if (x.kind == OPERAND_MEM && y.kind == OPERAND_MEM)
+    {
+        int size = y.size ? y.size : x.size;
+        emit_op2(OP_MOV, op_reg(REG_R11, size), y);
+        y = op_reg(REG_R11, x.size ? x.size : size);
+    }
+    else if (x.kind == OPERAND_MEM && y.kind == OPERAND_IMM && (y.value < INT32_MIN || y.value > INT32_MAX))
+    {
+        emit_op2(OP_MOV, op_reg(REG_R11, 8), y);
+        y = op_reg(REG_R11, x.size ? x.size : 8);
+    }
+
+    emit_insn(op, x, y);
+}
+
+// Allocates the function held back since allocator_begin() and emits it,
+// preceded by the rest of the prologue: the frame, for the locals in memory
+// and the spill slots, and the callee-saved registers when preserve is set.
+// Returns the size of the frame.
+int allocator_end(int preserve)
+{
+    struct allocator * a = ctx->emitter->allocator;
+    ctx->emitter->allocating = 0;
+
+    // Slots are whole registers and stay aligned.
+    int locals = (a->locals + 7) & ~7;
+
+    allocator_intervals(a);
+    int slots = allocator_scan(a, locals);
+    if (!preserve) a->saved = 0;
+
+    int saves = 0;
+    for (unsigned s = a->saved; s; s &= s - 1)
+    {
+        saves++;
+    }
+    a->save_slot = locals + 8 * slots;
+
+    int frame = a->save_slot + 8 * saves;
+    if (frame % 16 > 0)
+    {
+        frame += 16 - frame % 16;
+    }
+    if (frame > 0)
+    {
+        emit_op2(OP_SUB, op_reg(REG_RSP, 8), op_imm(frame));
+    }
+
+    int slot = a->save_slot;
+    for (int r = 0; r < 16; r++)
+    {
+        if (a->saved & REG_BIT(r))
+        {
+            slot += 8;
+            emit_op2(OP_MOV, op_mem(REG_RBP, -slot, 8), op_reg(r, 8));
+        }
+    }
+
+    for (int p = 0; p < a->length; p++)
+    {
+        allocator_emit(a, &a->code[p]);
+    }
+
+    return frame;
+}
+
+// Puts back the callee-saved registers allocator_end() saved.
+void allocator_restore()
+{
+    struct allocator * a = ctx->emitter->allocator;
+    int slot = a->save_slot;
+    for (int r = 0; r < 16; r++)
+    {
+        if (a->saved & REG_BIT(r))
+        {
+            slot += 8;
+            emit_op2(OP_MOV, op_reg(r, 8), op_mem(REG_RBP, -slot, 8));
+        }
+    }
+}
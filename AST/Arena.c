@@ -0,0 +1,210 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Arena
+//
+// Region allocator for everything a compile builds (AST nodes, types, symbols,
+// operands). Memory is bumped out of large zeroed chunks and is only given
+// back in one go by arena_release(), or by arena_reset() when the arena is
+// kept for another compile.
+
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_ALIGN 16
+#define ARENA_MAX_PHASES 16
+
+struct arena_chunk
+{
+    struct arena_chunk * next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct arena_phase
+{
+    const char * name;
+    size_t bytes;
+    size_t allocations;
+    size_t high_water;
+};
+
+struct arena
+{
+    struct arena_chunk * chunk;
+
+    size_t bytes;
+    size_t reserved;
+    size_t allocations;
+
+    struct arena_phase phases[ARENA_MAX_PHASES];
+    int phase_count;
+    size_t phase_bytes;
+    size_t phase_allocations;
+};
+
+struct arena * arena_create()
+{
+    struct arena * a = calloc(1, sizeof(*a));
+    if (!a)
+    {
+        printf("Memory allocation failed for arena.\n");
+        exit(1);
+    }
+
+    return a;
+}
+
+struct arena_chunk * arena_chunk_create(struct arena * a, size_t size)
+{
+    struct arena_chunk * c = calloc(1, sizeof(*c) + size);
+    if (!c)
+    {
+        printf("Memory allocation failed for arena chunk.\n");
+        exit(1);
+    }
+    c->size = size;
+    a->reserved += sizeof(*c) + size;
+
+    return c;
+}
+
+// Returned memory is always zeroed since chunks come from calloc and
+// arena_reset() zeroes whatever it hands out again.
+void * arena_alloc(struct arena * a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    struct arena_chunk * c = a->chunk;
+    if (!c || c->used + size > c->size)
+    {
+        if (size > ARENA_CHUNK_SIZE / 4)
+        {
+            // Oversized requests get a chunk of their own behind the current
+            // one so the rest of the current chunk is not wasted.
+            struct arena_chunk * big = arena_chunk_create(a, size);
+            if (c)
+            {
+                big->next = c->next;
+                c->next = big;
+            }
+            else
+            {
+                a->chunk = big;
+            }
+            c = big;
+        }
+        else
+        {
+            c = arena_chunk_create(a, ARENA_CHUNK_SIZE);
+            c->next = a->chunk;
+            a->chunk = c;
+        }
+    }
+
+    void * p = c->data + c->used;
+    c->used += size;
+
+    a->bytes += size;
+    a->allocations++;
+
+    return p;
+}
+
+char * arena_strndup(struct arena * a, const char * s, size_t len)
+{
+    char * d = arena_alloc(a, len + 1);
+    memcpy(d, s, len);
+    d[len] = '\0';
+
+    return d;
+}
+
+// Phases
+
+void arena_phase_end(struct arena * a)
+{
+    if (a->phase_count == 0) return;
+
+    struct arena_phase * p = &a->phases[a->phase_count - 1];
+    if (p->high_water) return;
+
+    p->bytes = a->bytes - a->phase_bytes;
+    p->allocations = a->allocations - a->phase_allocations;
+    p->high_water = a->reserved;
+}
+
+void arena_phase_begin(struct arena * a, const char * name)
+{
+    arena_phase_end(a);
+
+    if (a->phase_count == ARENA_MAX_PHASES) return;
+
+    struct arena_phase * p = &a->phases[a->phase_count++];
+    p->name = name;
+    p->bytes = 0;
+    p->allocations = 0;
+    p->high_water = 0;
+
+    a->phase_bytes = a->bytes;
+    a->phase_allocations = a->allocations;
+}
+
+void arena_report(struct arena * a, FILE * out)
+{
+    arena_phase_end(a);
+
+    fprintf(out, "%-12s %12s %12s %14s\n", "phase", "allocs", "bytes", "high-water");
+    for (int i = 0; i < a->phase_count; i++)
+    {
+        struct arena_phase * p = &a->phases[i];
+        fprintf(out, "%-12s %12zu %12zu %14zu\n", p->name, p->allocations, p->bytes, p->high_water);
+    }
+    fprintf(out, "%-12s %12zu %12zu %14zu\n", "total", a->allocations, a->bytes, a->reserved);
+}
+
+void arena_release(struct arena * a)
+{
+    if (!a) return;
+
+    struct arena_chunk * c = a->chunk;
+    while (c)
+    {
+        struct arena_chunk * next = c->next;
+        free(c);
+        c = next;
+    }
+    free(a);
+}
+
+// Empties the arena but keeps one standard chunk, already faulted in, for
+// the next compile.
+void arena_reset(struct arena * a)
+{
+    struct arena_chunk * kept = 0;
+    struct arena_chunk * c = a->chunk;
+    while (c)
+    {
+        struct arena_chunk * next = c->next;
+        if (!kept && c->size == ARENA_CHUNK_SIZE)
+        {
+            kept = c;
+        }
+        else
+        {
+            free(c);
+        }
+        c = next;
+    }
+
+    memset(a, 0, sizeof(*a));
+    if (kept)
+    {
+        memset(kept->data, 0, kept->used);
+        kept->used = 0;
+        kept->next = 0;
+        a->chunk = kept;
+        a->reserved = sizeof(*kept) + kept->size;
+    }
+}
@@ -0,0 +1,305 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Cache
+//
+// --cache DIR keeps the code generated for each function on disk, under the
+// hash of everything that code depends on. A function found there is not
+// resolved, checked or generated again: the instructions and labels it
+// emitted last time are replayed through the emitter, so one entry serves
+// both the assembly and the object backend. Labels inside a function are
+// numbered from 0 and local to it, which is what lets a fragment land
+// anywhere in a unit.
+//
+// An entry is the magic, then the key's length and bytes, then the
+// fragment's. The whole key is kept, not just its hash, and must match.
+
+#define CACHE_MAGIC "hendfn1"
+
+// Bytes written for a key or recorded from the emitter.
+struct cache_buffer
+{
+    char * data;
+    size_t length;
+    size_t capacity;
+};
+
+enum
+{
+    FRAGMENT_INSN = 'I',
+    FRAGMENT_LABEL = 'L'
+};
+
+void cache_put(struct cache_buffer * b, const void * data, size_t length)
+{
+    if (b->length + length > b->capacity)
+    {
+        size_t capacity = b->capacity ? b->capacity : 256;
+        while (b->length + length > capacity)
+        {
+            capacity *= 2;
+        }
+        char * grown = realloc(b->data, capacity);
+        if (!grown)
+        {
+            printf("Memory allocation failed for cache.\n");
+            exit(1);
+        }
+        b->data = grown;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->length, data, length);
+    b->length += length;
+}
+
+void cache_put_byte(struct cache_buffer * b, int value)
+{
+    unsigned char byte = value;
+    cache_put(b, &byte, 1);
+}
+
+void cache_put_int(struct cache_buffer * b, long value)
+{
+    int64_t v = value;
+    cache_put(b, &v, sizeof(v));
+}
+
+// Null and empty strings are told apart.
+void cache_put_string(struct cache_buffer * b, const char * s)
+{
+    uint32_t length = s ? strlen(s) : UINT32_MAX;
+    cache_put(b, &length, sizeof(length));
+    if (s) cache_put(b, s, length);
+}
+
+void cache_buffer_release(struct cache_buffer * b)
+{
+    free(b->data);
+    memset(b, 0, sizeof(*b));
+}
+
+// FNV-1a, 64 bits; only names the file.
+uint64_t cache_hash(const char * data, size_t length)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < length; i++)
+    {
+        h ^= (unsigned char)data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Recording
+
+void fragment_operand(struct cache_buffer * b, struct operand o)
+{
+    cache_put_byte(b, o.kind);
+    if (o.kind == OPERAND_NONE) return;
+
+    cache_put_byte(b, o.size);
+    cache_put_byte(b, o.reg);
+    cache_put_byte(b, o.index);
+    cache_put_byte(b, o.scale);
+    cache_put_int(b, o.value);
+    cache_put_string(b, o.prefix);
+    cache_put_string(b, o.name);
+}
+
+void fragment_insn(struct cache_buffer * b, opcode_t op, struct operand a, struct operand c)
+{
+    cache_put_byte(b, FRAGMENT_INSN);
+    cache_put_byte(b, op);
+    fragment_operand(b, a);
+    fragment_operand(b, c);
+}
+
+void fragment_label(struct cache_buffer * b, const char * prefix, const char * name, long number)
+{
+    cache_put_byte(b, FRAGMENT_LABEL);
+    cache_put_string(b, prefix);
+    cache_put_string(b, name);
+    cache_put_int(b, number);
+}
+
+// Replay
+
+struct fragment_reader
+{
+    const char * p;
+    const char * end;
+    int failed;
+};
+
+static inline int fragment_get_byte(struct fragment_reader * r)
+{
+    if (r->p >= r->end)
+    {
+        r->failed = 1;
+        return 0;
+    }
+    return (unsigned char)*r->p++;
+}
+
+long fragment_get_int(struct fragment_reader * r)
+{
+    int64_t v = 0;
+    if (r->end - r->p < (long)sizeof(v))
+    {
+        r->failed = 1;
+        return 0;
+    }
+    memcpy(&v, r->p, sizeof(v));
+    r->p += sizeof(v);
+    return v;
+}
+
+// Names come back interned, the way the emitter was given them.
+const char * fragment_get_string(struct fragment_reader * r)
+{
+    uint32_t length;
+    if (r->end - r->p < (long)sizeof(length))
+    {
+        r->failed = 1;
+        return 0;
+    }
+    memcpy(&length, r->p, sizeof(length));
+    r->p += sizeof(length);
+    if (length == UINT32_MAX) return 0;
+    if ((size_t)(r->end - r->p) < length)
+    {
+        r->failed = 1;
+        return 0;
+    }
+    const char * s = intern(r->p, length);
+    r->p += length;
+    return s;
+}
+
+struct operand fragment_get_operand(struct fragment_reader * r)
+{
+    struct operand o = { 0 };
+    o.kind = fragment_get_byte(r);
+    if (o.kind == OPERAND_NONE) return o;
+
+    o.size = fragment_get_byte(r);
+    o.reg = (signed char)fragment_get_byte(r);
+    o.index = (signed char)fragment_get_byte(r);
+    o.scale = fragment_get_byte(r);
+    o.value = fragment_get_int(r);
+    o.prefix = fragment_get_string(r);
+    o.name = fragment_get_string(r);
+    return o;
+}
+
+// Emits a recorded fragment, or with emit 0 only reads it through. Returns
+// -1 if it is cut short or malformed, which only a damaged entry can be.
+int fragment_replay(const char * data, size_t length, int emit)
+{
+    struct fragment_reader r = { data, data + length, 0 };
+    while (r.p < r.end && !r.failed)
+    {
+        int kind = fragment_get_byte(&r);
+        if (kind == FRAGMENT_INSN)
+        {
+            opcode_t op = fragment_get_byte(&r);
+            struct operand a = fragment_get_operand(&r);
+            struct operand b = fragment_get_operand(&r);
+            if (r.failed || op >= sizeof(opcode_names) / sizeof(*opcode_names)) return -1;
+            if (emit) emit_insn(op, a, b);
+        }
+        else if (kind == FRAGMENT_LABEL)
+        {
+            const char * prefix = fragment_get_string(&r);
+            const char * name = fragment_get_string(&r);
+            long number = fragment_get_int(&r);
+            if (r.failed) return -1;
+            if (emit) emit_label(prefix, name, number);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return r.failed ? -1 : 0;
+}
+
+// Entries
+
+void cache_path(char * path, size_t size, const char * dir, const char * key, size_t length)
+{
+    snprintf(path, size, "%s/%016llx", dir, (unsigned long long)cache_hash(key, length));
+}
+
+// Returns the fragment stored for the key, copied into the arena, or null.
+// A damaged entry is a miss, and is written over once the function has
+// been generated again.
+char * cache_load(const char * dir, const char * key, size_t key_length, size_t * length)
+{
+    char path[4096];
+    cache_path(path, sizeof(path), dir, key, key_length);
+
+    FILE * in = fopen(path, "rb");
+    if (!in) return 0;
+
+    char magic[sizeof(CACHE_MAGIC)];
+    uint64_t stored;
+    char * fragment = 0;
+    if (fread(magic, 1, sizeof(magic), in) == sizeof(magic) && !memcmp(magic, CACHE_MAGIC, sizeof(magic))
+        && fread(&stored, sizeof(stored), 1, in) == 1 && stored == key_length)
+    {
+        char * k = malloc(key_length ? key_length : 1);
+        uint64_t n;
+        if (k && fread(k, 1, key_length, in) == key_length && !memcmp(k, key, key_length)
+            && fread(&n, sizeof(n), 1, in) == 1 && n < (1ull << 32))
+        {
+            fragment = arena_alloc(ctx->arena, n ? n : 1);
+            if (fread(fragment, 1, n, in) == n && !fragment_replay(fragment, n, 0))
+            {
+                *length = n;
+            }
+            else
+            {
+                fragment = 0;
+            }
+        }
+        free(k);
+    }
+
+    fclose(in);
+    return fragment;
+}
+
+// Writes the entry under a name of its own and renames it into place, so a
+// compile running alongside sees the whole entry or none of it.
+void cache_store(const char * dir, const char * key, size_t key_length, const char * fragment, size_t length)
+{
+    char path[4096];
+    char temporary[4200];
+    cache_path(path, sizeof(path), dir, key, key_length);
+    snprintf(temporary, sizeof(temporary), "%s.%ld.%p", path, (long)getpid(), (void *)ctx);
+
+    if (mkdir(dir, 0755) && errno != EEXIST) return;
+
+    FILE * out = fopen(temporary, "wb");
+    if (!out) return;
+
+    uint64_t k = key_length;
+    uint64_t n = length;
+    int failed = fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), out) != sizeof(CACHE_MAGIC)
+        || fwrite(&k, sizeof(k), 1, out) != 1
+        || fwrite(key, 1, key_length, out) != key_length
+        || fwrite(&n, sizeof(n), 1, out) != 1
+        || fwrite(fragment, 1, length, out) != length;
+    failed |= fclose(out) != 0;
+
+    if (failed || rename(temporary, path))
+    {
+        unlink(temporary);
+    }
+}
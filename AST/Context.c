@@ -0,0 +1,62 @@
+#include <stdio.h>
+
+// Context
+//
+// Everything a compile reads or writes hangs off one hend_context, so two
+// compiles share nothing and can run on different threads. The context the
+// current thread is compiling is reached through ctx, which hend_compile()
+// points at its own context on the way in and restores on the way out.
+// Compiles in a session borrow its arena, intern table, type table and scope
+// storage instead of building their own, so those stay warm between them.
+
+struct hend_context
+{
+    // Every node, type, symbol and operand of the compile lives here.
+    struct arena * arena;
+
+    struct intern_table * interned;
+    struct type_table * types;
+    struct scopeStack * scope;
+    struct emitter * emitter;
+    struct report * report;
+    struct source * source;
+
+    struct decl * code;
+    int error;
+
+    int registers[7];
+    int label_counter;
+
+    // Last top-level statement of the function being generated. A return there
+    // falls straight into the epilogue; any other return jumps to it.
+    struct stmt * function_tail;
+
+    // Error messages, handed back to the caller as text.
+    FILE * diagnostics;
+
+    // Set when the tables above are borrowed from a session.
+    struct hend_session * session;
+
+    // Directory of the function cache; null without --cache.
+    const char * cache;
+
+    // The module this context compiles when a program has several files.
+    struct module * module;
+
+    // Threads for codegen; 0 for one per processor.
+    int jobs;
+};
+
+// Past this much interned and type storage a session starts over, so a long
+// running server does not grow without bound.
+#define SESSION_CACHE_LIMIT (64 << 20)
+
+struct hend_session
+{
+    struct arena * arena;
+    struct intern_table * interned;
+    struct type_table * types;
+    struct scopeStack * scope;
+};
+
+_Thread_local struct hend_context * ctx;
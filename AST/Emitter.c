@@ -0,0 +1,637 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Emitter
+//
+// Codegen describes each instruction as an opcode plus operands and the
+// emitter renders it straight into one growing in-memory buffer, formatting
+// registers and integers by hand. Fixed text such as section directives and
+// the runtime stubs is copied in verbatim. The whole buffer is written out
+// with a single write() once codegen is done. When the emitter has an
+// object, instructions, labels and data go to the encoder instead and only
+// assembler directives are dropped.
+
+#define EMITTER_INITIAL_CAPACITY (1 << 16)
+
+typedef enum
+{
+    REG_RAX,
+    REG_RCX,
+    REG_RDX,
+    REG_RBX,
+    REG_RSP,
+    REG_RBP,
+    REG_RSI,
+    REG_RDI,
+    REG_R8,
+    REG_R9,
+    REG_R10,
+    REG_R11,
+    REG_R12,
+    REG_R13,
+    REG_R14,
+    REG_R15,
+    REG_NONE = -1
+} reg_t;
+
+typedef enum
+{
+    OP_MOV,
+    OP_ADD,
+    OP_SUB,
+    OP_IMUL,
+    OP_IDIV,
+    OP_CMP,
+    OP_XOR,
+    OP_PUSH,
+    OP_POP,
+    OP_CALL,
+    OP_RET,
+    OP_JMP,
+    OP_JE,
+    OP_JNE,
+    OP_JG,
+    OP_JNG,
+    OP_JL,
+    OP_JNL,
+    OP_INT,
+    OP_MOVQ,
+    OP_MOVSX,
+    OP_MOVSXD,
+    OP_MOVZX,
+    OP_SETE,
+    OP_SETNE,
+    OP_SETG,
+    OP_SETNG,
+    OP_SETL,
+    OP_SETNL,
+    OP_CQO,
+    OP_SHL,
+    OP_SAR,
+    OP_SHR,
+    OP_NEG,
+    OP_LEA
+} opcode_t;
+
+typedef enum
+{
+    OPERAND_NONE,
+    OPERAND_REG,
+    OPERAND_IMM,
+    OPERAND_MEM,
+    OPERAND_LABEL
+} operand_t;
+
+struct operand
+{
+    operand_t kind;
+    int size;
+
+    reg_t reg;
+    long value;
+
+    const char * prefix;
+    const char * name;
+
+    // Scaled index register of a memory operand; no index when scale is 0.
+    reg_t index;
+    int scale;
+};
+
+struct emitter
+{
+    char * buffer;
+    size_t length;
+    size_t capacity;
+
+    // Set for -c; the assembly text is left empty.
+    struct object * object;
+
+    // While set, every instruction and label is also recorded here, for the
+    // function cache or for the thread that encodes the object.
+    struct cache_buffer * recording;
+
+    // Record only; nothing is written or encoded.
+    int record_only;
+
+    // While allocating is set, a function's body is held back here until
+    // its registers are allocated.
+    struct allocator * allocator;
+    int allocating;
+};
+
+static const char * const opcode_names[] =
+{
+    [OP_MOV] = "mov",
+    [OP_ADD] = "add",
+    [OP_SUB] = "sub",
+    [OP_IMUL] = "imul",
+    [OP_IDIV] = "idiv",
+    [OP_CMP] = "cmp",
+    [OP_XOR] = "xor",
+    [OP_PUSH] = "push",
+    [OP_POP] = "pop",
+    [OP_CALL] = "call",
+    [OP_RET] = "ret",
+    [OP_JMP] = "jmp",
+    [OP_JE] = "je",
+    [OP_JNE] = "jne",
+    [OP_JG] = "jg",
+    [OP_JNG] = "jng",
+    [OP_JL] = "jl",
+    [OP_JNL] = "jnl",
+    [OP_INT] = "int",
+    [OP_MOVQ] = "MOVQ",
+    [OP_MOVSX] = "movsx",
+    [OP_MOVSXD] = "movsxd",
+    [OP_MOVZX] = "movzx",
+    [OP_SETE] = "sete",
+    [OP_SETNE] = "setne",
+    [OP_SETG] = "setg",
+    [OP_SETNG] = "setng",
+    [OP_SETL] = "setl",
+    [OP_SETNL] = "setnl",
+    [OP_CQO] = "cqo",
+    [OP_SHL] = "shl",
+    [OP_SAR] = "sar",
+    [OP_SHR] = "shr",
+    [OP_NEG] = "neg",
+    [OP_LEA] = "lea",
+};
+
+static const char * const register_names[16][4] =
+{
+    [REG_RAX] = { "al", "ax", "eax", "rax" },
+    [REG_RCX] = { "cl", "cx", "ecx", "rcx" },
+    [REG_RDX] = { "dl", "dx", "edx", "rdx" },
+    [REG_RBX] = { "bl", "bx", "ebx", "rbx" },
+    [REG_RSP] = { "spl", "sp", "esp", "rsp" },
+    [REG_RBP] = { "bpl", "bp", "ebp", "rbp" },
+    [REG_RSI] = { "sil", "si", "esi", "rsi" },
+    [REG_RDI] = { "dil", "di", "edi", "rdi" },
+    [REG_R8] = { "r8b", "r8w", "r8d", "r8" },
+    [REG_R9] = { "r9b", "r9w", "r9d", "r9" },
+    [REG_R10] = { "r10b", "r10w", "r10d", "r10" },
+    [REG_R11] = { "r11b", "r11w", "r11d", "r11" },
+    [REG_R12] = { "r12b", "r12w", "r12d", "r12" },
+    [REG_R13] = { "r13b", "r13w", "r13d", "r13" },
+    [REG_R14] = { "r14b", "r14w", "r14d", "r14" },
+    [REG_R15] = { "r15b", "r15w", "r15d", "r15" },
+};
+
+struct emitter * emitter_create()
+{
+    struct emitter * e = calloc(1, sizeof(*e));
+    e->capacity = EMITTER_INITIAL_CAPACITY;
+    e->buffer = malloc(e->capacity);
+    if (!e->buffer)
+    {
+        printf("Memory allocation failed for emitter.\n");
+        exit(1);
+    }
+
+    return e;
+}
+
+void allocator_release(struct allocator * a);
+
+void emitter_release(struct emitter * e)
+{
+    if (!e) return;
+
+    allocator_release(e->allocator);
+    object_release(e->object);
+    free(e->buffer);
+    free(e);
+}
+
+int output_write(const char * path, const char * data, size_t length)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    size_t written = 0;
+    while (written < length)
+    {
+        ssize_t n = write(fd, data + written, length - written);
+        if (n <= 0)
+        {
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+
+    return close(fd);
+}
+
+static inline char * emit_reserve(size_t n)
+{
+    if (ctx->emitter->length + n > ctx->emitter->capacity)
+    {
+        while (ctx->emitter->length + n > ctx->emitter->capacity)
+        {
+            ctx->emitter->capacity *= 2;
+        }
+        ctx->emitter->buffer = realloc(ctx->emitter->buffer, ctx->emitter->capacity);
+        if (!ctx->emitter->buffer)
+        {
+            printf("Memory allocation failed for emitter.\n");
+            exit(1);
+        }
+    }
+    return ctx->emitter->buffer + ctx->emitter->length;
+}
+
+static inline void emit_bytes(const char * s, size_t n)
+{
+    memcpy(emit_reserve(n), s, n);
+    ctx->emitter->length += n;
+}
+
+// Copies a string literal without measuring it at run time.
+#define emit_literal(s) emit_bytes(s, sizeof(s) - 1)
+
+static inline void emit_char(char c)
+{
+    *emit_reserve(1) = c;
+    ctx->emitter->length++;
+}
+
+static inline void emit_string(const char * s)
+{
+    emit_bytes(s, strlen(s));
+}
+
+void emit_int(long v)
+{
+    char digits[24];
+    int n = 0;
+
+    unsigned long u = v < 0 ? -(unsigned long)v : (unsigned long)v;
+    do
+    {
+        digits[n++] = '0' + u % 10;
+        u /= 10;
+    } while (u);
+
+    char * p = emit_reserve(n + 1);
+    char * start = p;
+    if (v < 0)
+    {
+        *p++ = '-';
+    }
+    while (n)
+    {
+        *p++ = digits[--n];
+    }
+    ctx->emitter->length += p - start;
+}
+
+// Operands
+
+struct operand op_reg(reg_t reg, int size)
+{
+    struct operand o = { OPERAND_REG, size, reg };
+    return o;
+}
+
+struct operand op_imm(long value)
+{
+    struct operand o = { OPERAND_IMM, 0, REG_NONE, value };
+    return o;
+}
+
+struct operand op_sized_imm(long value, int size)
+{
+    struct operand o = { OPERAND_IMM, size, REG_NONE, value };
+    return o;
+}
+
+struct operand op_mem(reg_t base, long displacement, int size)
+{
+    struct operand o = { OPERAND_MEM, size, base, displacement };
+    return o;
+}
+
+struct operand op_label(const char * prefix, long number)
+{
+    struct operand o = { OPERAND_LABEL, 0, REG_NONE, number, prefix, 0 };
+    return o;
+}
+
+struct operand op_symbol(const char * prefix, const char * name)
+{
+    struct operand o = { OPERAND_LABEL, 0, REG_NONE, -1, prefix, name };
+    return o;
+}
+
+// Memory at a named data label rather than off a base register.
+struct operand op_global(const char * prefix, const char * name, long displacement, int size)
+{
+    struct operand o = { OPERAND_MEM, size, REG_NONE, displacement, prefix, name };
+    return o;
+}
+
+struct operand op_indexed(struct operand o, reg_t index, int scale)
+{
+    o.index = index;
+    o.scale = scale;
+    return o;
+}
+
+const char * size_name(int size)
+{
+    switch (size)
+    {
+    case 1:
+        return "byte";
+    case 2:
+        return "word";
+    case 4:
+        return "dword";
+    case 8:
+        return "qword";
+    default:
+        return 0;
+    }
+}
+
+int size_index(int size)
+{
+    switch (size)
+    {
+    case 1:
+        return 0;
+    case 2:
+        return 1;
+    case 4:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+void emit_register(reg_t reg, int size)
+{
+    if (reg == REG_NONE)
+    {
+        emit_literal("(null)");
+        return;
+    }
+    emit_string(register_names[reg][size_index(size)]);
+}
+
+// Labels with only a number are local to the named label before them, the
+// way NASM's dot labels are, so each function can number its own from 0.
+void emit_label_name(const char * prefix, const char * name, long number)
+{
+    if (!name && number >= 0) emit_char('.');
+    if (prefix) emit_string(prefix);
+    if (name) emit_string(name);
+    if (number >= 0) emit_int(number);
+}
+
+void emit_operand(struct operand o)
+{
+    switch (o.kind)
+    {
+    case OPERAND_REG:
+        emit_register(o.reg, o.size);
+        break;
+    case OPERAND_IMM:
+        if (size_name(o.size))
+        {
+            emit_string(size_name(o.size));
+            emit_char('\t');
+        }
+        emit_int(o.value);
+        break;
+    case OPERAND_MEM:
+        if (size_name(o.size))
+        {
+            emit_string(size_name(o.size));
+            emit_char(' ');
+        }
+        emit_char('[');
+        if (o.name)
+        {
+            emit_label_name(o.prefix, o.name, -1);
+        }
+        else
+        {
+            emit_register(o.reg, 8);
+        }
+        if (o.scale)
+        {
+            emit_literal(" + ");
+            emit_register(o.index, 8);
+            emit_char('*');
+            emit_int(o.scale);
+        }
+        if (o.value > 0)
+        {
+            emit_literal(" + ");
+            emit_int(o.value);
+        }
+        else if (o.value < 0)
+        {
+            emit_literal(" - ");
+            emit_int(-o.value);
+        }
+        emit_char(']');
+        break;
+    case OPERAND_LABEL:
+        emit_label_name(o.prefix, o.name, o.value);
+        break;
+    default:
+        break;
+    }
+}
+
+// Instructions
+
+void encode_insn(opcode_t op, struct operand a, struct operand b);
+void fragment_insn(struct cache_buffer * b, opcode_t op, struct operand a, struct operand c);
+void fragment_label(struct cache_buffer * b, const char * prefix, const char * name, long number);
+void allocator_insn(opcode_t op, struct operand a, struct operand b);
+void allocator_label(const char * prefix, const char * name, long number);
+
+void emit_insn(opcode_t op, struct operand a, struct operand b)
+{
+    if (ctx->emitter->allocating)
+    {
+        allocator_insn(op, a, b);
+        return;
+    }
+    if (ctx->emitter->recording)
+    {
+        fragment_insn(ctx->emitter->recording, op, a, b);
+        if (ctx->emitter->record_only) return;
+    }
+    if (ctx->emitter->object)
+    {
+        encode_insn(op, a, b);
+        return;
+    }
+
+    emit_char('\t');
+    emit_string(opcode_names[op]);
+    if (a.kind != OPERAND_NONE)
+    {
+        emit_char('\t');
+        emit_operand(a);
+    }
+    if (b.kind != OPERAND_NONE)
+    {
+        emit_literal(",\t");
+        emit_operand(b);
+    }
+    emit_char('\n');
+}
+
+static const struct operand no_operand;
+
+void emit_op0(opcode_t op)
+{
+    emit_insn(op, no_operand, no_operand);
+}
+
+void emit_op1(opcode_t op, struct operand a)
+{
+    emit_insn(op, a, no_operand);
+}
+
+void emit_op2(opcode_t op, struct operand a, struct operand b)
+{
+    emit_insn(op, a, b);
+}
+
+void emit_label(const char * prefix, const char * name, long number)
+{
+    if (ctx->emitter->allocating)
+    {
+        allocator_label(prefix, name, number);
+        return;
+    }
+    if (ctx->emitter->recording)
+    {
+        fragment_label(ctx->emitter->recording, prefix, name, number);
+        if (ctx->emitter->record_only) return;
+    }
+
+    struct object * o = ctx->emitter->object;
+    if (o)
+    {
+        if (name || number < 0)
+        {
+            object_scope(o);
+        }
+        object_define(o, object_label(o, prefix, name, number));
+        return;
+    }
+
+    emit_label_name(prefix, name, number);
+    emit_literal(":\n");
+}
+
+// Directives
+
+void emit_section(int section)
+{
+    if (ctx->emitter->object)
+    {
+        ctx->emitter->object->section = section;
+        return;
+    }
+
+    if (section == OBJECT_TEXT)
+    {
+        emit_literal("\tsection\t.text\n");
+    }
+    else
+    {
+        emit_literal("\n\tsection\t.data\n\n");
+    }
+}
+
+// Text only the assembler needs, such as default rel and extern.
+void emit_directive(const char * text)
+{
+    if (ctx->emitter->object) return;
+
+    emit_string(text);
+}
+
+void emit_global(const char * prefix, const char * name)
+{
+    struct object * o = ctx->emitter->object;
+    if (o)
+    {
+        int label = object_label(o, prefix, name, -1);
+        o->labels[label].global = 1;
+        return;
+    }
+
+    emit_literal("\tglobal\t");
+    if (prefix) emit_string(prefix);
+    emit_string(name);
+    emit_char('\n');
+}
+
+// A name defined in another unit. An object needs no word of it: a name
+// used but never defined there is an undefined symbol already.
+void emit_extern(const char * prefix, const char * name)
+{
+    if (ctx->emitter->object) return;
+
+    emit_literal("\textern\t");
+    if (prefix) emit_string(prefix);
+    emit_string(name);
+    emit_char('\n');
+}
+
+// Labelled bytes in the current section.
+void emit_data(const char * prefix, const char * name, const char * data, size_t length)
+{
+    struct object * o = ctx->emitter->object;
+    if (o)
+    {
+        object_define(o, object_label(o, prefix, name, -1));
+        object_bytes(o, data, length);
+        return;
+    }
+
+    emit_label_name(prefix, name, -1);
+    emit_literal(":\tdb\t");
+    for (size_t i = 0; i < length; i++)
+    {
+        if (i)
+        {
+            emit_literal(", ");
+        }
+        emit_int((unsigned char)data[i]);
+    }
+    emit_char('\n');
+}
+
+// A labelled run of size zero bytes in the current section.
+void emit_zeros(const char * prefix, const char * name, long size)
+{
+    struct object * o = ctx->emitter->object;
+    if (o)
+    {
+        object_define(o, object_label(o, prefix, name, -1));
+        memset(object_reserve(o, size), 0, size);
+        return;
+    }
+
+    emit_label_name(prefix, name, -1);
+    emit_literal(":\ttimes ");
+    emit_int(size);
+    emit_literal(" db 0\n");
+}
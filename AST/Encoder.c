@@ -0,0 +1,416 @@
+#include <stdint.h>
+#include <stdio.h>
+
+// Encoder
+//
+// Turns the emitter's instructions into x86-64 machine code in the object's
+// current section. Only the forms codegen produces are covered; anything
+// else is reported as an error rather than guessed at. Registers number the
+// way the hardware does, so a reg_t is its own encoding.
+
+// Condition codes, added to 0x70 (short Jcc), 0x0f 0x80 (near Jcc) or
+// 0x0f 0x90 (SETcc).
+static const unsigned char condition_codes[] =
+{
+    [OP_JE] = 0x4,
+    [OP_JNE] = 0x5,
+    [OP_JL] = 0xc,
+    [OP_JNL] = 0xd,
+    [OP_JNG] = 0xe,
+    [OP_JG] = 0xf,
+    [OP_SETE] = 0x4,
+    [OP_SETNE] = 0x5,
+    [OP_SETL] = 0xc,
+    [OP_SETNL] = 0xd,
+    [OP_SETNG] = 0xe,
+    [OP_SETG] = 0xf,
+};
+
+// The four classic two-operand ALU instructions: the r/m, reg opcode for
+// byte operands (the other forms follow from it) and the /digit used with
+// an immediate.
+struct alu_encoding
+{
+    unsigned char opcode;
+    unsigned char digit;
+};
+
+static const struct alu_encoding alu_encodings[] =
+{
+    [OP_ADD] = { 0x00, 0 },
+    [OP_SUB] = { 0x28, 5 },
+    [OP_XOR] = { 0x30, 6 },
+    [OP_CMP] = { 0x38, 7 },
+};
+
+static inline int fits_int8(long v)
+{
+    return v >= INT8_MIN && v <= INT8_MAX;
+}
+
+static inline int fits_int32(long v)
+{
+    return v >= INT32_MIN && v <= INT32_MAX;
+}
+
+void encode_error(opcode_t op)
+{
+    fprintf(ctx->diagnostics, "error: cannot encode %s with these operands.\n", opcode_names[op]);
+    ctx->error = 1;
+}
+
+// Prefixes, opcode and ModRM (plus SIB and displacement) for an instruction
+// with a register or /digit in reg and a register or memory operand in rm.
+// opcode may be two bytes (0x0fxx). trailing is the number of immediate
+// bytes that follow, which a RIP-relative displacement has to skip.
+void encode_rm(int size, int opcode, int reg, struct operand rm, int trailing)
+{
+    struct object * o = ctx->emitter->object;
+
+    int rex = 0;
+    if (size == 8) rex |= 0x48;
+    if (reg & 8) rex |= 0x44;
+    if (rm.kind == OPERAND_REG || (rm.kind == OPERAND_MEM && !rm.name))
+    {
+        if (rm.reg & 8) rex |= 0x41;
+    }
+    if (rm.kind == OPERAND_MEM && rm.scale && (rm.index & 8)) rex |= 0x42;
+    // spl, bpl, sil and dil only exist with a REX prefix.
+    if (size == 1 && ((reg >= 4 && reg < 8) || (rm.kind == OPERAND_REG && rm.reg >= 4 && rm.reg < 8))) rex |= 0x40;
+
+    if (size == 2) object_byte(o, 0x66);
+    if (rex) object_byte(o, rex);
+    if (opcode > 0xff) object_byte(o, opcode >> 8);
+    object_byte(o, opcode & 0xff);
+
+    int r = (reg & 7) << 3;
+
+    if (rm.kind == OPERAND_REG)
+    {
+        object_byte(o, 0xc0 | r | (rm.reg & 7));
+        return;
+    }
+
+    int scale = rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0;
+
+    if (rm.name)
+    {
+        int label = object_label(o, rm.prefix, rm.name, -1);
+        if (rm.scale)
+        {
+            // No base: an absolute address plus the scaled index.
+            object_byte(o, 0x04 | r);
+            object_byte(o, scale << 6 | (rm.index & 7) << 3 | 5);
+            object_reference(o, label, FIXUP_ABS32S, rm.value);
+        }
+        else
+        {
+            object_byte(o, 0x05 | r);
+            object_reference(o, label, FIXUP_PC32, rm.value - 4 - trailing);
+        }
+        return;
+    }
+
+    // rbp and r13 as a base always take a displacement.
+    int mod = rm.value == 0 && (rm.reg & 7) != 5 ? 0 : fits_int8(rm.value) ? 1 : 2;
+    if (rm.scale || (rm.reg & 7) == 4)
+    {
+        int index = rm.scale ? rm.index & 7 : 4;
+        object_byte(o, mod << 6 | r | 4);
+        object_byte(o, scale << 6 | index << 3 | (rm.reg & 7));
+    }
+    else
+    {
+        object_byte(o, mod << 6 | r | (rm.reg & 7));
+    }
+    if (mod == 1) object_value(o, rm.value, 1);
+    if (mod == 2) object_value(o, rm.value, 4);
+}
+
+// The short register forms: push, pop and mov reg, imm.
+void encode_short(int size, int opcode, reg_t reg)
+{
+    struct object * o = ctx->emitter->object;
+
+    int rex = 0;
+    if (size == 8) rex |= 0x48;
+    if (reg & 8) rex |= 0x41;
+    if (size == 1 && reg >= 4 && reg < 8) rex |= 0x40;
+
+    if (size == 2) object_byte(o, 0x66);
+    if (rex) object_byte(o, rex);
+    object_byte(o, opcode + (reg & 7));
+}
+
+void encode_mov(struct operand a, struct operand b)
+{
+    struct object * o = ctx->emitter->object;
+    int size = a.size ? a.size : b.size;
+
+    if (a.kind == OPERAND_REG && b.kind == OPERAND_IMM)
+    {
+        if (size == 8 && b.value >= 0 && b.value <= UINT32_MAX)
+        {
+            // Writing the low half zeroes the rest.
+            encode_short(4, 0xb8, a.reg);
+            object_value(o, b.value, 4);
+        }
+        else if (size == 8 && fits_int32(b.value))
+        {
+            encode_rm(8, 0xc7, 0, a, 4);
+            object_value(o, b.value, 4);
+        }
+        else
+        {
+            encode_short(size, size == 1 ? 0xb0 : 0xb8, a.reg);
+            object_value(o, b.value, size);
+        }
+    }
+    else if (a.kind == OPERAND_REG && b.kind == OPERAND_LABEL)
+    {
+        encode_short(8, 0xb8, a.reg);
+        object_reference(o, object_label(o, b.prefix, b.name, b.value), FIXUP_ABS64, 0);
+    }
+    else if (a.kind == OPERAND_MEM && b.kind == OPERAND_IMM)
+    {
+        int immediate = size == 8 ? 4 : size;
+        encode_rm(size, size == 1 ? 0xc6 : 0xc7, 0, a, immediate);
+        object_value(o, b.value, immediate);
+    }
+    else if (b.kind == OPERAND_REG && (a.kind == OPERAND_REG || a.kind == OPERAND_MEM))
+    {
+        size = b.size;
+        encode_rm(size, size == 1 ? 0x88 : 0x89, b.reg, a, 0);
+    }
+    else if (a.kind == OPERAND_REG && b.kind == OPERAND_MEM)
+    {
+        encode_rm(size, size == 1 ? 0x8a : 0x8b, a.reg, b, 0);
+    }
+    else
+    {
+        encode_error(OP_MOV);
+    }
+}
+
+void encode_alu(opcode_t op, struct operand a, struct operand b)
+{
+    struct object * o = ctx->emitter->object;
+    struct alu_encoding e = alu_encodings[op];
+    int size = a.size ? a.size : b.size;
+    int wide = size != 1;
+
+    if (b.kind == OPERAND_IMM && (a.kind == OPERAND_REG || a.kind == OPERAND_MEM))
+    {
+        if (wide && fits_int8(b.value))
+        {
+            encode_rm(size, 0x83, e.digit, a, 1);
+            object_value(o, b.value, 1);
+        }
+        else
+        {
+            int immediate = wide ? (size == 2 ? 2 : 4) : 1;
+            encode_rm(size, wide ? 0x81 : 0x80, e.digit, a, immediate);
+            object_value(o, b.value, immediate);
+        }
+    }
+    else if (b.kind == OPERAND_REG && (a.kind == OPERAND_REG || a.kind == OPERAND_MEM))
+    {
+        encode_rm(size, e.opcode + wide, b.reg, a, 0);
+    }
+    else if (a.kind == OPERAND_REG && b.kind == OPERAND_MEM)
+    {
+        encode_rm(size, e.opcode + 2 + wide, a.reg, b, 0);
+    }
+    else
+    {
+        encode_error(op);
+    }
+}
+
+void encode_branch(opcode_t op, struct operand a)
+{
+    struct object * o = ctx->emitter->object;
+
+    if (a.kind == OPERAND_REG && (op == OP_CALL || op == OP_JMP))
+    {
+        encode_rm(4, 0xff, op == OP_CALL ? 2 : 4, a, 0);
+        return;
+    }
+    if (a.kind != OPERAND_LABEL)
+    {
+        encode_error(op);
+        return;
+    }
+
+    switch (op)
+    {
+    case OP_CALL:
+        object_byte(o, 0xe8);
+        break;
+    case OP_JMP:
+        object_byte(o, 0xe9);
+        break;
+    default:
+        object_byte(o, 0x0f);
+        object_byte(o, 0x80 + condition_codes[op]);
+        break;
+    }
+    object_reference(o, object_label(o, a.prefix, a.name, a.value), FIXUP_REL32, -4);
+}
+
+void encode_insn(opcode_t op, struct operand a, struct operand b)
+{
+    struct object * o = ctx->emitter->object;
+
+    switch (op)
+    {
+    case OP_MOV:
+    case OP_MOVQ:
+        encode_mov(a, b);
+        break;
+    case OP_MOVSX:
+    case OP_MOVZX:
+        if (a.kind != OPERAND_REG || b.size == 4 || b.size == 8)
+        {
+            encode_error(op);
+            break;
+        }
+        encode_rm(8, (op == OP_MOVSX ? 0x0fbe : 0x0fb6) + (b.size == 2), a.reg, b, 0);
+        break;
+    case OP_MOVSXD:
+        if (a.kind != OPERAND_REG)
+        {
+            encode_error(op);
+            break;
+        }
+        encode_rm(8, 0x63, a.reg, b, 0);
+        break;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_XOR:
+    case OP_CMP:
+        encode_alu(op, a, b);
+        break;
+    case OP_SETE:
+    case OP_SETNE:
+    case OP_SETG:
+    case OP_SETNG:
+    case OP_SETL:
+    case OP_SETNL:
+        if ((a.kind != OPERAND_REG && a.kind != OPERAND_MEM) || b.kind != OPERAND_NONE)
+        {
+            encode_error(op);
+            break;
+        }
+        encode_rm(1, 0x0f90 + condition_codes[op], 0, a, 0);
+        break;
+    case OP_IMUL:
+        // One operand: rdx:rax = rax * a. Two: a = a * b, where b may be an
+        // immediate.
+        if (b.kind == OPERAND_NONE && a.kind != OPERAND_IMM)
+        {
+            encode_rm(a.size ? a.size : 8, a.size == 1 ? 0xf6 : 0xf7, 5, a, 0);
+        }
+        else if (a.kind == OPERAND_REG && b.kind == OPERAND_IMM && a.size != 1)
+        {
+            encode_rm(a.size, fits_int8(b.value) ? 0x6b : 0x69, a.reg, a, fits_int8(b.value) ? 1 : a.size == 2 ? 2 : 4);
+            object_value(o, b.value, fits_int8(b.value) ? 1 : a.size == 2 ? 2 : 4);
+        }
+        else if (a.kind == OPERAND_REG && (b.kind == OPERAND_REG || b.kind == OPERAND_MEM) && a.size != 1)
+        {
+            encode_rm(a.size, 0x0faf, a.reg, b, 0);
+        }
+        else
+        {
+            encode_error(op);
+        }
+        break;
+    case OP_IDIV:
+    case OP_NEG:
+        if (b.kind != OPERAND_NONE || a.kind == OPERAND_IMM)
+        {
+            encode_error(op);
+            break;
+        }
+        encode_rm(a.size ? a.size : 8, a.size == 1 ? 0xf6 : 0xf7, op == OP_IDIV ? 7 : 3, a, 0);
+        break;
+    case OP_CQO:
+        object_byte(o, 0x48);
+        object_byte(o, 0x99);
+        break;
+    case OP_SHL:
+    case OP_SAR:
+    case OP_SHR:
+        // By a constant count only.
+        if ((a.kind != OPERAND_REG && a.kind != OPERAND_MEM) || b.kind != OPERAND_IMM)
+        {
+            encode_error(op);
+            break;
+        }
+        encode_rm(a.size ? a.size : 8, a.size == 1 ? 0xc0 : 0xc1, op == OP_SHL ? 4 : op == OP_SAR ? 7 : 5, a, 1);
+        object_value(o, b.value, 1);
+        break;
+    case OP_LEA:
+        if (a.kind != OPERAND_REG || b.kind != OPERAND_MEM)
+        {
+            encode_error(op);
+            break;
+        }
+        encode_rm(8, 0x8d, a.reg, b, 0);
+        break;
+    case OP_PUSH:
+        if (a.kind == OPERAND_REG)
+        {
+            encode_short(4, 0x50, a.reg);
+        }
+        else if (a.kind == OPERAND_IMM && a.size == 2)
+        {
+            object_byte(o, 0x66);
+            object_byte(o, 0x6a);
+            object_value(o, a.value, 1);
+        }
+        else if (a.kind == OPERAND_MEM)
+        {
+            encode_rm(4, 0xff, 6, a, 0);
+        }
+        else if (a.kind == OPERAND_IMM)
+        {
+            // Pushes eight bytes whatever the size says.
+            object_byte(o, fits_int8(a.value) ? 0x6a : 0x68);
+            object_value(o, a.value, fits_int8(a.value) ? 1 : 4);
+        }
+        else
+        {
+            encode_error(op);
+        }
+        break;
+    case OP_POP:
+        if (a.kind != OPERAND_REG)
+        {
+            encode_error(op);
+            break;
+        }
+        encode_short(4, 0x58, a.reg);
+        break;
+    case OP_CALL:
+    case OP_JMP:
+    case OP_JE:
+    case OP_JNE:
+    case OP_JG:
+    case OP_JNG:
+    case OP_JL:
+    case OP_JNL:
+        encode_branch(op, a);
+        break;
+    case OP_RET:
+        object_byte(o, 0xc3);
+        break;
+    case OP_INT:
+        object_byte(o, 0xcd);
+        object_value(o, a.value, 1);
+        break;
+    default:
+        encode_error(op);
+        break;
+    }
+}
@@ -0,0 +1,215 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Interface
+//
+// A module's interface on disk, name.hmi: its pub declarations, resolved,
+// so a module that includes it can be compiled without its source. The file
+// is read mapped, as it lies; nothing in it is parsed. It is a header, then
+// one fixed-size record per declaration, then the dimensions of array types,
+// then the names, each followed by a NUL. Records point into the dimensions
+// and the names by index and offset. Numbers are in the compiling machine's
+// byte order, which is the only one the compiler targets.
+
+#define INTERFACE_MAGIC "hendmi1"
+
+struct interface_header
+{
+    char magic[8];
+
+    uint32_t name;
+    uint32_t name_length;
+
+    uint32_t symbol_count;
+    uint32_t dimension_count;
+    uint32_t strings_length;
+    uint32_t reserved;
+};
+
+struct interface_symbol
+{
+    uint32_t name;
+    uint32_t name_length;
+
+    // TYPE_NAME types only.
+    uint32_t type_name;
+    uint32_t type_name_length;
+
+    // The array's dimensions, outermost first.
+    uint32_t dimensions;
+    uint32_t dimension_count;
+
+    int32_t size;
+
+    // decl_t; 0 for no type, else 1 + type_t; primitives_t; type_spec_t.
+    uint8_t kind;
+    uint8_t type;
+    uint8_t primitive;
+    uint8_t spec;
+};
+
+// A mapped interface file.
+struct interface_image
+{
+    void * data;
+    size_t size;
+
+    const struct interface_header * header;
+    const struct interface_symbol * symbols;
+    const int32_t * dimensions;
+    const char * strings;
+};
+
+// A string of the image must lie inside the names and end in a NUL.
+static inline int interface_string_valid(const struct interface_image * image, uint32_t offset, uint32_t length)
+{
+    return offset < image->header->strings_length
+        && length < image->header->strings_length - offset
+        && image->strings[offset + length] == '\0';
+}
+
+int interface_valid(const struct interface_image * image)
+{
+    const struct interface_header * h = image->header;
+    if (image->size < sizeof(*h) || memcmp(h->magic, INTERFACE_MAGIC, sizeof(h->magic))) return 0;
+
+    uint64_t size = sizeof(*h)
+        + (uint64_t)h->symbol_count * sizeof(struct interface_symbol)
+        + (uint64_t)h->dimension_count * sizeof(int32_t)
+        + h->strings_length;
+    if (size != image->size) return 0;
+
+    if (!interface_string_valid(image, h->name, h->name_length)) return 0;
+    for (uint32_t i = 0; i < h->symbol_count; i++)
+    {
+        const struct interface_symbol * s = &image->symbols[i];
+        if (!interface_string_valid(image, s->name, s->name_length)) return 0;
+        if (s->type_name_length && !interface_string_valid(image, s->type_name, s->type_name_length)) return 0;
+        if (s->dimensions > h->dimension_count || s->dimension_count > h->dimension_count - s->dimensions) return 0;
+    }
+    return 1;
+}
+
+// Maps the interface at path. Returns -1 if there is none and -2 if the file
+// is not an interface this compiler wrote.
+int interface_open(struct interface_image * image, const char * path)
+{
+    memset(image, 0, sizeof(*image));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < (off_t)sizeof(struct interface_header))
+    {
+        close(fd);
+        return -2;
+    }
+
+    void * data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -2;
+
+    image->data = data;
+    image->size = st.st_size;
+    image->header = data;
+    image->symbols = (const struct interface_symbol *)(image->header + 1);
+    image->dimensions = (const int32_t *)(image->symbols + image->header->symbol_count);
+    image->strings = (const char *)(image->dimensions + image->header->dimension_count);
+
+    if (!interface_valid(image))
+    {
+        munmap(data, st.st_size);
+        memset(image, 0, sizeof(*image));
+        return -2;
+    }
+    return 0;
+}
+
+void interface_close(struct interface_image * image)
+{
+    if (image->data)
+    {
+        munmap(image->data, image->size);
+    }
+    memset(image, 0, sizeof(*image));
+}
+
+// Writing
+
+struct interface_writer
+{
+    struct cache_buffer symbols;
+    struct cache_buffer dimensions;
+    struct cache_buffer strings;
+
+    uint32_t symbol_count;
+    uint32_t dimension_count;
+};
+
+uint32_t interface_put_string(struct interface_writer * w, const char * s, size_t length)
+{
+    uint32_t offset = w->strings.length;
+    cache_put(&w->strings, s, length);
+    cache_put_byte(&w->strings, 0);
+    return offset;
+}
+
+uint32_t interface_put_dimension(struct interface_writer * w, int dimension)
+{
+    int32_t d = dimension;
+    cache_put(&w->dimensions, &d, sizeof(d));
+    return w->dimension_count++;
+}
+
+void interface_put_symbol(struct interface_writer * w, const struct interface_symbol * s)
+{
+    cache_put(&w->symbols, s, sizeof(*s));
+    w->symbol_count++;
+}
+
+void interface_writer_release(struct interface_writer * w)
+{
+    cache_buffer_release(&w->symbols);
+    cache_buffer_release(&w->dimensions);
+    cache_buffer_release(&w->strings);
+}
+
+// Writes the interface of the module called name to path, the way the
+// cache writes an entry: under a name of its own, then renamed into place.
+int interface_write(struct interface_writer * w, const char * dir, const char * path, const char * name)
+{
+    char temporary[4200];
+    snprintf(temporary, sizeof(temporary), "%s.%ld.%p", path, (long)getpid(), (void *)ctx);
+
+    if (mkdir(dir, 0755) && errno != EEXIST) return -1;
+
+    struct interface_header h = { INTERFACE_MAGIC };
+    h.name_length = strlen(name);
+    h.name = interface_put_string(w, name, h.name_length);
+    h.symbol_count = w->symbol_count;
+    h.dimension_count = w->dimension_count;
+    h.strings_length = w->strings.length;
+
+    FILE * out = fopen(temporary, "wb");
+    if (!out) return -1;
+
+    int failed = fwrite(&h, sizeof(h), 1, out) != 1
+        || (w->symbols.length && fwrite(w->symbols.data, 1, w->symbols.length, out) != w->symbols.length)
+        || (w->dimensions.length && fwrite(w->dimensions.data, 1, w->dimensions.length, out) != w->dimensions.length)
+        || fwrite(w->strings.data, 1, w->strings.length, out) != w->strings.length;
+    failed |= fclose(out) != 0;
+
+    if (failed || rename(temporary, path))
+    {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
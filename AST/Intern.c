@@ -0,0 +1,142 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Interning
+//
+// Identifier names are interned straight from the lexer so every occurrence
+// of a name shares one pointer, and its hash is stored in a small header in
+// front of the characters. Names can then be compared by pointer. The table
+// has storage of its own, apart from the context's arena. The files of a
+// program compiled on several threads share one table, under its lock.
+
+#define INTERN_INITIAL_CAPACITY 1024
+
+struct intern_header
+{
+    unsigned int hash;
+    unsigned int length;
+};
+
+struct intern_table
+{
+    const char ** slots;
+    size_t capacity;
+    size_t count;
+
+    struct arena * storage;
+
+    // Set while the table is shared between threads.
+    pthread_mutex_t * lock;
+};
+
+unsigned int intern_hash_bytes(const char * s, size_t length)
+{
+    unsigned int hash = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = hash * 31 + (unsigned int)s[i];
+    }
+    return hash;
+}
+
+unsigned int intern_hash(const char * name)
+{
+    return ((const struct intern_header *)name)[-1].hash;
+}
+
+unsigned int intern_length(const char * name)
+{
+    return ((const struct intern_header *)name)[-1].length;
+}
+
+void intern_grow()
+{
+    size_t capacity = ctx->interned->capacity ? ctx->interned->capacity * 2 : INTERN_INITIAL_CAPACITY;
+    const char ** slots = calloc(capacity, sizeof(*slots));
+    if (!slots)
+    {
+        printf("Memory allocation failed for intern table.\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < ctx->interned->capacity; i++)
+    {
+        const char * name = ctx->interned->slots[i];
+        if (!name) continue;
+
+        size_t j = intern_hash(name) & (capacity - 1);
+        while (slots[j])
+        {
+            j = (j + 1) & (capacity - 1);
+        }
+        slots[j] = name;
+    }
+
+    free(ctx->interned->slots);
+    ctx->interned->slots = slots;
+    ctx->interned->capacity = capacity;
+}
+
+const char * intern_locked(const char * s, size_t length)
+{
+    if (!ctx->interned->storage)
+    {
+        ctx->interned->storage = arena_create();
+    }
+    if ((ctx->interned->count + 1) * 2 > ctx->interned->capacity)
+    {
+        intern_grow();
+    }
+
+    unsigned int hash = intern_hash_bytes(s, length);
+    size_t i = hash & (ctx->interned->capacity - 1);
+    while (ctx->interned->slots[i])
+    {
+        const char * name = ctx->interned->slots[i];
+        if (intern_hash(name) == hash && intern_length(name) == length && memcmp(name, s, length) == 0)
+        {
+            return name;
+        }
+        i = (i + 1) & (ctx->interned->capacity - 1);
+    }
+
+    struct intern_header * h = arena_alloc(ctx->interned->storage, sizeof(*h) + length + 1);
+    h->hash = hash;
+    h->length = length;
+
+    char * name = (char *)(h + 1);
+    memcpy(name, s, length);
+    name[length] = '\0';
+
+    ctx->interned->slots[i] = name;
+    ctx->interned->count++;
+
+    return name;
+}
+
+const char * intern(const char * s, size_t length)
+{
+    if (!ctx->interned->lock) return intern_locked(s, length);
+
+    pthread_mutex_lock(ctx->interned->lock);
+    const char * name = intern_locked(s, length);
+    pthread_mutex_unlock(ctx->interned->lock);
+    return name;
+}
+
+const char * intern_string(const char * s)
+{
+    return intern(s, strlen(s));
+}
+
+void intern_table_release(struct intern_table * t)
+{
+    if (!t) return;
+
+    free(t->slots);
+    arena_release(t->storage);
+    free(t);
+}
@@ -0,0 +1,269 @@
+#include <dlfcn.h>
+#include <elf.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// JIT
+//
+// --run loads the object -c would have written straight into memory and
+// calls its main, so running a program costs no assembler, linker or exec.
+// The loader is a small static linker for the objects Object.c writes: the
+// allocated sections are laid out in one region below 2GB, which keeps the
+// 32-bit absolute relocations of indexed globals valid, and every external
+// function is called through a stub that jumps to the address dlsym()
+// found for it. The program's exit() is redirected back to the caller.
+
+struct jit
+{
+    char * base;
+    size_t size;
+
+    // Load address of each section; 0 for sections that are not loaded.
+    char ** sections;
+
+    Elf64_Sym * symbols;
+    int symbol_count;
+    const char * names;
+
+    // Where each undefined symbol's stub is.
+    char ** stubs;
+};
+
+// jmp [rip], followed by the target address.
+#define JIT_STUB_SIZE 16
+
+_Thread_local jmp_buf * jit_return;
+_Thread_local int jit_status;
+
+void jit_exit(int status)
+{
+    jit_status = status;
+    longjmp(*jit_return, 1);
+}
+
+void * jit_resolve(const char * name)
+{
+    if (!strcmp(name, "exit")) return (void *)jit_exit;
+
+    // The compiler's own global scope, which has libc in it.
+    void * self = dlopen(0, RTLD_LAZY);
+    void * address = self ? dlsym(self, name) : 0;
+    if (self) dlclose(self);
+    return address;
+}
+
+static size_t jit_align(size_t offset, size_t alignment)
+{
+    if (alignment < 1) alignment = 1;
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+void jit_release(struct jit * j)
+{
+    if (j->base) munmap(j->base, j->size);
+    free(j->sections);
+    free(j->stubs);
+    memset(j, 0, sizeof(*j));
+}
+
+int jit_relocate(struct jit * j, const char * image, Elf64_Shdr * rela)
+{
+    char * target = j->sections[rela->sh_info];
+    if (!target) return 0;
+
+    Elf64_Rela * relas = (Elf64_Rela *)(image + rela->sh_offset);
+    size_t count = rela->sh_size / sizeof(*relas);
+    for (size_t i = 0; i < count; i++)
+    {
+        Elf64_Rela * r = &relas[i];
+        size_t index = ELF64_R_SYM(r->r_info);
+        if (index >= (size_t)j->symbol_count) return -1;
+
+        Elf64_Sym * s = &j->symbols[index];
+        char * symbol;
+        if (s->st_shndx == SHN_UNDEF)
+        {
+            symbol = j->stubs[index];
+        }
+        else
+        {
+            symbol = j->sections[s->st_shndx] + s->st_value;
+        }
+
+        char * place = target + r->r_offset;
+        intptr_t value = (intptr_t)symbol + r->r_addend;
+        switch (ELF64_R_TYPE(r->r_info))
+        {
+        case R_X86_64_64:
+            memcpy(place, &value, 8);
+            break;
+        case R_X86_64_32S:
+            if (value != (int32_t)value) return -1;
+            memcpy(place, &(int32_t){ value }, 4);
+            break;
+        case R_X86_64_PC32:
+        case R_X86_64_PLT32:
+            value -= (intptr_t)place;
+            if (value != (int32_t)value) return -1;
+            memcpy(place, &(int32_t){ value }, 4);
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// Lays out and links the object. Code and stubs come first and end up
+// read-only, writable sections start on a page of their own.
+int jit_load(struct jit * j, const char * image, size_t length)
+{
+    memset(j, 0, sizeof(*j));
+
+    Elf64_Ehdr * header = (Elf64_Ehdr *)image;
+    if (length < sizeof(*header) || memcmp(header->e_ident, ELFMAG, SELFMAG)
+        || header->e_ident[EI_CLASS] != ELFCLASS64 || header->e_type != ET_REL
+        || header->e_machine != EM_X86_64 || header->e_shoff + header->e_shnum * sizeof(Elf64_Shdr) > length)
+    {
+        return -1;
+    }
+
+    Elf64_Shdr * sections = (Elf64_Shdr *)(image + header->e_shoff);
+    int count = header->e_shnum;
+
+    Elf64_Shdr * symtab = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (sections[i].sh_type == SHT_SYMTAB) symtab = &sections[i];
+    }
+    if (!symtab) return -1;
+
+    j->symbols = (Elf64_Sym *)(image + symtab->sh_offset);
+    j->symbol_count = symtab->sh_size / sizeof(Elf64_Sym);
+    j->names = image + sections[symtab->sh_link].sh_offset;
+
+    int undefined = 0;
+    for (int i = 1; i < j->symbol_count; i++)
+    {
+        if (j->symbols[i].st_shndx == SHN_UNDEF) undefined++;
+    }
+
+    // Two passes over the sections, executable then writable.
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t * offsets = calloc(count, sizeof(*offsets));
+    size_t offset = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (!(sections[i].sh_flags & SHF_ALLOC) || (sections[i].sh_flags & SHF_WRITE)) continue;
+        offset = jit_align(offset, sections[i].sh_addralign);
+        offsets[i] = offset;
+        offset += sections[i].sh_size;
+    }
+    size_t stubs = jit_align(offset, JIT_STUB_SIZE);
+    size_t writable = jit_align(stubs + undefined * JIT_STUB_SIZE, page);
+    offset = writable;
+    for (int i = 0; i < count; i++)
+    {
+        if (!(sections[i].sh_flags & SHF_ALLOC) || !(sections[i].sh_flags & SHF_WRITE)) continue;
+        offset = jit_align(offset, sections[i].sh_addralign);
+        offsets[i] = offset;
+        offset += sections[i].sh_size;
+    }
+    j->size = jit_align(offset ? offset : 1, page);
+
+    j->base = mmap(0, j->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (j->base == MAP_FAILED)
+    {
+        j->base = 0;
+        free(offsets);
+        return -1;
+    }
+
+    j->sections = calloc(count, sizeof(*j->sections));
+    for (int i = 0; i < count; i++)
+    {
+        if (!(sections[i].sh_flags & SHF_ALLOC)) continue;
+        j->sections[i] = j->base + offsets[i];
+        if (sections[i].sh_type != SHT_NOBITS)
+        {
+            memcpy(j->sections[i], image + sections[i].sh_offset, sections[i].sh_size);
+        }
+    }
+    free(offsets);
+
+    j->stubs = calloc(j->symbol_count, sizeof(*j->stubs));
+    char * stub = j->base + stubs;
+    for (int i = 1; i < j->symbol_count; i++)
+    {
+        if (j->symbols[i].st_shndx != SHN_UNDEF) continue;
+
+        void * address = jit_resolve(j->names + j->symbols[i].st_name);
+        if (!address)
+        {
+            jit_release(j);
+            return -1;
+        }
+        static const unsigned char jump[] = { 0xff, 0x25, 0, 0, 0, 0 };
+        memcpy(stub, jump, sizeof(jump));
+        memcpy(stub + sizeof(jump), &address, 8);
+        j->stubs[i] = stub;
+        stub += JIT_STUB_SIZE;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (sections[i].sh_type == SHT_RELA && sections[i].sh_info < (unsigned)count
+            && jit_relocate(j, image, &sections[i]))
+        {
+            jit_release(j);
+            return -1;
+        }
+    }
+
+    if (mprotect(j->base, writable, PROT_READ | PROT_EXEC))
+    {
+        jit_release(j);
+        return -1;
+    }
+
+    return 0;
+}
+
+void * jit_symbol(struct jit * j, const char * name)
+{
+    for (int i = 1; i < j->symbol_count; i++)
+    {
+        Elf64_Sym * s = &j->symbols[i];
+        if (s->st_shndx != SHN_UNDEF && ELF64_ST_BIND(s->st_info) == STB_GLOBAL
+            && !strcmp(j->names + s->st_name, name))
+        {
+            return j->sections[s->st_shndx] + s->st_value;
+        }
+    }
+    return 0;
+}
+
+// Calls main and returns the status it exits with.
+int jit_call(void * entry)
+{
+    jmp_buf here;
+    jmp_buf * outer = jit_return;
+    jit_return = &here;
+
+    int status;
+    if (setjmp(here))
+    {
+        status = jit_status;
+    }
+    else
+    {
+        status = ((int (*)())entry)();
+    }
+
+    jit_return = outer;
+    return status;
+}
@@ -0,0 +1,551 @@
+#include <elf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Object
+//
+// With -c codegen's instructions are encoded as they come (see Encoder.c)
+// into a text and a data section, and the unit is written out as an ELF64
+// relocatable object, so neither NASM nor the assembly text is needed.
+// Jumps and calls always take a 32-bit displacement, so every reference is
+// a fixed-size hole that is filled in once its label is known. References
+// into the unit's own text are patched when the object is finished;
+// everything else, data and external functions alike, is left to the linker
+// as a relocation.
+
+#define OBJECT_TEXT 1
+#define OBJECT_DATA 2
+
+typedef enum
+{
+    FIXUP_REL32,    // jmp, jcc and call displacements
+    FIXUP_PC32,     // RIP-relative memory operands
+    FIXUP_ABS64,    // label addresses loaded into a register
+    FIXUP_ABS32S    // indexed memory operands, which cannot be RIP-relative
+} fixup_t;
+
+struct object_section
+{
+    char * data;
+    size_t length;
+    size_t capacity;
+};
+
+struct object_label
+{
+    // Interned; null for numbered labels, which never reach the symbol table.
+    const char * name;
+    int section;
+    size_t offset;
+    int global;
+    int symbol;
+};
+
+struct object_fixup
+{
+    size_t offset;
+    int label;
+    fixup_t kind;
+    long addend;
+};
+
+// A reference the linker has to resolve. label is -1 when the relocation is
+// against a section, with the label's offset folded into the addend.
+struct object_reloc
+{
+    size_t offset;
+    int type;
+    int label;
+    int section;
+    long addend;
+};
+
+struct object
+{
+    struct object_section sections[3];
+    int section;
+
+    struct object_label * labels;
+    int label_count;
+    int label_capacity;
+
+    // Label index + 1 for each label number and each interned name; 0 is free.
+    int * numbered;
+    long numbered_capacity;
+    int * named;
+    int named_capacity;
+    int named_count;
+
+    struct object_fixup * fixups;
+    int fixup_count;
+    int fixup_capacity;
+
+    struct object_reloc * relocs;
+    int reloc_count;
+    int reloc_capacity;
+};
+
+void * object_grow(void * items, int * capacity, size_t size)
+{
+    *capacity = *capacity ? *capacity * 2 : 256;
+    items = realloc(items, *capacity * size);
+    if (!items)
+    {
+        printf("Memory allocation failed for object.\n");
+        exit(1);
+    }
+    return items;
+}
+
+struct object * object_create()
+{
+    struct object * o = calloc(1, sizeof(*o));
+    if (!o)
+    {
+        printf("Memory allocation failed for object.\n");
+        exit(1);
+    }
+    o->section = OBJECT_TEXT;
+
+    return o;
+}
+
+void object_release(struct object * o)
+{
+    if (!o) return;
+
+    free(o->sections[OBJECT_TEXT].data);
+    free(o->sections[OBJECT_DATA].data);
+    free(o->labels);
+    free(o->numbered);
+    free(o->named);
+    free(o->fixups);
+    free(o->relocs);
+    free(o);
+}
+
+// Sections
+
+static inline char * object_reserve(struct object * o, size_t n)
+{
+    struct object_section * s = &o->sections[o->section];
+    if (s->length + n > s->capacity)
+    {
+        while (s->length + n > s->capacity)
+        {
+            s->capacity = s->capacity ? s->capacity * 2 : 1 << 16;
+        }
+        s->data = realloc(s->data, s->capacity);
+        if (!s->data)
+        {
+            printf("Memory allocation failed for object.\n");
+            exit(1);
+        }
+    }
+    char * p = s->data + s->length;
+    s->length += n;
+    return p;
+}
+
+static inline void object_byte(struct object * o, unsigned char b)
+{
+    *object_reserve(o, 1) = b;
+}
+
+void object_bytes(struct object * o, const void * data, size_t n)
+{
+    memcpy(object_reserve(o, n), data, n);
+}
+
+void object_value(struct object * o, long value, int size)
+{
+    char * p = object_reserve(o, size);
+    for (int i = 0; i < size; i++)
+    {
+        p[i] = (value >> (i * 8)) & 0xff;
+    }
+}
+
+size_t object_offset(struct object * o)
+{
+    return o->sections[o->section].length;
+}
+
+// Labels
+
+int object_label_add(struct object * o, const char * name)
+{
+    if (o->label_count == o->label_capacity)
+    {
+        o->labels = object_grow(o->labels, &o->label_capacity, sizeof(*o->labels));
+    }
+    struct object_label * l = &o->labels[o->label_count];
+    memset(l, 0, sizeof(*l));
+    l->name = name;
+    return o->label_count++;
+}
+
+int object_label_numbered(struct object * o, long number)
+{
+    if (number >= o->numbered_capacity)
+    {
+        long capacity = o->numbered_capacity ? o->numbered_capacity : 256;
+        while (number >= capacity)
+        {
+            capacity *= 2;
+        }
+        o->numbered = realloc(o->numbered, capacity * sizeof(*o->numbered));
+        memset(o->numbered + o->numbered_capacity, 0, (capacity - o->numbered_capacity) * sizeof(*o->numbered));
+        o->numbered_capacity = capacity;
+    }
+    if (!o->numbered[number])
+    {
+        o->numbered[number] = object_label_add(o, 0) + 1;
+    }
+    return o->numbered[number] - 1;
+}
+
+void object_named_grow(struct object * o)
+{
+    int * old = o->named;
+    int old_capacity = o->named_capacity;
+
+    o->named_capacity = old_capacity ? old_capacity * 2 : 256;
+    o->named = calloc(o->named_capacity, sizeof(*o->named));
+
+    int mask = o->named_capacity - 1;
+    for (int i = 0; i < old_capacity; i++)
+    {
+        if (!old[i]) continue;
+
+        int j = intern_hash(o->labels[old[i] - 1].name) & mask;
+        while (o->named[j])
+        {
+            j = (j + 1) & mask;
+        }
+        o->named[j] = old[i];
+    }
+
+    free(old);
+}
+
+int object_label_named(struct object * o, const char * name)
+{
+    if ((o->named_count + 1) * 2 > o->named_capacity)
+    {
+        object_named_grow(o);
+    }
+
+    int mask = o->named_capacity - 1;
+    int i = intern_hash(name) & mask;
+    while (o->named[i])
+    {
+        if (o->labels[o->named[i] - 1].name == name)
+        {
+            return o->named[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+
+    o->named[i] = object_label_add(o, name) + 1;
+    o->named_count++;
+    return o->named[i] - 1;
+}
+
+// Numbered labels are local to the named label before them, so a named
+// label starts a fresh set. Labels already made keep their fixups.
+void object_scope(struct object * o)
+{
+    if (o->numbered)
+    {
+        memset(o->numbered, 0, o->numbered_capacity * sizeof(*o->numbered));
+    }
+}
+
+// Labels are named the way the emitter prints them: prefix, then name, then
+// number. A label with only a number is one of label_create()'s, and those
+// numbers are unique within their scope.
+int object_label(struct object * o, const char * prefix, const char * name, long number)
+{
+    if (!name && number >= 0)
+    {
+        return object_label_numbered(o, number);
+    }
+
+    char buffer[256];
+    int length = snprintf(buffer, sizeof(buffer), "%s%s", prefix ? prefix : "", name ? name : "");
+    if (number >= 0 && length < (int)sizeof(buffer))
+    {
+        length += snprintf(buffer + length, sizeof(buffer) - length, "%ld", number);
+    }
+    if (length >= (int)sizeof(buffer))
+    {
+        length = sizeof(buffer) - 1;
+    }
+    return object_label_named(o, intern(buffer, length));
+}
+
+void object_define(struct object * o, int label)
+{
+    o->labels[label].section = o->section;
+    o->labels[label].offset = object_offset(o);
+}
+
+// Leaves a hole for a reference to label at the current offset. addend is
+// relative to the start of the hole, as in an ELF relocation.
+void object_reference(struct object * o, int label, fixup_t kind, long addend)
+{
+    if (o->fixup_count == o->fixup_capacity)
+    {
+        o->fixups = object_grow(o->fixups, &o->fixup_capacity, sizeof(*o->fixups));
+    }
+    struct object_fixup * f = &o->fixups[o->fixup_count++];
+    f->offset = object_offset(o);
+    f->label = label;
+    f->kind = kind;
+    f->addend = addend;
+
+    object_value(o, 0, kind == FIXUP_ABS64 ? 8 : 4);
+}
+
+void object_reloc_add(struct object * o, size_t offset, int type, int label, int section, long addend)
+{
+    if (o->reloc_count == o->reloc_capacity)
+    {
+        o->relocs = object_grow(o->relocs, &o->reloc_capacity, sizeof(*o->relocs));
+    }
+    struct object_reloc * r = &o->relocs[o->reloc_count++];
+    r->offset = offset;
+    r->type = type;
+    r->label = label;
+    r->section = section;
+    r->addend = addend;
+}
+
+// Patches every reference into the text and turns the rest into relocations.
+// Returns the number of references to numbered labels that were never
+// defined, which would otherwise be handed to the linker without a name.
+int object_finish(struct object * o)
+{
+    int missing = 0;
+    struct object_section * text = &o->sections[OBJECT_TEXT];
+
+    for (int i = 0; i < o->fixup_count; i++)
+    {
+        struct object_fixup * f = &o->fixups[i];
+        struct object_label * l = &o->labels[f->label];
+        int relative = f->kind == FIXUP_REL32 || f->kind == FIXUP_PC32;
+
+        if (relative && l->section == OBJECT_TEXT)
+        {
+            int32_t value = l->offset + f->addend - f->offset;
+            memcpy(text->data + f->offset, &value, 4);
+            continue;
+        }
+
+        int type = f->kind == FIXUP_ABS64 ? R_X86_64_64
+            : f->kind == FIXUP_ABS32S ? R_X86_64_32S
+            : f->kind == FIXUP_PC32 ? R_X86_64_PC32
+            : R_X86_64_PLT32;
+
+        if (l->section)
+        {
+            object_reloc_add(o, f->offset, type, -1, l->section, l->offset + f->addend);
+        }
+        else if (l->name)
+        {
+            l->global = 1;
+            object_reloc_add(o, f->offset, type, f->label, 0, f->addend);
+        }
+        else
+        {
+            missing++;
+        }
+    }
+
+    return missing;
+}
+
+// ELF
+
+void object_strtab_add(struct object_section * strtab, const char * name)
+{
+    size_t length = strlen(name) + 1;
+    if (strtab->length + length > strtab->capacity)
+    {
+        while (strtab->length + length > strtab->capacity)
+        {
+            strtab->capacity = strtab->capacity ? strtab->capacity * 2 : 1 << 12;
+        }
+        strtab->data = realloc(strtab->data, strtab->capacity);
+    }
+    memcpy(strtab->data + strtab->length, name, length);
+    strtab->length += length;
+}
+
+static size_t object_align(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+// Lays the object out as one malloc'd image: header, section contents, then
+// the section header table.
+int object_write(struct object * o, char ** image, size_t * image_length)
+{
+    enum
+    {
+        SECTION_TEXT = OBJECT_TEXT,
+        SECTION_DATA = OBJECT_DATA,
+        SECTION_SYMTAB,
+        SECTION_STRTAB,
+        SECTION_RELA,
+        SECTION_NOTE,
+        SECTION_SHSTRTAB,
+        SECTION_COUNT
+    };
+    static const char shstrtab[] =
+        "\0.text\0.data\0.symtab\0.strtab\0.rela.text\0.note.GNU-stack\0.shstrtab";
+    static const int shstrtab_names[SECTION_COUNT] = { 0, 1, 7, 13, 21, 29, 40, 56 };
+
+    // Symbols: null, the two section symbols, named locals, then globals.
+    int symbol_count = 3;
+    int first_global = 0;
+    for (int global = 0; global < 2; global++)
+    {
+        if (global)
+        {
+            first_global = symbol_count;
+        }
+        for (int i = 0; i < o->label_count; i++)
+        {
+            struct object_label * l = &o->labels[i];
+            if (!l->name || (!l->section && !l->global) || l->global != global) continue;
+            l->symbol = symbol_count++;
+        }
+    }
+
+    Elf64_Sym * symbols = calloc(symbol_count, sizeof(*symbols));
+    struct object_section strtab = { 0 };
+    object_strtab_add(&strtab, "");
+
+    symbols[1].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    symbols[1].st_shndx = SECTION_TEXT;
+    symbols[2].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+    symbols[2].st_shndx = SECTION_DATA;
+
+    for (int i = 0; i < o->label_count; i++)
+    {
+        struct object_label * l = &o->labels[i];
+        if (!l->name || !l->symbol) continue;
+
+        Elf64_Sym * s = &symbols[l->symbol];
+        s->st_name = strtab.length;
+        object_strtab_add(&strtab, l->name);
+
+        s->st_info = ELF64_ST_INFO(l->global ? STB_GLOBAL : STB_LOCAL, STT_NOTYPE);
+        s->st_shndx = l->section ? l->section : SHN_UNDEF;
+        s->st_value = l->offset;
+    }
+
+    Elf64_Rela * relas = calloc(o->reloc_count ? o->reloc_count : 1, sizeof(*relas));
+    for (int i = 0; i < o->reloc_count; i++)
+    {
+        struct object_reloc * r = &o->relocs[i];
+        int symbol = r->label >= 0 ? o->labels[r->label].symbol : r->section;
+        relas[i].r_offset = r->offset;
+        relas[i].r_info = ELF64_R_INFO(symbol, r->type);
+        relas[i].r_addend = r->addend;
+    }
+
+    // Where each section's contents go in the image.
+    const void * contents[SECTION_COUNT] = { 0 };
+    size_t sizes[SECTION_COUNT] = { 0 };
+    size_t alignments[SECTION_COUNT] = { 0, 16, 16, 8, 1, 8, 1, 1 };
+    contents[SECTION_TEXT] = o->sections[OBJECT_TEXT].data;
+    sizes[SECTION_TEXT] = o->sections[OBJECT_TEXT].length;
+    contents[SECTION_DATA] = o->sections[OBJECT_DATA].data;
+    sizes[SECTION_DATA] = o->sections[OBJECT_DATA].length;
+    contents[SECTION_SYMTAB] = symbols;
+    sizes[SECTION_SYMTAB] = symbol_count * sizeof(*symbols);
+    contents[SECTION_STRTAB] = strtab.data;
+    sizes[SECTION_STRTAB] = strtab.length;
+    contents[SECTION_RELA] = relas;
+    sizes[SECTION_RELA] = o->reloc_count * sizeof(*relas);
+    contents[SECTION_SHSTRTAB] = shstrtab;
+    sizes[SECTION_SHSTRTAB] = sizeof(shstrtab);
+
+    size_t offsets[SECTION_COUNT] = { 0 };
+    size_t offset = sizeof(Elf64_Ehdr);
+    for (int i = 1; i < SECTION_COUNT; i++)
+    {
+        offset = object_align(offset, alignments[i]);
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+    size_t headers = object_align(offset, 8);
+    size_t length = headers + SECTION_COUNT * sizeof(Elf64_Shdr);
+
+    char * p = calloc(1, length);
+    if (!p)
+    {
+        free(symbols);
+        free(strtab.data);
+        free(relas);
+        return -1;
+    }
+
+    Elf64_Ehdr * header = (Elf64_Ehdr *)p;
+    memcpy(header->e_ident, ELFMAG, SELFMAG);
+    header->e_ident[EI_CLASS] = ELFCLASS64;
+    header->e_ident[EI_DATA] = ELFDATA2LSB;
+    header->e_ident[EI_VERSION] = EV_CURRENT;
+    header->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    header->e_type = ET_REL;
+    header->e_machine = EM_X86_64;
+    header->e_version = EV_CURRENT;
+    header->e_shoff = headers;
+    header->e_ehsize = sizeof(Elf64_Ehdr);
+    header->e_shentsize = sizeof(Elf64_Shdr);
+    header->e_shnum = SECTION_COUNT;
+    header->e_shstrndx = SECTION_SHSTRTAB;
+
+    Elf64_Shdr * sections = (Elf64_Shdr *)(p + headers);
+    for (int i = 1; i < SECTION_COUNT; i++)
+    {
+        if (sizes[i])
+        {
+            memcpy(p + offsets[i], contents[i], sizes[i]);
+        }
+        sections[i].sh_name = shstrtab_names[i];
+        sections[i].sh_offset = offsets[i];
+        sections[i].sh_size = sizes[i];
+        sections[i].sh_addralign = alignments[i];
+    }
+
+    sections[SECTION_TEXT].sh_type = SHT_PROGBITS;
+    sections[SECTION_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    sections[SECTION_DATA].sh_type = SHT_PROGBITS;
+    sections[SECTION_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+    sections[SECTION_SYMTAB].sh_type = SHT_SYMTAB;
+    sections[SECTION_SYMTAB].sh_link = SECTION_STRTAB;
+    sections[SECTION_SYMTAB].sh_info = first_global;
+    sections[SECTION_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+    sections[SECTION_STRTAB].sh_type = SHT_STRTAB;
+    sections[SECTION_RELA].sh_type = SHT_RELA;
+    sections[SECTION_RELA].sh_flags = SHF_INFO_LINK;
+    sections[SECTION_RELA].sh_link = SECTION_SYMTAB;
+    sections[SECTION_RELA].sh_info = SECTION_TEXT;
+    sections[SECTION_RELA].sh_entsize = sizeof(Elf64_Rela);
+    sections[SECTION_NOTE].sh_type = SHT_PROGBITS;
+    sections[SECTION_SHSTRTAB].sh_type = SHT_STRTAB;
+
+    free(symbols);
+    free(strtab.data);
+    free(relas);
+
+    *image = p;
+    *image_length = length;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Pool
+//
+// Runs work over items 0 to count - 1 on a number of threads, the calling
+// thread among them. Items are handed out one at a time from a shared
+// cursor, so a thread that finishes early takes the next item instead of
+// waiting on a fixed share. work is told which worker it runs on, for state
+// of its own; ctx is the caller's again when pool_run returns.
+
+struct pool
+{
+    void (*work)(void * arg, int worker, int item);
+    void * arg;
+    int count;
+    int next;
+};
+
+struct pool_thread
+{
+    struct pool * pool;
+    int worker;
+};
+
+void * pool_worker(void * arg)
+{
+    struct pool_thread * t = arg;
+    struct pool * p = t->pool;
+    for (;;)
+    {
+        int i = __atomic_fetch_add(&p->next, 1, __ATOMIC_RELAXED);
+        if (i >= p->count) break;
+        p->work(p->arg, t->worker, i);
+    }
+    return 0;
+}
+
+// Threads for jobs, where 0 means one per processor, never more than count.
+int pool_workers(int jobs, int count)
+{
+    int workers = jobs > 0 ? jobs : sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers > count) workers = count;
+    if (workers < 1) workers = 1;
+    return workers;
+}
+
+void pool_run(int workers, int count, void (*work)(void * arg, int worker, int item), void * arg)
+{
+    struct pool p = { work, arg, count, 0 };
+    struct hend_context * outer = ctx;
+
+    pthread_t * threads = calloc(workers, sizeof(*threads));
+    struct pool_thread * state = calloc(workers, sizeof(*state));
+    for (int i = 0; i < workers; i++)
+    {
+        state[i].pool = &p;
+        state[i].worker = i;
+    }
+    for (int i = 1; i < workers; i++)
+    {
+        pthread_create(&threads[i], 0, pool_worker, &state[i]);
+    }
+    pool_worker(&state[0]);
+    for (int i = 1; i < workers; i++)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    free(state);
+    free(threads);
+    ctx = outer;
+}
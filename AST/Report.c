@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// Report
+//
+// -ftime-report records, for each compile phase, the wall time, what was
+// allocated from the arena, peak RSS once the phase is over, how many AST
+// nodes were built and how many bytes of output were produced. Lexing runs
+// interleaved with parsing, so its share is accumulated token by token and
+// split back out of the parse phase when that ends.
+
+#define REPORT_MAX_PHASES 8
+
+struct report_phase
+{
+    const char * name;
+    double seconds;
+    size_t allocations;
+    size_t bytes;
+    long peak_rss;
+    size_t nodes;
+    size_t output;
+};
+
+struct report
+{
+    hend_report_t format;
+
+    struct report_phase phases[REPORT_MAX_PHASES];
+    int phase_count;
+    int open;
+
+    // Counters at the start of the current phase.
+    struct timespec start;
+    size_t allocations;
+    size_t bytes;
+    size_t node_start;
+    size_t output_start;
+
+    // Running counters.
+    size_t nodes;
+    size_t output;
+
+    // The lexer's share of the current phase.
+    struct report_phase lex;
+};
+
+// AST nodes are counted as they are allocated, whether or not a report was
+// asked for; a single increment is cheaper than deciding.
+#define node_alloc(p) (ctx->report->nodes++, arena_alloc(ctx->arena, sizeof(*(p))))
+
+double report_seconds(struct timespec from, struct timespec to)
+{
+    return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) / 1e9;
+}
+
+long report_peak_rss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage)) return 0;
+    return usage.ru_maxrss;
+}
+
+void report_end()
+{
+    if (!ctx->report->open) return;
+    ctx->report->open = 0;
+
+    if (ctx->report->format == HEND_REPORT_NONE) return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    struct report_phase * p = &ctx->report->phases[ctx->report->phase_count - 1];
+    p->seconds = report_seconds(ctx->report->start, now);
+    p->allocations = ctx->arena->allocations - ctx->report->allocations;
+    p->bytes = ctx->arena->bytes - ctx->report->bytes;
+    p->peak_rss = report_peak_rss();
+    p->nodes = ctx->report->nodes - ctx->report->node_start;
+    p->output = ctx->report->output - ctx->report->output_start;
+
+    if (!ctx->report->lex.name || ctx->report->phase_count == REPORT_MAX_PHASES) return;
+
+    p->seconds -= ctx->report->lex.seconds;
+    p->allocations -= ctx->report->lex.allocations;
+    p->bytes -= ctx->report->lex.bytes;
+    ctx->report->lex.peak_rss = p->peak_rss;
+
+    ctx->report->phases[ctx->report->phase_count] = *p;
+    ctx->report->phases[ctx->report->phase_count - 1] = ctx->report->lex;
+    ctx->report->phase_count++;
+
+    memset(&ctx->report->lex, 0, sizeof(ctx->report->lex));
+}
+
+void report_begin(const char * name)
+{
+    report_end();
+    arena_phase_begin(ctx->arena, name);
+
+    if (ctx->report->format == HEND_REPORT_NONE || ctx->report->phase_count == REPORT_MAX_PHASES) return;
+
+    struct report_phase * p = &ctx->report->phases[ctx->report->phase_count++];
+    memset(p, 0, sizeof(*p));
+    p->name = name;
+
+    ctx->report->open = 1;
+    ctx->report->allocations = ctx->arena->allocations;
+    ctx->report->bytes = ctx->arena->bytes;
+    ctx->report->node_start = ctx->report->nodes;
+    ctx->report->output_start = ctx->report->output;
+    clock_gettime(CLOCK_MONOTONIC, &ctx->report->start);
+}
+
+void report_output(size_t bytes)
+{
+    ctx->report->output += bytes;
+}
+
+// Pulls one token through scan, charging its time and allocations to lex.
+int report_lex(int (*scan)())
+{
+    if (ctx->report->format == HEND_REPORT_NONE) return scan();
+
+    struct timespec from, to;
+    size_t allocations = ctx->arena->allocations;
+    size_t bytes = ctx->arena->bytes;
+
+    clock_gettime(CLOCK_MONOTONIC, &from);
+    int token = scan();
+    clock_gettime(CLOCK_MONOTONIC, &to);
+
+    ctx->report->lex.name = "lex";
+    ctx->report->lex.seconds += report_seconds(from, to);
+    ctx->report->lex.allocations += ctx->arena->allocations - allocations;
+    ctx->report->lex.bytes += ctx->arena->bytes - bytes;
+
+    return token;
+}
+
+struct report_phase report_total()
+{
+    struct report_phase total = { "total" };
+    for (int i = 0; i < ctx->report->phase_count; i++)
+    {
+        struct report_phase * p = &ctx->report->phases[i];
+        total.seconds += p->seconds;
+        total.allocations += p->allocations;
+        total.bytes += p->bytes;
+        total.nodes += p->nodes;
+        // Codegen and emit both count the same assembly text.
+        if (p->output > total.output) total.output = p->output;
+        if (p->peak_rss > total.peak_rss) total.peak_rss = p->peak_rss;
+    }
+    return total;
+}
+
+void report_print_text(FILE * out)
+{
+    fprintf(out, "%-12s %12s %12s %12s %14s %12s %12s\n", "phase", "wall ms", "allocs", "bytes", "peak rss kb", "nodes", "output");
+    for (int i = 0; i <= ctx->report->phase_count; i++)
+    {
+        struct report_phase p = i < ctx->report->phase_count ? ctx->report->phases[i] : report_total();
+        fprintf(out, "%-12s %12.3f %12zu %12zu %14ld %12zu %12zu\n", p.name, p.seconds * 1e3, p.allocations, p.bytes, p.peak_rss, p.nodes, p.output);
+    }
+}
+
+void report_print_json(FILE * out)
+{
+    fprintf(out, "{\"phases\": [");
+    for (int i = 0; i <= ctx->report->phase_count; i++)
+    {
+        struct report_phase p = i < ctx->report->phase_count ? ctx->report->phases[i] : report_total();
+        if (i == ctx->report->phase_count)
+        {
+            fprintf(out, "], \"total\": ");
+        }
+        else if (i > 0)
+        {
+            fprintf(out, ", ");
+        }
+        fprintf(out, "{\"name\": \"%s\", \"wall_ms\": %.3f, \"allocations\": %zu, \"bytes\": %zu, \"peak_rss_kb\": %ld, \"nodes\": %zu, \"output_bytes\": %zu}",
+            p.name, p.seconds * 1e3, p.allocations, p.bytes, p.peak_rss, p.nodes, p.output);
+    }
+    fprintf(out, "}\n");
+}
+
+void report_print(FILE * out)
+{
+    report_end();
+
+    switch (ctx->report->format)
+    {
+    case HEND_REPORT_TEXT:
+        report_print_text(out);
+        break;
+    case HEND_REPORT_JSON:
+        report_print_json(out);
+        break;
+    default:
+        break;
+    }
+}
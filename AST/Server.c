@@ -0,0 +1,146 @@
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Server
+//
+// --daemon keeps one process and its warm sessions around for a build that
+// compiles many small units, so none of them pays for process start-up or
+// for filling the intern and type tables from scratch. Every worker thread
+// owns a session and takes connections off the shared listening socket;
+// each request on a connection is compiled and answered in turn.
+
+extern FILE * yyout;
+
+// Answers requests until the client hangs up or breaks the protocol.
+void server_connection(hend_session * session, int fd)
+{
+    char * source = 0;
+    size_t capacity = 0;
+    char cache[4096];
+
+    hend_request request;
+    while (!stream_read(fd, &request, sizeof(request)) && request.magic == HEND_PROTOCOL_MAGIC)
+    {
+        if (request.cache_length >= sizeof(cache) || stream_read(fd, cache, request.cache_length)) break;
+        cache[request.cache_length] = '\0';
+
+        // Room for the two NUL bytes the scanner wants, so the source is
+        // compiled where it was read.
+        if (request.length + 2 > capacity)
+        {
+            free(source);
+            capacity = request.length + 2;
+            source = malloc(capacity);
+            if (!source) break;
+        }
+        if (stream_read(fd, source, request.length)) break;
+        source[request.length] = '\0';
+        source[request.length + 1] = '\0';
+
+        hend_options options = { 0 };
+        options.time_report = request.time_report;
+        options.memory_report = request.memory_report;
+        options.object = request.object;
+        options.cache = request.cache_length ? cache : 0;
+        options.in_place = 1;
+
+        // The workers already keep every processor busy, so a unit's
+        // functions get more than one thread only when the client asks.
+        options.jobs = request.jobs ? request.jobs : 1;
+
+        hend_output output;
+        hend_session_compile(session, source, request.length, &options, &output);
+
+        hend_response response = { 0 };
+        response.magic = HEND_PROTOCOL_MAGIC;
+        response.errors = output.errors;
+        response.assembly_length = output.assembly_length;
+        response.object_length = output.object_length;
+        response.diagnostics_length = output.diagnostics_length;
+        response.report_length = output.report_length;
+
+        int failed = stream_write(fd, &response, sizeof(response))
+            || stream_write(fd, output.assembly, output.assembly_length)
+            || stream_write(fd, output.object, output.object_length)
+            || stream_write(fd, output.diagnostics, output.diagnostics_length)
+            || stream_write(fd, output.report, output.report_length);
+        hend_output_release(&output);
+        if (failed) break;
+    }
+
+    free(source);
+    close(fd);
+}
+
+void * server_worker(void * arg)
+{
+    int listener = *(int *)arg;
+    hend_session * session = hend_session_create();
+
+    for (;;)
+    {
+        int fd = accept(listener, 0, 0);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        server_connection(session, fd);
+    }
+
+    hend_session_release(session);
+    return 0;
+}
+
+int hend_serve(const char * path, int workers)
+{
+    struct sockaddr_un address = { 0 };
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) return -1;
+
+    // A socket left behind by an earlier server is replaced.
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&address, sizeof(address)) || listen(listener, 64))
+    {
+        close(listener);
+        return -1;
+    }
+
+    // A client that goes away mid-response must not take the server with it.
+    signal(SIGPIPE, SIG_IGN);
+
+    // The scanner echoes what it does not match, newlines mostly, to yyout.
+    // Nobody reads the server's output, so that goes nowhere.
+    FILE * null = fopen("/dev/null", "w");
+    if (null)
+    {
+        yyout = null;
+    }
+
+    if (workers < 1) workers = 1;
+    pthread_t * threads = calloc(workers, sizeof(*threads));
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_create(&threads[i], 0, server_worker, &listener);
+    }
+    for (int i = 0; i < workers; i++)
+    {
+        pthread_join(threads[i], 0);
+    }
+
+    free(threads);
+    close(listener);
+    return 0;
+}
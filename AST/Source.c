@@ -0,0 +1,128 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Source
+//
+// Flex scans the whole input in place, so tokens are sliced straight out of
+// the buffer and views into it stay valid for the whole compile. Flex wants
+// two NUL bytes after the text and writes into the buffer while it scans.
+// With -i the file is mapped private and writable over a zeroed anonymous
+// region that has room for the terminators; stdin is read into a buffer with
+// the same layout. The context's source is the buffer being scanned.
+
+struct source
+{
+    char * data;
+    size_t length;
+    size_t mapped;
+};
+
+int source_map(struct source * s, const char * path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t length = st.st_size;
+    size_t mapped = (length + 2 + page - 1) & ~(page - 1);
+
+    char * data = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+    {
+        close(fd);
+        return -1;
+    }
+
+    // Past the end of the file the last page reads as zeros, and whatever is
+    // left over comes from the anonymous region, so the terminators are free.
+    if (length && mmap(data, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(data, mapped);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    madvise(data, mapped, MADV_SEQUENTIAL);
+
+    s->data = data;
+    s->length = length;
+    s->mapped = mapped;
+
+    return 0;
+}
+
+// Reads all of in into a heap buffer followed by the two terminators.
+int source_read(struct source * s, FILE * in)
+{
+    size_t capacity = 1 << 16;
+    size_t length = 0;
+    char * data = malloc(capacity);
+    if (!data) return -1;
+
+    size_t n;
+    while ((n = fread(data + length, 1, capacity - length - 2, in)) > 0)
+    {
+        length += n;
+        if (length + 2 == capacity)
+        {
+            capacity *= 2;
+            char * grown = realloc(data, capacity);
+            if (!grown)
+            {
+                free(data);
+                return -1;
+            }
+            data = grown;
+        }
+    }
+    data[length] = '\0';
+    data[length + 1] = '\0';
+
+    s->data = data;
+    s->length = length;
+    s->mapped = 0;
+
+    return 0;
+}
+
+void source_release(struct source * s)
+{
+    if (!s->data) return;
+
+    if (s->mapped)
+    {
+        munmap(s->data, s->mapped);
+    }
+    else
+    {
+        free(s->data);
+    }
+    s->data = 0;
+    s->length = 0;
+    s->mapped = 0;
+}
+
+// Returns text that stays valid for the rest of the compile. Tokens scanned
+// out of the source are returned as they are; anything else is copied.
+const char * source_view(const char * text, size_t length)
+{
+    if (ctx->source->data && text >= ctx->source->data && text + length <= ctx->source->data + ctx->source->length)
+    {
+        return text;
+    }
+    return arena_strndup(ctx->arena, text, length);
+}
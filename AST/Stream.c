@@ -0,0 +1,38 @@
+#include <errno.h>
+#include <stddef.h>
+#include <unistd.h>
+
+// Stream
+//
+// Reads and writes of an exact length on a descriptor, for the compile
+// server's socket and for hendc, its client, which builds on its own and
+// includes this file alone.
+
+// Reads or writes exactly length bytes; fails on error or end of file.
+int stream_read(int fd, void * data, size_t length)
+{
+    char * p = data;
+    while (length)
+    {
+        ssize_t n = read(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int stream_write(int fd, const void * data, size_t length)
+{
+    const char * p = data;
+    while (length)
+    {
+        ssize_t n = write(fd, p, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Generates a synthetic hend program for the compiler throughput benchmark.
+//
+//   gen [-f functions] [-s statements] [-d depth] [-n nesting] [-v identifiers] [-r seed]
+//
+// Every function takes two parameters, declares its identifiers up front and
+// then runs a list of assignments whose right hand sides have as many operands
+// as an expression tree of the given depth, with the odd call to a function
+// defined earlier. Every eighth statement opens a chain of nested if blocks of
+// the given nesting, and main calls the last function. The program goes to
+// stdout.
+
+struct options
+{
+    int functions;
+    int statements;
+    int depth;
+    int nesting;
+    int identifiers;
+    unsigned int seed;
+};
+
+struct options options = { 16, 64, 2, 2, 8, 1 };
+
+int current_function;
+
+unsigned int next_random()
+{
+    options.seed = options.seed * 1103515245 + 12345;
+    return (options.seed >> 16) & 0x7fff;
+}
+
+void indent(int level)
+{
+    for (int i = 0; i < level; i++)
+    {
+        fputs("    ", stdout);
+    }
+}
+
+void leaf()
+{
+    switch (next_random() % 4)
+    {
+    case 0:
+        printf("%u", next_random() % 100);
+        break;
+    case 1:
+        printf("%c", next_random() % 2 ? 'a' : 'b');
+        break;
+    default:
+        printf("v%u", next_random() % options.identifiers);
+        break;
+    }
+}
+
+void expression(int depth)
+{
+    if (depth <= 0)
+    {
+        leaf();
+        return;
+    }
+
+    // Only + and -, so the programs stay clear of multiply and divide codegen.
+    // Each subtree is parenthesised, so every level keeps one more value live
+    // while its right side is computed, and deep trees spill.
+    printf("(");
+    expression(depth - 1);
+    printf(" %c ", next_random() % 2 ? '+' : '-');
+    expression(depth - 1);
+    printf(")");
+}
+
+// Calls get statements of their own, as they always have, so corpora stay
+// comparable from one version of the compiler to the next.
+void assignment(int level)
+{
+    indent(level);
+    if (current_function > 0 && next_random() % 16 == 0)
+    {
+        printf("f%u(", next_random() % current_function);
+        expression(options.depth - 1);
+        printf(", ");
+        expression(options.depth - 1);
+        printf(");\n");
+        return;
+    }
+    printf("v%u: ", next_random() % options.identifiers);
+    expression(options.depth);
+    printf(";\n");
+}
+
+void function(int n)
+{
+    current_function = n;
+
+    printf("fn f%d(int4 a, int4 b) int4\n{\n", n);
+    for (int i = 0; i < options.identifiers; i++)
+    {
+        indent(1);
+        printf("int4 v%d: %d;\n", i, i);
+    }
+
+    int emitted = 0;
+    while (emitted < options.statements)
+    {
+        if (options.nesting > 0 && emitted % 8 == 7)
+        {
+            for (int level = 0; level < options.nesting; level++)
+            {
+                indent(level + 1);
+                printf("if (v%u < %u)\n", next_random() % options.identifiers, next_random() % 100);
+                indent(level + 1);
+                printf("{\n");
+            }
+            assignment(options.nesting + 1);
+            for (int level = options.nesting - 1; level >= 0; level--)
+            {
+                indent(level + 1);
+                printf("}\n");
+            }
+        }
+        else
+        {
+            assignment(1);
+        }
+        emitted++;
+    }
+
+    printf("    ret v0;\n}\n\n");
+}
+
+int parse_option(int argc, char ** argv, int i)
+{
+    if (i + 1 >= argc)
+    {
+        fprintf(stderr, "error: %s needs a value\n", argv[i]);
+        exit(1);
+    }
+    return atoi(argv[i + 1]);
+}
+
+int main(int argc, char ** argv)
+{
+    for (int i = 1; i < argc; i += 2)
+    {
+        int value = parse_option(argc, argv, i);
+        if (!strcmp(argv[i], "-f")) options.functions = value;
+        else if (!strcmp(argv[i], "-s")) options.statements = value;
+        else if (!strcmp(argv[i], "-d")) options.depth = value;
+        else if (!strcmp(argv[i], "-n")) options.nesting = value;
+        else if (!strcmp(argv[i], "-v")) options.identifiers = value;
+        else if (!strcmp(argv[i], "-r")) options.seed = value;
+        else
+        {
+            fprintf(stderr, "error: unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (options.functions < 1) options.functions = 1;
+    if (options.identifiers < 1) options.identifiers = 1;
+
+    for (int i = 0; i < options.functions; i++)
+    {
+        function(i);
+    }
+
+    printf("fn main() int4\n{\n    f%d(1, 2);\n    ret 0;\n}\n", options.functions - 1);
+
+    return 0;
+}
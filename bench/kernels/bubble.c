@@ -0,0 +1,39 @@
+#include <stdio.h>
+
+int main()
+{
+    int a[5000];
+    int x = 1;
+    for (int i = 0; i < 5000; i = i + 1)
+    {
+        x = x + 7919;
+        if (x >= 10007)
+        {
+            x = x - 10007;
+        }
+        a[i] = x;
+    }
+
+    for (int i = 0; i < 4999; i = i + 1)
+    {
+        for (int j = 0; j < 4999 - i; j = j + 1)
+        {
+            if (a[j] > a[j + 1])
+            {
+                int t = a[j];
+                a[j] = a[j + 1];
+                a[j + 1] = t;
+            }
+        }
+    }
+
+    int sum = 0;
+    for (int i = 0; i < 5000; i = i + 1)
+    {
+        sum = sum + a[i] - i;
+    }
+    printf("%i\n", a[0]);
+    printf("%i\n", a[4999]);
+    printf("%i\n", sum);
+    return 0;
+}
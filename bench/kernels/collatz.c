@@ -0,0 +1,32 @@
+#include <stdio.h>
+
+int main()
+{
+    int longest = 0;
+    int start = 0;
+    for (int n = 1; n < 300000; n = n + 1)
+    {
+        long x = n;
+        int steps = 0;
+        while (x != 1)
+        {
+            if (x - x / 2 * 2 == 0)
+            {
+                x = x / 2;
+            }
+            else
+            {
+                x = 3 * x + 1;
+            }
+            steps = steps + 1;
+        }
+        if (steps > longest)
+        {
+            longest = steps;
+            start = n;
+        }
+    }
+    printf("%i\n", start);
+    printf("%i\n", longest);
+    return 0;
+}
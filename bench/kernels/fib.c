@@ -0,0 +1,18 @@
+#include <stdio.h>
+
+int fib(int n)
+{
+    if (n < 2)
+    {
+        return n;
+    }
+    int a = fib(n - 1);
+    int b = fib(n - 2);
+    return a + b;
+}
+
+int main()
+{
+    printf("%i\n", fib(32));
+    return 0;
+}
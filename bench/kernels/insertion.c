@@ -0,0 +1,53 @@
+#include <stdio.h>
+
+int main()
+{
+    int a[8000];
+    int x = 1;
+    for (int i = 0; i < 8000; i = i + 1)
+    {
+        x = x + 7919;
+        if (x >= 10007)
+        {
+            x = x - 10007;
+        }
+        a[i] = x;
+    }
+
+    for (int i = 1; i < 8000; i = i + 1)
+    {
+        int key = a[i];
+        int j = i - 1;
+        int moving = 1;
+        while (moving == 1)
+        {
+            if (j < 0)
+            {
+                moving = 0;
+            }
+            else
+            {
+                if (a[j] > key)
+                {
+                    a[j + 1] = a[j];
+                    j = j - 1;
+                }
+                else
+                {
+                    moving = 0;
+                }
+            }
+        }
+        a[j + 1] = key;
+    }
+
+    int sum = 0;
+    for (int i = 0; i < 8000; i = i + 1)
+    {
+        sum = sum + a[i] - i;
+    }
+    printf("%i\n", a[0]);
+    printf("%i\n", a[7999]);
+    printf("%i\n", sum);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+int main()
+{
+    int a[16384];
+    int b[16384];
+    int c[16384];
+    int x = 1;
+    for (int i = 0; i < 16384; i = i + 1)
+    {
+        x = x + 7919;
+        if (x >= 10007)
+        {
+            x = x - 10007;
+        }
+        a[i] = x - 5003;
+        b[i] = 5003 - x;
+    }
+
+    for (int i = 0; i < 128; i = i + 1)
+    {
+        for (int j = 0; j < 128; j = j + 1)
+        {
+            int sum = 0;
+            for (int k = 0; k < 128; k = k + 1)
+            {
+                sum = sum + a[i * 128 + k] * b[k * 128 + j];
+            }
+            c[i * 128 + j] = sum;
+        }
+    }
+
+    int check = 0;
+    for (int i = 0; i < 16384; i = i + 1)
+    {
+        check = check + c[i] - check / 3;
+    }
+    printf("%i\n", c[0]);
+    printf("%i\n", c[16383]);
+    printf("%i\n", check);
+    return 0;
+}
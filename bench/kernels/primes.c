@@ -0,0 +1,28 @@
+#include <stdio.h>
+
+int prime(int n)
+{
+    for (int d = 2; d * d <= n; d = d + 1)
+    {
+        if (n - n / d * d == 0)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main()
+{
+    int count = 0;
+    for (int n = 2; n < 200000; n = n + 1)
+    {
+        int p = prime(n);
+        if (p)
+        {
+            count = count + 1;
+        }
+    }
+    printf("%i\n", count);
+    return 0;
+}
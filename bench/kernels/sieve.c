@@ -0,0 +1,28 @@
+#include <stdio.h>
+
+int main()
+{
+    int composite[500000];
+    int count = 0;
+    for (int round = 0; round < 20; round = round + 1)
+    {
+        for (int i = 0; i < 500000; i = i + 1)
+        {
+            composite[i] = 0;
+        }
+        count = 0;
+        for (int i = 2; i < 500000; i = i + 1)
+        {
+            if (composite[i] == 0)
+            {
+                count = count + 1;
+                for (int j = i + i; j < 500000; j = j + i)
+                {
+                    composite[j] = 1;
+                }
+            }
+        }
+    }
+    printf("%i\n", count);
+    return 0;
+}
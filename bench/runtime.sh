@@ -0,0 +1,94 @@
+#!/bin/sh
+# Generated code runtime benchmark.
+#
+#   bench/runtime.sh [kernel ...]
+#
+# Every kernel in bench/kernels comes as a .hend program and a C program that
+# does the same work. The hend version goes through the usual pipeline
+# (compiler, nasm, gcc -no-pie), or with BACKEND=object straight from the
+# compiler's own object (compiler -c, gcc -no-pie), and the C version is
+# built at -O0 and -O2.
+# Each binary runs RUNS times and the fastest run is kept. The hend output has
+# to match the C output for a kernel to count; otherwise its row reports why
+# it failed. The ratios are hend time over C time, so lower is better and 1.00
+# means parity.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${BENCH_DIR:-/tmp/hend-bench}/runtime
+RUNS=${RUNS:-3}
+BACKEND=${BACKEND:-nasm}
+
+mkdir -p "$OUT"
+if [ -z "$COMPILER" ]; then
+    COMPILER="$OUT/compiler"
+    (cd "$ROOT" && gcc -O2 -w -o "$COMPILER" lex.yy.c parser.tab.c)
+fi
+
+# Compiles $1 to $2.o in $OUT with the chosen backend.
+assemble() {
+    if [ "$BACKEND" = object ]; then
+        "$COMPILER" -c -i "$ROOT/bench/kernels/$1.hend" > "$OUT/$1.log" 2>&1 \
+            && ! grep -q "error\|ran out of registers" "$OUT/$1.log" \
+            && mv assembly.o "$1.o"
+    else
+        "$COMPILER" -i "$ROOT/bench/kernels/$1.hend" > "$OUT/$1.log" 2>&1 \
+            && ! grep -q "error\|ran out of registers" "$OUT/$1.log" \
+            && nasm -f elf64 assembly.asm -o "$1.o"
+    fi
+}
+
+# Prints the best wall time of RUNS runs in milliseconds, leaving the output
+# of the last run in $OUT/$2.out.
+best() {
+    fastest=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        if ! "$1" > "$OUT/$2.out" 2>&1; then
+            echo crashed
+            return
+        fi
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$fastest" ] || [ "$ms" -lt "$fastest" ]; then
+            fastest=$ms
+        fi
+        i=$((i + 1))
+    done
+    echo "$fastest"
+}
+
+ratio() {
+    awk -v a="$1" -v b="$2" 'BEGIN { if (b > 0) printf "%.2f", a / b; else print "-" }'
+}
+
+KERNELS=${*:-$(cd "$ROOT/bench/kernels" && ls *.hend | sed 's/\.hend$//')}
+
+printf "%-10s %10s %10s %10s %8s %8s  %s\n" kernel "hend ms" "-O0 ms" "-O2 ms" "vs -O0" "vs -O2" status
+for kernel in $KERNELS; do
+    gcc -O0 -o "$OUT/$kernel-O0" "$ROOT/bench/kernels/$kernel.c"
+    gcc -O2 -o "$OUT/$kernel-O2" "$ROOT/bench/kernels/$kernel.c"
+    o0=$(best "$OUT/$kernel-O0" "$kernel-O0")
+    o2=$(best "$OUT/$kernel-O2" "$kernel-O2")
+
+    status=ok
+    if ! (cd "$OUT" && assemble "$kernel" && gcc -no-pie -o "$kernel" "$kernel.o") > /dev/null 2>&1; then
+        status="compile failed"
+    else
+        hend=$(best "$OUT/$kernel" "$kernel")
+        if [ "$hend" = crashed ]; then
+            status=crashed
+        elif ! cmp -s "$OUT/$kernel.out" "$OUT/$kernel-O0.out"; then
+            status="wrong output"
+        fi
+    fi
+
+    if [ "$status" = ok ]; then
+        printf "%-10s %10s %10s %10s %8s %8s  %s\n" "$kernel" "$hend" "$o0" "$o2" \
+            "$(ratio "$hend" "$o0")" "$(ratio "$hend" "$o2")" "$status"
+    else
+        printf "%-10s %10s %10s %10s %8s %8s  %s\n" "$kernel" - "$o0" "$o2" - - "$status"
+    fi
+done
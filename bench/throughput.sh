@@ -0,0 +1,102 @@
+#!/bin/sh
+# Compiler throughput benchmark.
+#
+#   bench/throughput.sh [functions|statements|depth|nesting|identifiers ...]
+#
+# Grows one dimension of the generated program at a time (all of them by
+# default) while holding the rest at gen's defaults. Every size is compiled
+# RUNS times with -ftime-report and the fastest run is kept. Each row gives
+# lines/sec, the per-phase times and peak RSS, plus the scaling exponent
+# against the previous size: log(time ratio) / log(node ratio). A linear
+# compiler stays near 1; anything above 1.5 is flagged as superlinear.
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${BENCH_DIR:-/tmp/hend-bench}
+RUNS=${RUNS:-3}
+
+mkdir -p "$OUT"
+gcc -O2 -o "$OUT/gen" "$ROOT/bench/gen.c"
+if [ -z "$COMPILER" ]; then
+    COMPILER="$OUT/compiler"
+    (cd "$ROOT" && gcc -O2 -w -o "$COMPILER" lex.yy.c parser.tab.c)
+fi
+
+steps() {
+    case $1 in
+    functions) printf "%s " -f 8 16 32 64 128 256 512 ;;
+    statements) printf "%s " -s 32 64 128 256 512 1024 2048 ;;
+    # Every level doubles the expression and keeps one more value live; past
+    # the allocatable registers the allocator spills the rest to the stack.
+    depth) printf "%s " -d 0 1 2 3 4 5 6 ;;
+    nesting) printf "%s " -n 1 2 4 8 16 32 64 ;;
+    identifiers) printf "%s " -v 8 16 32 64 128 256 512 ;;
+    *) echo "unknown dimension $1" >&2; exit 1 ;;
+    esac
+}
+
+run() {
+    best=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        (cd "$OUT" && "$COMPILER" -ftime-report -i "$1" > "$OUT/stdout" 2> "$OUT/report")
+        if grep -q "error\|ran out of registers" "$OUT/stdout" "$OUT/report"; then
+            echo fail
+            return
+        fi
+        total=$(awk '$1 == "total" { print $2 }' "$OUT/report")
+        if [ -z "$best" ] || awk "BEGIN { exit !($total < $best) }"; then
+            best=$total
+            cp "$OUT/report" "$OUT/best"
+        fi
+        i=$((i + 1))
+    done
+    echo ok
+}
+
+DIMENSIONS=${*:-functions statements depth nesting identifiers}
+
+for dimension in $DIMENSIONS; do
+    set -- $(steps "$dimension")
+    flag=$1
+    shift
+
+    echo "== $dimension"
+    printf "%8s %9s %9s %12s %8s %8s %8s %8s %8s %8s %8s %9s %10s\n" \
+        size lines nodes "lines/s" lex parse resolve check fold codegen emit "rss kb" exponent
+
+    previous=""
+    for size in "$@"; do
+        source="$OUT/$dimension-$size.hend"
+        "$OUT/gen" "$flag" "$size" > "$source"
+        lines=$(wc -l < "$source")
+
+        if [ "$(run "$source")" = fail ]; then
+            printf "%8s %9s %s\n" "$size" "$lines" "compile failed"
+            previous=""
+            continue
+        fi
+
+        row=$(awk -v size="$size" -v lines="$lines" -v previous="$previous" '
+            { ms[$1] = $2; nodes[$1] = $6; rss[$1] = $5 }
+            END {
+                total = ms["total"]
+                rate = total > 0 ? lines / (total / 1000) : 0
+                exponent = "-"
+                split(previous, p, " ")
+                if (previous != "" && p[1] > 0 && p[2] > 0 && nodes["total"] > p[2] && total > 0) {
+                    e = log(total / p[1]) / log(nodes["total"] / p[2])
+                    exponent = sprintf("%.2f%s", e, e > 1.5 ? " superlinear" : "")
+                }
+                printf "%8s %9d %9d %12.0f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %9d %10s|%s %s\n",
+                    size, lines, nodes["total"], rate, ms["lex"], ms["parse"], ms["resolve"],
+                    ms["typecheck"], ms["fold"], ms["codegen"], ms["emit"], rss["total"], exponent,
+                    total, nodes["total"]
+            }' "$OUT/best")
+
+        echo "${row%|*}"
+        previous=${row##*|}
+    done
+    echo
+done
@@ -0,0 +1,213 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "hend.h"
+#include "AST/Stream.c"
+
+// hendc
+//
+// Stands in for ./compiler when a compile server is running: it takes the
+// compiler's flags for one unit (-m, -ftime-report, -c, -j, --cache and one
+// -i), sends them and the source to the server and writes the same files and
+// messages the compiler would have. What only the compiler itself can do,
+// --run, -I and programs of several files, is refused with an error. The
+// socket is HEND_SOCKET unless the environment variable of the same name
+// says otherwise.
+//
+//   gcc -O2 -o hendc client.c
+//   ./compiler --daemon &
+//   ./hendc < code.hend
+
+char * read_all(FILE * in, size_t * length)
+{
+    size_t capacity = 1 << 16;
+    size_t n = 0;
+    char * data = malloc(capacity);
+    if (!data) return 0;
+
+    size_t got;
+    while ((got = fread(data + n, 1, capacity - n, in)) > 0)
+    {
+        n += got;
+        if (n == capacity)
+        {
+            capacity *= 2;
+            char * grown = realloc(data, capacity);
+            if (!grown)
+            {
+                free(data);
+                return 0;
+            }
+            data = grown;
+        }
+    }
+
+    *length = n;
+    return data;
+}
+
+int write_file(const char * path, const char * data, size_t length)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    int failed = stream_write(fd, data, length);
+    return close(fd) || failed;
+}
+
+int main(int argc, char ** argv)
+{
+    hend_request request = { HEND_PROTOCOL_MAGIC };
+    const char * input = 0;
+    const char * cache = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-m"))
+        {
+            request.memory_report = 1;
+        }
+        else if (!strcmp(argv[i], "-ftime-report"))
+        {
+            request.time_report = HEND_REPORT_TEXT;
+        }
+        else if (!strcmp(argv[i], "-ftime-report=json"))
+        {
+            request.time_report = HEND_REPORT_JSON;
+        }
+        else if (!strcmp(argv[i], "-c"))
+        {
+            request.object = 1;
+        }
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+        {
+            if (input)
+            {
+                printf("error: hendc compiles one file; use ./compiler for a program of several\n");
+                return 1;
+            }
+            input = argv[++i];
+        }
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            request.jobs = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--cache") && i + 1 < argc)
+        {
+            cache = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--run") || !strcmp(argv[i], "-I") || !strcmp(argv[i], "--daemon"))
+        {
+            printf("error: hendc cannot take %s; use ./compiler\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // The server has a working directory of its own, so a relative cache
+    // directory is made absolute here.
+    char directory[4096];
+    if (cache)
+    {
+        directory[0] = '\0';
+        if (cache[0] != '/' && !getcwd(directory, sizeof(directory) - 1))
+        {
+            printf("error: could not find the working directory\n");
+            return 1;
+        }
+        size_t used = strlen(directory);
+        if (used)
+        {
+            directory[used++] = '/';
+        }
+        if (used + strlen(cache) >= sizeof(directory))
+        {
+            printf("error: the cache directory's path is too long\n");
+            return 1;
+        }
+        strcpy(directory + used, cache);
+        request.cache_length = strlen(directory);
+    }
+
+    FILE * in = input ? fopen(input, "rb") : stdin;
+    size_t length = 0;
+    char * source = in ? read_all(in, &length) : 0;
+    if (!source)
+    {
+        printf("error: could not read %s\n", input ? input : "stdin");
+        return 1;
+    }
+    if (input)
+    {
+        fclose(in);
+    }
+    request.length = length;
+
+    const char * path = getenv("HEND_SOCKET");
+    if (!path) path = HEND_SOCKET;
+
+    struct sockaddr_un address = { 0 };
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)))
+    {
+        printf("error: no compile server on %s\n", path);
+        return 1;
+    }
+
+    hend_response response;
+    if (stream_write(fd, &request, sizeof(request)) || stream_write(fd, directory, request.cache_length)
+        || stream_write(fd, source, length)
+        || stream_read(fd, &response, sizeof(response)) || response.magic != HEND_PROTOCOL_MAGIC)
+    {
+        printf("error: the compile server did not answer\n");
+        return 1;
+    }
+    free(source);
+
+    size_t total = response.assembly_length + response.object_length
+        + response.diagnostics_length + response.report_length;
+    char * body = malloc(total ? total : 1);
+    if (!body || stream_read(fd, body, total))
+    {
+        printf("error: the compile server did not answer\n");
+        return 1;
+    }
+    close(fd);
+
+    char * assembly = body;
+    char * object = assembly + response.assembly_length;
+    char * diagnostics = object + response.object_length;
+    char * report = diagnostics + response.diagnostics_length;
+
+    fwrite(diagnostics, 1, response.diagnostics_length, stdout);
+    if (request.object)
+    {
+        if (!response.errors && write_file("assembly.o", object, response.object_length))
+        {
+            printf("error: could not write assembly.o\n");
+        }
+    }
+    else if (write_file("assembly.asm", assembly, response.assembly_length))
+    {
+        printf("error: could not write assembly.asm\n");
+    }
+    fwrite(report, 1, response.report_length, stderr);
+    free(body);
+
+    if (response.errors)
+    {
+        printf("********************Build Succesfull!***********************\n");
+    }
+    else
+    {
+        printf("*********************Build Succesfull!***********************\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+#ifndef HEND_H
+#define HEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// hend
+//
+// The compiler as a library: source text in, assembly text or an ELF64
+// relocatable object out. Each call
+// compiles one unit in a context of its own and keeps no state between
+// calls, so a process can compile any number of units, from any number of
+// threads. Build with -DHEND_LIBRARY to leave out the command line driver.
+
+typedef enum
+{
+    HEND_REPORT_NONE,
+    HEND_REPORT_TEXT,
+    HEND_REPORT_JSON
+} hend_report_t;
+
+typedef struct hend_options
+{
+    // Per phase time, allocation and output report (-ftime-report).
+    hend_report_t time_report;
+
+    // Per phase arena usage report (-m).
+    int memory_report;
+
+    // The source is writable and followed by two NUL bytes, so it can be
+    // scanned where it is instead of being copied first.
+    int in_place;
+
+    // Encode straight to an object instead of writing NASM source (-c).
+    int object;
+
+    // Directory that keeps each function's code between compiles, so an
+    // unchanged function is not compiled again (--cache DIR); null for none.
+    const char * cache;
+
+    // Directory of module interfaces (-I DIR): every module compiled leaves
+    // its pub declarations there as name.hmi, and a module that is included
+    // but not compiled is read from there, its code to be linked in from
+    // the unit it was compiled in. Null for none.
+    const char * interfaces;
+
+    // Threads for the files of a program and for generating a unit's
+    // functions (-j); 0 for one per processor.
+    int jobs;
+} hend_options;
+
+typedef struct hend_output
+{
+    // NASM source for the unit; empty when an object was asked for.
+    char * assembly;
+    size_t assembly_length;
+
+    // The ELF64 relocatable object, when asked for.
+    char * object;
+    size_t object_length;
+
+    // Error messages, one per line.
+    char * diagnostics;
+    size_t diagnostics_length;
+
+    // The requested reports, if any.
+    char * report;
+    size_t report_length;
+
+    int errors;
+} hend_output;
+
+// Compiles len bytes of src. Options may be null. Returns 0 when the unit
+// compiled cleanly; output is filled in either way and must be released
+// with hend_output_release().
+int hend_compile(const char * src, size_t len, const hend_options * options, hend_output * output);
+
+void hend_output_release(hend_output * output);
+
+// Compiles a program made of several files, one module per file, into one
+// output. `mod name;` names a file's module (it is named after the file
+// otherwise), `include name;` makes another module's pub declarations
+// visible in it. Files are parsed, resolved and checked on a pool of
+// threads; diagnostics are prefixed with the file they belong to.
+int hend_compile_files(const char * const * paths, int count, const hend_options * options, hend_output * output);
+
+// Loads an object from hend_compile() into this process and runs its main.
+// The program's exit() returns here instead of ending the process. Returns
+// 0 and sets status to the program's exit status, or -1 if the object could
+// not be loaded.
+int hend_run(const char * object, size_t length, int * status);
+
+// A session keeps what compiles can share warm between them: interned names,
+// canonical types, the scope table's storage and an arena chunk. A session
+// compiles one unit at a time; use one per thread.
+typedef struct hend_session hend_session;
+
+hend_session * hend_session_create(void);
+
+void hend_session_release(hend_session * session);
+
+// hend_compile() in the session's caches.
+int hend_session_compile(hend_session * session, const char * src, size_t len, const hend_options * options, hend_output * output);
+
+// Compile server
+//
+// compiler --daemon serves compiles over a Unix domain socket, one session
+// per worker thread. A client sends any number of requests on a connection
+// and gets one response back for each, in order.
+
+#define HEND_SOCKET "/tmp/hend.sock"
+#define HEND_PROTOCOL_MAGIC 0x646e6568
+
+// Followed by cache_length bytes of the cache directory, then length bytes
+// of source.
+typedef struct hend_request
+{
+    uint32_t magic;
+    uint32_t time_report;
+    uint32_t memory_report;
+    uint32_t object;
+    uint64_t length;
+
+    // -j; 0 leaves the unit's functions to one thread.
+    uint32_t jobs;
+
+    // --cache; 0 for none. The directory is an absolute path.
+    uint32_t cache_length;
+} hend_request;
+
+// Followed by the assembly, object, diagnostics and report, in that order.
+typedef struct hend_response
+{
+    uint32_t magic;
+    int32_t errors;
+    uint64_t assembly_length;
+    uint64_t object_length;
+    uint64_t diagnostics_length;
+    uint64_t report_length;
+} hend_response;
+
+// Serves compiles on path until the process is killed. Returns -1 if the
+// socket could not be set up.
+int hend_serve(const char * path, int workers);
+
+#endif
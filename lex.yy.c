@@ -545,8 +545,12 @@ char *yytext;
 #line 1 "lexer.l"
 #line 2 "lexer.l"
 #include "parser.tab.h" // Include the Bison-generated header file
-#line 549 "lex.yy.c"
-#line 550 "lex.yy.c"
+#include <stddef.h>
+
+const char * intern(const char * s, size_t length);
+const char * source_view(const char * text, size_t length);
+#line 553 "lex.yy.c"
+#line 554 "lex.yy.c"
 
 #define INITIAL 0
 
@@ -763,9 +767,9 @@ YY_DECL
 		}
 
 	{
-#line 5 "lexer.l"
+#line 9 "lexer.l"
 
-#line 769 "lex.yy.c"
+#line 773 "lex.yy.c"
 
 	while ( /*CONSTCOND*/1 )		/* loops until end-of-file is reached */
 		{
@@ -824,305 +828,305 @@ do_action:	/* This label is used only to access EOF actions. */
 
 case 1:
 YY_RULE_SETUP
-#line 6 "lexer.l"
+#line 10 "lexer.l"
 ;
 	YY_BREAK
 case 2:
 YY_RULE_SETUP
-#line 7 "lexer.l"
+#line 11 "lexer.l"
 { return POINTER; }
 	YY_BREAK
 case 3:
 YY_RULE_SETUP
-#line 8 "lexer.l"
-{ yylval.string_val = strdup(yytext); return STRING_VALUE; }
+#line 12 "lexer.l"
+{ yylval.view_val.text = source_view(yytext, yyleng); yylval.view_val.length = yyleng; return STRING_VALUE; }
 	YY_BREAK
 case 4:
 YY_RULE_SETUP
-#line 9 "lexer.l"
+#line 13 "lexer.l"
 { return STRING; } 
 	YY_BREAK
 case 5:
 YY_RULE_SETUP
-#line 10 "lexer.l"
+#line 14 "lexer.l"
 { return STRUCT; }
 	YY_BREAK
 case 6:
 YY_RULE_SETUP
-#line 11 "lexer.l"
+#line 15 "lexer.l"
 { return MODULE; }
 	YY_BREAK
 case 7:
 YY_RULE_SETUP
-#line 12 "lexer.l"
+#line 16 "lexer.l"
 { return PUBLIC; }
 	YY_BREAK
 case 8:
 YY_RULE_SETUP
-#line 13 "lexer.l"
+#line 17 "lexer.l"
 { return PRIVATE; }
 	YY_BREAK
 case 9:
 YY_RULE_SETUP
-#line 14 "lexer.l"
+#line 18 "lexer.l"
 { return FUNCTION; }
 	YY_BREAK
 case 10:
 YY_RULE_SETUP
-#line 15 "lexer.l"
+#line 19 "lexer.l"
 { return RETURN; }
 	YY_BREAK
 case 11:
 YY_RULE_SETUP
-#line 16 "lexer.l"
+#line 20 "lexer.l"
 { return EXTEND; }
 	YY_BREAK
 case 12:
 YY_RULE_SETUP
-#line 17 "lexer.l"
+#line 21 "lexer.l"
 { return REQUIREMENT; }
 	YY_BREAK
 case 13:
 YY_RULE_SETUP
-#line 18 "lexer.l"
+#line 22 "lexer.l"
 { return CONSTRUCTOR; }
 	YY_BREAK
 case 14:
 YY_RULE_SETUP
-#line 19 "lexer.l"
+#line 23 "lexer.l"
 { return VOID; }
 	YY_BREAK
 case 15:
 YY_RULE_SETUP
-#line 20 "lexer.l"
+#line 24 "lexer.l"
 { return OBJECT; }
 	YY_BREAK
 case 16:
 YY_RULE_SETUP
-#line 21 "lexer.l"
+#line 25 "lexer.l"
 { return INCLUDE; }
 	YY_BREAK
 case 17:
 YY_RULE_SETUP
-#line 22 "lexer.l"
+#line 26 "lexer.l"
 { return I1; }        
 	YY_BREAK
 case 18:
 YY_RULE_SETUP
-#line 23 "lexer.l"
+#line 27 "lexer.l"
 { return I2; }
 	YY_BREAK
 case 19:
 YY_RULE_SETUP
-#line 24 "lexer.l"
+#line 28 "lexer.l"
 { return I4; }
 	YY_BREAK
 case 20:
 YY_RULE_SETUP
-#line 25 "lexer.l"
+#line 29 "lexer.l"
 { return I8; }
 	YY_BREAK
 case 21:
 YY_RULE_SETUP
-#line 26 "lexer.l"
+#line 30 "lexer.l"
 { return UI1; }        
 	YY_BREAK
 case 22:
 YY_RULE_SETUP
-#line 27 "lexer.l"
+#line 31 "lexer.l"
 { return UI2; }
 	YY_BREAK
 case 23:
 YY_RULE_SETUP
-#line 28 "lexer.l"
+#line 32 "lexer.l"
 { return UI4; }
 	YY_BREAK
 case 24:
 YY_RULE_SETUP
-#line 29 "lexer.l"
+#line 33 "lexer.l"
 { return UI8; }
 	YY_BREAK
 case 25:
 YY_RULE_SETUP
-#line 30 "lexer.l"
+#line 34 "lexer.l"
 { return F4; }
 	YY_BREAK
 case 26:
 YY_RULE_SETUP
-#line 31 "lexer.l"
+#line 35 "lexer.l"
 { return F8; }
 	YY_BREAK
 case 27:
 YY_RULE_SETUP
-#line 32 "lexer.l"
+#line 36 "lexer.l"
 { return BOOLEAN; }
 	YY_BREAK
 case 28:
 YY_RULE_SETUP
-#line 33 "lexer.l"
+#line 37 "lexer.l"
 { return CHARACTER; }
 	YY_BREAK
 case 29:
 YY_RULE_SETUP
-#line 34 "lexer.l"
+#line 38 "lexer.l"
 { return FOR; }
 	YY_BREAK
 case 30:
 YY_RULE_SETUP
-#line 35 "lexer.l"
+#line 39 "lexer.l"
 { return IF; }
 	YY_BREAK
 case 31:
 YY_RULE_SETUP
-#line 36 "lexer.l"
+#line 40 "lexer.l"
 { return ELSE; }
 	YY_BREAK
 case 32:
 YY_RULE_SETUP
-#line 37 "lexer.l"
+#line 41 "lexer.l"
 { return WHILE; }
 	YY_BREAK
 case 33:
 YY_RULE_SETUP
-#line 38 "lexer.l"
+#line 42 "lexer.l"
 { return FALSE_; }
 	YY_BREAK
 case 34:
 YY_RULE_SETUP
-#line 39 "lexer.l"
+#line 43 "lexer.l"
 { return TRUE_; }
 	YY_BREAK
 case 35:
 YY_RULE_SETUP
-#line 40 "lexer.l"
+#line 44 "lexer.l"
 { yylval.int_val = atoi(yytext); return NUM; }
 	YY_BREAK
 case 36:
 YY_RULE_SETUP
-#line 41 "lexer.l"
-{ yylval.string_val = strdup(yytext); return IDENTIFIER; }
+#line 45 "lexer.l"
+{ yylval.string_val = (char *)intern(yytext, yyleng); return IDENTIFIER; }
 	YY_BREAK
 case 37:
 YY_RULE_SETUP
-#line 42 "lexer.l"
+#line 46 "lexer.l"
 { return EQUAL; }
 	YY_BREAK
 case 38:
 YY_RULE_SETUP
-#line 43 "lexer.l"
+#line 47 "lexer.l"
 { return GREATER; }
 	YY_BREAK
 case 39:
 YY_RULE_SETUP
-#line 44 "lexer.l"
+#line 48 "lexer.l"
 { return GREATER_EQUAL; }
 	YY_BREAK
 case 40:
 YY_RULE_SETUP
-#line 45 "lexer.l"
+#line 49 "lexer.l"
 { return LESS; }
 	YY_BREAK
 case 41:
 YY_RULE_SETUP
-#line 46 "lexer.l"
+#line 50 "lexer.l"
 { return LESS_EQUAL; }
 	YY_BREAK
 case 42:
 YY_RULE_SETUP
-#line 47 "lexer.l"
+#line 51 "lexer.l"
 { return NOT_EQUAL; }
 	YY_BREAK
 case 43:
 YY_RULE_SETUP
-#line 48 "lexer.l"
+#line 52 "lexer.l"
 { return ERROR; }
 	YY_BREAK
 case 44:
 YY_RULE_SETUP
-#line 49 "lexer.l"
+#line 53 "lexer.l"
 { return PLUS; }
 	YY_BREAK
 case 45:
 YY_RULE_SETUP
-#line 50 "lexer.l"
+#line 54 "lexer.l"
 { return MINUS; }
 	YY_BREAK
 case 46:
 YY_RULE_SETUP
-#line 51 "lexer.l"
+#line 55 "lexer.l"
 { return TIMES; }
 	YY_BREAK
 case 47:
 YY_RULE_SETUP
-#line 52 "lexer.l"
+#line 56 "lexer.l"
 { return DIVIDE; }
 	YY_BREAK
 case 48:
 YY_RULE_SETUP
-#line 53 "lexer.l"
+#line 57 "lexer.l"
 { return SEMICOLON; }
 	YY_BREAK
 case 49:
 YY_RULE_SETUP
-#line 54 "lexer.l"
+#line 58 "lexer.l"
 { return ASSIGN; }
 	YY_BREAK
 case 50:
 YY_RULE_SETUP
-#line 55 "lexer.l"
+#line 59 "lexer.l"
 { return LPAREN; }
 	YY_BREAK
 case 51:
 YY_RULE_SETUP
-#line 56 "lexer.l"
+#line 60 "lexer.l"
 { return RPAREN; }
 	YY_BREAK
 case 52:
 YY_RULE_SETUP
-#line 57 "lexer.l"
+#line 61 "lexer.l"
 { return LCBRACKET; }
 	YY_BREAK
 case 53:
 YY_RULE_SETUP
-#line 58 "lexer.l"
+#line 62 "lexer.l"
 { return RCBRACKET; }
 	YY_BREAK
 case 54:
 YY_RULE_SETUP
-#line 59 "lexer.l"
+#line 63 "lexer.l"
 { return LBRACKET; }
 	YY_BREAK
 case 55:
 YY_RULE_SETUP
-#line 60 "lexer.l"
+#line 64 "lexer.l"
 { return RBRACKET; }
 	YY_BREAK
 case 56:
 YY_RULE_SETUP
-#line 61 "lexer.l"
+#line 65 "lexer.l"
 { return QUOTE; }
 	YY_BREAK
 case 57:
 YY_RULE_SETUP
-#line 62 "lexer.l"
+#line 66 "lexer.l"
 { return COMMA; }
 	YY_BREAK
 case 58:
 YY_RULE_SETUP
-#line 63 "lexer.l"
+#line 67 "lexer.l"
 ; // Ignore whitespace
 	YY_BREAK
 case 59:
 YY_RULE_SETUP
-#line 64 "lexer.l"
+#line 68 "lexer.l"
 { yyerror("Invalid character"); }
 	YY_BREAK
 case 60:
 YY_RULE_SETUP
-#line 65 "lexer.l"
+#line 69 "lexer.l"
 ECHO;
 	YY_BREAK
-#line 1126 "lex.yy.c"
+#line 1130 "lex.yy.c"
 case YY_STATE_EOF(INITIAL):
 	yyterminate();
 
@@ -2127,7 +2131,7 @@ void yyfree (void * ptr )
 
 #define YYTABLES_NAME "yytables"
 
-#line 65 "lexer.l"
+#line 69 "lexer.l"
 
 
 int yywrap() {
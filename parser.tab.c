@@ -69,15 +69,28 @@
 /* First part of user prologue.  */
 #line 1 "parser.y"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "hend.h"
 #include "AST/AbstractSyntaxTree.c"
 
-struct decl * code;
+struct yy_buffer_state * yy_scan_buffer(char * base, size_t size);
+void yy_delete_buffer(struct yy_buffer_state * buffer);
 
+int yylex(void);
+
+// Tokens are pulled one at a time by the parser, so lexing is timed here.
+int report_yylex()
+{
+    return report_lex(yylex);
+}
+#define yylex report_yylex
 
-#line 81 "parser.tab.c"
+
+#line 94 "parser.tab.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -164,21 +177,24 @@ enum yysymbol_kind_t
   YYSYMBOL_RBRACKET = 56,                  /* RBRACKET  */
   YYSYMBOL_STRING_VALUE = 57,              /* STRING_VALUE  */
   YYSYMBOL_STRING = 58,                    /* STRING  */
-  YYSYMBOL_YYACCEPT = 59,                  /* $accept  */
-  YYSYMBOL_program = 60,                   /* program  */
-  YYSYMBOL_declaration = 61,               /* declaration  */
-  YYSYMBOL_function_decl = 62,             /* function_decl  */
-  YYSYMBOL_param = 63,                     /* param  */
-  YYSYMBOL_exp = 64,                       /* exp  */
-  YYSYMBOL_decl = 65,                      /* decl  */
-  YYSYMBOL_arguments = 66,                 /* arguments  */
-  YYSYMBOL_type = 67,                      /* type  */
-  YYSYMBOL_type_specifier = 68,            /* type_specifier  */
-  YYSYMBOL_array_subscript = 69,           /* array_subscript  */
-  YYSYMBOL_statement = 70,                 /* statement  */
-  YYSYMBOL_if_statement = 71,              /* if_statement  */
-  YYSYMBOL_else_if_statement = 72,         /* else_if_statement  */
-  YYSYMBOL_ident = 73                      /* ident  */
+  YYSYMBOL_NAME = 59,                      /* NAME  */
+  YYSYMBOL_YYACCEPT = 60,                  /* $accept  */
+  YYSYMBOL_program = 61,                   /* program  */
+  YYSYMBOL_declaration = 62,               /* declaration  */
+  YYSYMBOL_function_decl = 63,             /* function_decl  */
+  YYSYMBOL_param = 64,                     /* param  */
+  YYSYMBOL_exp = 65,                       /* exp  */
+  YYSYMBOL_decl = 66,                      /* decl  */
+  YYSYMBOL_arguments = 67,                 /* arguments  */
+  YYSYMBOL_type = 68,                      /* type  */
+  YYSYMBOL_type_specifier = 69,            /* type_specifier  */
+  YYSYMBOL_array_subscript = 70,           /* array_subscript  */
+  YYSYMBOL_statement = 71,                 /* statement  */
+  YYSYMBOL_statement_list = 72,            /* statement_list  */
+  YYSYMBOL_if_statement = 73,              /* if_statement  */
+  YYSYMBOL_else_if_statement = 74,         /* else_if_statement  */
+  YYSYMBOL_else_statement = 75,            /* else_statement  */
+  YYSYMBOL_ident = 76                      /* ident  */
 };
 typedef enum yysymbol_kind_t yysymbol_kind_t;
 
@@ -504,21 +520,21 @@ union yyalloc
 #endif /* !YYCOPY_NEEDED */
 
 /* YYFINAL -- State number of the termination state.  */
-#define YYFINAL  28
+#define YYFINAL  3
 /* YYLAST -- Last index in YYTABLE.  */
-#define YYLAST   443
+#define YYLAST   522
 
 /* YYNTOKENS -- Number of terminals.  */
-#define YYNTOKENS  59
+#define YYNTOKENS  60
 /* YYNNTS -- Number of nonterminals.  */
-#define YYNNTS  15
+#define YYNNTS  17
 /* YYNRULES -- Number of rules.  */
-#define YYNRULES  67
+#define YYNRULES  76
 /* YYNSTATES -- Number of states.  */
-#define YYNSTATES  157
+#define YYNSTATES  170
 
 /* YYMAXUTOK -- Last valid token kind.  */
-#define YYMAXUTOK   313
+#define YYMAXUTOK   314
 
 
 /* YYTRANSLATE(TOKEN-NUM) -- Symbol number corresponding to TOKEN-NUM
@@ -563,20 +579,21 @@ static const yytype_int8 yytranslate[] =
       25,    26,    27,    28,    29,    30,    31,    32,    33,    34,
       35,    36,    37,    38,    39,    40,    41,    42,    43,    44,
       45,    46,    47,    48,    49,    50,    51,    52,    53,    54,
-      55,    56,    57,    58
+      55,    56,    57,    58,    59
 };
 
 #if YYDEBUG
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_uint8 yyrline[] =
 {
-       0,    49,    49,    50,    54,    55,    56,    57,    61,    65,
-      66,    67,    68,    69,    72,    73,    74,    75,    77,    78,
-      79,    80,    81,    82,    83,    84,    85,    86,    87,    88,
-      89,    90,    91,    92,    96,    97,   101,   102,   103,   107,
-     108,   109,   110,   111,   112,   113,   114,   115,   116,   120,
-     121,   122,   124,   125,   126,   129,   130,   131,   132,   133,
-     134,   135,   139,   143,   144,   145,   149,   150
+       0,    75,    75,    76,    82,    83,    84,    85,    86,    87,
+      88,    89,    90,    91,    92,    93,    97,   101,   102,   103,
+     104,   105,   109,   110,   112,   113,   114,   115,   116,   117,
+     118,   119,   120,   121,   122,   123,   124,   125,   126,   127,
+     128,   132,   133,   137,   138,   139,   143,   144,   145,   146,
+     147,   148,   149,   150,   151,   152,   156,   157,   158,   160,
+     161,   162,   165,   169,   170,   171,   172,   173,   174,   175,
+     179,   183,   184,   188,   189,   193,   194
 };
 #endif
 
@@ -600,10 +617,11 @@ static const char *const yytname[] =
   "CONSTRUCTOR", "VOID", "OBJECT", "INCLUDE", "NUM", "IDENTIFIER", "PLUS",
   "MINUS", "TIMES", "DIVIDE", "ASSIGN", "SEMICOLON", "FUNCTION", "LPAREN",
   "RPAREN", "LCBRACKET", "RCBRACKET", "PUBLIC", "PRIVATE", "LBRACKET",
-  "RBRACKET", "STRING_VALUE", "STRING", "$accept", "program",
+  "RBRACKET", "STRING_VALUE", "STRING", "NAME", "$accept", "program",
   "declaration", "function_decl", "param", "exp", "decl", "arguments",
-  "type", "type_specifier", "array_subscript", "statement", "if_statement",
-  "else_if_statement", "ident", YY_NULLPTR
+  "type", "type_specifier", "array_subscript", "statement",
+  "statement_list", "if_statement", "else_if_statement", "else_statement",
+  "ident", YY_NULLPTR
 };
 
 static const char *
@@ -613,12 +631,12 @@ yysymbol_name (yysymbol_kind_t yysymbol)
 }
 #endif
 
-#define YYPACT_NINF (-69)
+#define YYPACT_NINF (-58)
 
 #define yypact_value_is_default(Yyn) \
   ((Yyn) == YYPACT_NINF)
 
-#define YYTABLE_NINF (-68)
+#define YYTABLE_NINF (-57)
 
 #define yytable_value_is_error(Yyn) \
   0
@@ -627,22 +645,23 @@ yysymbol_name (yysymbol_kind_t yysymbol)
    STATE-NUM.  */
 static const yytype_int16 yypact[] =
 {
-     363,     2,     2,     2,     2,     2,     2,     2,   -54,   -26,
-       2,    17,   -69,   363,   -26,     2,   -69,   -22,   -69,   -69,
-     -69,   -69,   -69,   -69,   -69,   -20,   -28,   -69,   -69,   -69,
-     -39,   -69,   -12,   -32,   -31,   385,    57,   363,   -22,   -69,
-     -69,   -23,   -26,   -69,   -69,   -69,    19,    57,   -69,   274,
-     -43,   -69,   -69,   385,   -30,    -9,   118,    57,    57,    57,
-      57,    57,    57,    57,    57,    57,    57,   363,    57,    57,
-     -19,   385,    57,   -17,   -69,   370,   370,   370,   370,   370,
-     370,   370,   370,   370,   370,   -69,   370,   347,   -16,   161,
-     -69,   353,    20,    57,   -69,   -21,   -13,    13,    57,   280,
-     161,   -26,    11,   -69,    31,   385,   -69,    57,   385,    57,
-     296,   161,   -69,   -36,   -69,   -69,   200,    57,   217,   161,
-     -69,    57,   -69,    25,   302,    30,   -69,   325,   161,    57,
-     161,   -69,    12,   226,    18,    69,    34,   161,     8,   161,
-     161,   -69,    33,   161,   -69,    35,    57,    36,   161,   248,
-     -69,   -69,    39,   161,    40,    69,   -69
+       4,    51,   435,   -58,    -7,    -7,    -7,    -7,    -7,    -7,
+      16,    -7,    23,    14,    45,   464,   464,    -7,   -58,    45,
+      -7,   -58,    48,   -58,   -58,   -58,   -58,   -58,   -58,    53,
+     -58,    54,     3,    46,   -58,    45,   -58,    45,   -58,   -24,
+     -58,    69,    49,   -58,   -58,   -58,   -58,   -58,   -29,     3,
+     -58,   114,    56,   -12,   -19,    32,     3,   -58,    48,   -58,
+       3,   136,     3,     3,     3,     3,     3,     3,     3,     3,
+       3,     3,     3,   -58,     3,    66,    45,     3,   -58,     3,
+     -58,   259,   -58,   355,    73,   -58,   417,    67,    67,    67,
+      67,   417,   -58,    40,    40,   -58,   -58,   406,   -12,   -33,
+     267,   275,   -58,     3,   -58,    74,   -12,     3,   -58,   -58,
+     -58,   -58,   -58,   398,    75,    50,   -12,   -58,    77,    80,
+      82,     3,   283,   -58,    45,   -58,   -34,   -58,     3,   -12,
+       3,   328,   -58,    34,   184,     3,   193,   -58,     3,   -58,
+      81,   336,    83,   344,   -58,     3,   -58,   -58,    84,   202,
+      86,   -58,    96,   -58,   124,   -58,     5,   -58,    97,    99,
+     -58,   -58,     3,   101,   211,   -58,   100,   -58,   108,   -58
 };
 
 /* YYDEFACT[STATE-NUM] -- Default reduction number in state STATE-NUM.
@@ -650,36 +669,37 @@ static const yytype_int16 yypact[] =
    means the default is an error.  */
 static const yytype_int8 yydefact[] =
 {
-       2,    49,    49,    49,    49,    49,    49,    49,    66,     0,
-      49,     0,     3,     4,     0,    49,    51,    52,    47,    46,
-      42,    43,    44,    45,    40,     0,     0,    48,     1,     5,
-       0,    41,    53,     0,     0,     9,    14,     4,    52,    50,
-      67,     0,     0,    26,    25,    18,    17,    14,    19,     0,
-       0,     6,    54,    39,    10,     0,     0,    14,    14,    14,
-      14,    14,    14,    14,    14,    14,    14,     4,    14,    14,
-       0,     9,    14,     0,    15,    28,    30,    31,    32,    33,
-      29,    21,    22,    23,    24,     7,    20,    37,     0,    14,
-      12,    11,    16,    14,    27,     0,     0,     0,    14,     0,
-      14,     0,     0,    59,    49,     9,    38,    14,     0,    14,
-       0,    14,    58,     0,     8,    13,     0,    14,     0,    14,
-      57,    14,    34,     0,     0,     0,    56,     0,    14,    14,
-      14,    35,     0,     0,     0,    63,     0,    14,     0,    14,
-      14,    60,     0,    14,    62,     0,    14,     0,    14,     0,
-      65,    61,     0,    14,     0,    63,    64
+       4,     0,     3,     1,    56,    56,    56,    56,    56,    56,
+       0,    56,     0,    75,     0,     0,     0,    56,     5,     0,
+      56,    58,    59,    54,    53,    49,    50,    51,    52,     0,
+      47,     0,     0,     0,     8,     0,    11,     0,    55,     0,
+      48,    60,     0,    14,    15,    33,    32,    24,    75,     0,
+      25,     0,    23,    17,     0,     0,     0,     6,    59,    57,
+      43,     0,     0,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,     0,    76,     0,     0,     0,     0,     9,     0,
+      12,     0,    61,    44,     0,    22,    35,    37,    38,    39,
+      40,    36,    30,    27,    28,    29,    31,    26,    46,    18,
+       0,     0,     7,    43,    34,     0,    17,     0,    10,    13,
+      45,    63,    20,    19,     0,    62,    17,    16,     0,     0,
+       0,     0,     0,    66,     0,    67,    23,    21,     0,     0,
+       0,     0,    65,     0,     0,     0,     0,    64,     0,    41,
+       0,     0,     0,     0,    63,     0,    63,    42,     0,     0,
+       0,    71,     0,    68,    73,    63,     0,    70,     0,     0,
+      63,    69,     0,     0,     0,    74,     0,    63,     0,    72
 };
 
 /* YYPGOTO[NTERM-NUM].  */
 static const yytype_int16 yypgoto[] =
 {
-     -69,   -69,   -11,   -69,   -67,   -14,   -68,    -2,    83,   426,
-      56,    27,   -69,   -56,     0
+     -58,   -58,   -58,    78,   -57,   -32,    33,    61,    -1,   491,
+     107,     6,   -58,   -58,   -58,   -58,    39
 };
 
 /* YYDEFGOTO[NTERM-NUM].  */
 static const yytype_uint8 yydefgoto[] =
 {
-       0,    11,    12,    13,    41,    99,   100,    88,   101,    31,
-      33,   102,   103,   139,    50
+       0,     1,     2,    18,    75,    83,   123,    84,    76,    40,
+      42,   114,   115,   125,   154,   157,    52
 };
 
 /* YYTABLE[YYPACT[STATE-NUM]] -- What to do in state STATE-NUM.  If
@@ -687,146 +707,165 @@ static const yytype_uint8 yydefgoto[] =
    number is the opposite.  If YYTABLE_NINF, syntax error.  */
 static const yytype_int16 yytable[] =
 {
-      15,    25,    29,    68,    90,    71,    69,    36,    37,    26,
-     121,   122,    16,    15,    30,     8,    72,    28,    32,   142,
-      34,    35,    49,    38,    39,    40,    51,    53,   107,   -66,
-     -67,    73,    89,    56,    94,    15,   108,    15,   115,    92,
-     117,    16,    54,    75,    76,    77,    78,    79,    80,    81,
-      82,    83,    84,    15,    86,    87,    85,    17,    91,   143,
-     -66,   -67,   109,   114,   135,   -66,   -67,    15,   -66,   -67,
-     137,    15,    43,    44,    55,   -67,   128,    68,   138,    87,
-      69,   130,   146,    14,   110,   140,    17,   148,   150,   104,
-     153,   106,   155,   116,    52,   118,    14,    45,    46,   156,
-     104,   113,     0,   124,     0,    15,    47,   127,    15,     0,
-       0,   104,     0,     0,    48,   133,     0,     0,    42,   104,
-      14,    57,    58,    59,    60,    61,    62,   112,   104,     0,
-     104,     0,   149,     0,     0,     0,    70,   104,   120,   104,
-     104,     0,     0,   104,     0,     0,   126,     0,   104,     0,
-      14,     0,     0,   104,    42,   132,     0,   134,     0,     0,
-      63,    64,    65,    66,   141,     0,   144,   145,    74,     0,
-     147,     0,    95,    96,    97,   151,    43,    44,     1,     2,
-     154,     3,     4,     5,     6,     0,     0,     0,    42,     0,
-       0,     0,     0,    98,     0,     0,     0,     0,     7,     0,
-       0,    45,    46,    57,    58,    59,    60,    61,    62,     0,
-      47,     0,     0,   -55,     0,     0,     0,     0,    48,    10,
-      57,    58,    59,    60,    61,    62,     0,     0,     0,    57,
-      58,    59,    60,    61,    62,     0,     0,     0,     0,     0,
-       0,     0,    63,    64,    65,    66,     0,     0,     0,     0,
-     123,    57,    58,    59,    60,    61,    62,     0,     0,    63,
-      64,    65,    66,     0,     0,     0,     0,   125,    63,    64,
-      65,    66,     0,     0,     0,     0,   136,    57,    58,    59,
-      60,    61,    62,    57,    58,    59,    60,    61,    62,     0,
-      63,    64,    65,    66,     0,     0,     0,     0,   152,    57,
-      58,    59,    60,    61,    62,    57,    58,    59,    60,    61,
-      62,     0,     0,     0,     0,     0,    63,    64,    65,    66,
-       0,    67,    63,    64,    65,    66,     0,   111,    57,    58,
-      59,    60,    61,    62,     0,     0,     0,     0,    63,    64,
-      65,    66,     0,   119,    63,    64,    65,    66,     0,   129,
-      57,    58,    59,    60,    61,    62,    57,    58,    59,    60,
-      61,    62,     0,     0,     0,     0,     0,    63,    64,    65,
-      66,     0,   131,    57,    58,    59,    60,    61,    62,     0,
-       1,     2,    93,     3,     4,     5,     6,     0,   105,    63,
-      64,    65,    66,     0,     0,    63,    64,    65,    66,     0,
-       7,     0,     1,     2,     8,     3,     4,     5,     6,     0,
-       0,     9,    63,    64,    65,    66,     0,     0,     0,     0,
-       0,    10,     7,     0,     0,     0,     8,    18,    19,    20,
-      21,    22,    23,    24,     0,     0,    27,     0,     0,     0,
-       0,     0,     0,    10
+      51,    19,   106,    21,    -2,     4,     5,   -56,     6,     7,
+       8,     9,    74,   107,    35,    37,   159,    61,    45,    46,
+      60,    22,    56,    57,    81,    11,    32,    77,    78,    13,
+      86,    87,    88,    89,    90,    91,    92,    93,    94,    95,
+      96,    20,    97,    47,    48,   100,    17,   101,    22,   112,
+      68,     3,    49,    33,    20,    20,   160,    29,    39,   127,
+      50,   118,   119,   120,    31,    45,    46,     4,     5,    32,
+       6,     7,     8,     9,    54,   113,    55,    68,    79,    80,
+     138,   139,   121,   122,    71,    72,    13,    11,    41,   131,
+      47,    48,    20,    34,    36,    53,   134,   105,   136,    49,
+      43,    44,    74,   141,    58,    59,   143,    50,    17,    69,
+      70,    71,    72,   149,   124,    99,    98,    62,    63,    64,
+      65,    66,    67,   104,    68,   111,   128,   117,   124,   129,
+     164,   130,   144,   156,   146,     0,   151,    20,   153,    62,
+      63,    64,    65,    66,    67,    20,    68,   155,   162,   161,
+     148,   167,   150,   165,   126,    20,    69,    70,    71,    72,
+     169,   158,   135,   133,   110,    82,   163,     0,    20,     0,
+      73,     0,     0,   168,     0,     0,     0,     0,    69,    70,
+      71,    72,     0,     0,     0,     0,    85,    62,    63,    64,
+      65,    66,    67,     0,    68,     0,    62,    63,    64,    65,
+      66,    67,     0,    68,     0,    62,    63,    64,    65,    66,
+      67,     0,    68,     0,    62,    63,    64,    65,    66,    67,
+       0,    68,     0,     0,     0,     0,    69,    70,    71,    72,
+       0,     0,     0,     0,   140,    69,    70,    71,    72,     0,
+       0,     0,     0,   142,    69,    70,    71,    72,     0,     0,
+       0,     0,   152,    69,    70,    71,    72,     0,     0,     0,
+       0,   166,    62,    63,    64,    65,    66,    67,     0,    68,
+      62,    63,    64,    65,    66,    67,     0,    68,    62,    63,
+      64,    65,    66,    67,     0,    68,    62,    63,    64,    65,
+      66,    67,     0,    68,     0,     0,     0,     0,     0,     0,
+       0,    69,    70,    71,    72,     0,   102,     0,     0,    69,
+      70,    71,    72,     0,   108,     0,     0,    69,    70,    71,
+      72,     0,   109,     0,     0,    69,    70,    71,    72,     0,
+     132,    62,    63,    64,    65,    66,    67,     0,    68,    62,
+      63,    64,    65,    66,    67,     0,    68,    62,    63,    64,
+      65,    66,    67,     0,    68,     0,     0,     0,    62,    63,
+      64,    65,    66,    67,     0,    68,     0,     0,     0,     0,
+      69,    70,    71,    72,     0,   137,     0,     0,    69,    70,
+      71,    72,     0,   145,     0,     0,    69,    70,    71,    72,
+     103,   147,     0,     0,     0,     0,     0,    69,    70,    71,
+      72,    62,    63,    64,    65,    66,    67,     0,    68,    62,
+      63,    64,    65,    66,    67,     0,    68,     0,     0,     0,
+       0,    63,    64,    65,    66,     0,     0,    68,     0,     0,
+       0,     0,     0,   116,     0,     0,     0,     0,     0,     0,
+      69,    70,    71,    72,     0,     0,     0,     0,    69,    70,
+      71,    72,     4,     5,     0,     6,     7,     8,     9,    69,
+      70,    71,    72,     0,     0,     0,    10,     0,     0,     0,
+       0,     0,    11,     0,    12,     0,    13,     0,     0,     0,
+       0,     4,     5,    14,     6,     7,     8,     9,    15,    16,
+       0,     0,     0,    17,     0,    23,    24,    25,    26,    27,
+      28,    11,    30,     0,     0,    13,     0,     0,    38,     0,
+       0,     0,    14,     0,     0,     0,     0,     0,     0,     0,
+       0,     0,    17
 };
 
 static const yytype_int16 yycheck[] =
 {
-       0,    55,    13,    46,    71,    35,    49,    46,    47,     9,
-      46,    47,    10,    13,    14,    41,    46,     0,    40,    11,
-      40,    49,    36,    35,    56,    56,    37,    50,    49,    10,
-      10,    40,    51,    47,    50,    35,    49,    37,   105,    56,
-     108,    10,    42,    57,    58,    59,    60,    61,    62,    63,
-      64,    65,    66,    53,    68,    69,    67,    55,    72,    51,
-      41,    41,    49,    52,    52,    46,    46,    67,    49,    49,
-      52,    71,    15,    16,    55,    55,    51,    46,     9,    93,
-      49,    51,    49,     0,    98,    51,    55,    52,    52,    89,
-      51,    93,    52,   107,    38,   109,    13,    40,    41,   155,
-     100,   101,    -1,   117,    -1,   105,    49,   121,   108,    -1,
-      -1,   111,    -1,    -1,    57,   129,    -1,    -1,    35,   119,
-      37,     3,     4,     5,     6,     7,     8,   100,   128,    -1,
-     130,    -1,   146,    -1,    -1,    -1,    53,   137,   111,   139,
-     140,    -1,    -1,   143,    -1,    -1,   119,    -1,   148,    -1,
-      67,    -1,    -1,   153,    71,   128,    -1,   130,    -1,    -1,
-      42,    43,    44,    45,   137,    -1,   139,   140,    50,    -1,
-     143,    -1,    11,    12,    13,   148,    15,    16,    17,    18,
-     153,    20,    21,    22,    23,    -1,    -1,    -1,   105,    -1,
-      -1,    -1,    -1,    32,    -1,    -1,    -1,    -1,    37,    -1,
-      -1,    40,    41,     3,     4,     5,     6,     7,     8,    -1,
-      49,    -1,    -1,    52,    -1,    -1,    -1,    -1,    57,    58,
-       3,     4,     5,     6,     7,     8,    -1,    -1,    -1,     3,
-       4,     5,     6,     7,     8,    -1,    -1,    -1,    -1,    -1,
-      -1,    -1,    42,    43,    44,    45,    -1,    -1,    -1,    -1,
-      50,     3,     4,     5,     6,     7,     8,    -1,    -1,    42,
-      43,    44,    45,    -1,    -1,    -1,    -1,    50,    42,    43,
+      32,     2,    35,    10,     0,    17,    18,    41,    20,    21,
+      22,    23,    46,    46,    15,    16,    11,    49,    15,    16,
+      49,    55,    46,    47,    56,    37,    55,    46,    47,    41,
+      62,    63,    64,    65,    66,    67,    68,    69,    70,    71,
+      72,     2,    74,    40,    41,    77,    58,    79,    55,   106,
+      10,     0,    49,    14,    15,    16,    51,    41,    19,   116,
+      57,    11,    12,    13,    41,    15,    16,    17,    18,    55,
+      20,    21,    22,    23,    35,   107,    37,    10,    46,    47,
+      46,    47,    32,   115,    44,    45,    41,    37,    40,   121,
+      40,    41,    53,    15,    16,    49,   128,    98,   130,    49,
+      47,    47,    46,   135,    35,    56,   138,    57,    58,    42,
+      43,    44,    45,   145,   115,    76,    50,     3,     4,     5,
+       6,     7,     8,    50,    10,    51,    49,    52,   129,    49,
+     162,    49,    51,     9,    51,    -1,    52,    98,    52,     3,
+       4,     5,     6,     7,     8,   106,    10,    51,    49,    52,
+     144,    51,   146,    52,   115,   116,    42,    43,    44,    45,
+      52,   155,   129,   124,   103,    58,   160,    -1,   129,    -1,
+      56,    -1,    -1,   167,    -1,    -1,    -1,    -1,    42,    43,
       44,    45,    -1,    -1,    -1,    -1,    50,     3,     4,     5,
-       6,     7,     8,     3,     4,     5,     6,     7,     8,    -1,
-      42,    43,    44,    45,    -1,    -1,    -1,    -1,    50,     3,
-       4,     5,     6,     7,     8,     3,     4,     5,     6,     7,
-       8,    -1,    -1,    -1,    -1,    -1,    42,    43,    44,    45,
-      -1,    47,    42,    43,    44,    45,    -1,    47,     3,     4,
-       5,     6,     7,     8,    -1,    -1,    -1,    -1,    42,    43,
-      44,    45,    -1,    47,    42,    43,    44,    45,    -1,    47,
-       3,     4,     5,     6,     7,     8,     3,     4,     5,     6,
-       7,     8,    -1,    -1,    -1,    -1,    -1,    42,    43,    44,
-      45,    -1,    47,     3,     4,     5,     6,     7,     8,    -1,
-      17,    18,    35,    20,    21,    22,    23,    -1,    35,    42,
-      43,    44,    45,    -1,    -1,    42,    43,    44,    45,    -1,
-      37,    -1,    17,    18,    41,    20,    21,    22,    23,    -1,
-      -1,    48,    42,    43,    44,    45,    -1,    -1,    -1,    -1,
-      -1,    58,    37,    -1,    -1,    -1,    41,     1,     2,     3,
-       4,     5,     6,     7,    -1,    -1,    10,    -1,    -1,    -1,
-      -1,    -1,    -1,    58
+       6,     7,     8,    -1,    10,    -1,     3,     4,     5,     6,
+       7,     8,    -1,    10,    -1,     3,     4,     5,     6,     7,
+       8,    -1,    10,    -1,     3,     4,     5,     6,     7,     8,
+      -1,    10,    -1,    -1,    -1,    -1,    42,    43,    44,    45,
+      -1,    -1,    -1,    -1,    50,    42,    43,    44,    45,    -1,
+      -1,    -1,    -1,    50,    42,    43,    44,    45,    -1,    -1,
+      -1,    -1,    50,    42,    43,    44,    45,    -1,    -1,    -1,
+      -1,    50,     3,     4,     5,     6,     7,     8,    -1,    10,
+       3,     4,     5,     6,     7,     8,    -1,    10,     3,     4,
+       5,     6,     7,     8,    -1,    10,     3,     4,     5,     6,
+       7,     8,    -1,    10,    -1,    -1,    -1,    -1,    -1,    -1,
+      -1,    42,    43,    44,    45,    -1,    47,    -1,    -1,    42,
+      43,    44,    45,    -1,    47,    -1,    -1,    42,    43,    44,
+      45,    -1,    47,    -1,    -1,    42,    43,    44,    45,    -1,
+      47,     3,     4,     5,     6,     7,     8,    -1,    10,     3,
+       4,     5,     6,     7,     8,    -1,    10,     3,     4,     5,
+       6,     7,     8,    -1,    10,    -1,    -1,    -1,     3,     4,
+       5,     6,     7,     8,    -1,    10,    -1,    -1,    -1,    -1,
+      42,    43,    44,    45,    -1,    47,    -1,    -1,    42,    43,
+      44,    45,    -1,    47,    -1,    -1,    42,    43,    44,    45,
+      35,    47,    -1,    -1,    -1,    -1,    -1,    42,    43,    44,
+      45,     3,     4,     5,     6,     7,     8,    -1,    10,     3,
+       4,     5,     6,     7,     8,    -1,    10,    -1,    -1,    -1,
+      -1,     4,     5,     6,     7,    -1,    -1,    10,    -1,    -1,
+      -1,    -1,    -1,    35,    -1,    -1,    -1,    -1,    -1,    -1,
+      42,    43,    44,    45,    -1,    -1,    -1,    -1,    42,    43,
+      44,    45,    17,    18,    -1,    20,    21,    22,    23,    42,
+      43,    44,    45,    -1,    -1,    -1,    31,    -1,    -1,    -1,
+      -1,    -1,    37,    -1,    39,    -1,    41,    -1,    -1,    -1,
+      -1,    17,    18,    48,    20,    21,    22,    23,    53,    54,
+      -1,    -1,    -1,    58,    -1,     4,     5,     6,     7,     8,
+       9,    37,    11,    -1,    -1,    41,    -1,    -1,    17,    -1,
+      -1,    -1,    48,    -1,    -1,    -1,    -1,    -1,    -1,    -1,
+      -1,    -1,    58
 };
 
 /* YYSTOS[STATE-NUM] -- The symbol kind of the accessing symbol of
    state STATE-NUM.  */
 static const yytype_int8 yystos[] =
 {
-       0,    17,    18,    20,    21,    22,    23,    37,    41,    48,
-      58,    60,    61,    62,    67,    73,    10,    55,    68,    68,
-      68,    68,    68,    68,    68,    55,    73,    68,     0,    61,
-      73,    68,    40,    69,    40,    49,    46,    47,    35,    56,
-      56,    63,    67,    15,    16,    40,    41,    49,    57,    64,
-      73,    61,    69,    50,    73,    55,    64,     3,     4,     5,
-       6,     7,     8,    42,    43,    44,    45,    47,    46,    49,
-      67,    35,    46,    40,    50,    64,    64,    64,    64,    64,
-      64,    64,    64,    64,    64,    61,    64,    64,    66,    51,
-      63,    64,    56,    35,    50,    11,    12,    13,    32,    64,
-      65,    67,    70,    71,    73,    35,    66,    49,    49,    49,
-      64,    47,    70,    73,    52,    63,    64,    65,    64,    47,
-      70,    46,    47,    50,    64,    50,    70,    64,    51,    47,
-      51,    47,    70,    64,    70,    52,    50,    52,     9,    72,
-      51,    70,    11,    51,    70,    70,    49,    70,    52,    64,
-      52,    70,    50,    51,    70,    52,    72
+       0,    61,    62,     0,    17,    18,    20,    21,    22,    23,
+      31,    37,    39,    41,    48,    53,    54,    58,    63,    68,
+      76,    10,    55,    69,    69,    69,    69,    69,    69,    41,
+      69,    41,    55,    76,    63,    68,    63,    68,    69,    76,
+      69,    40,    70,    47,    47,    15,    16,    40,    41,    49,
+      57,    65,    76,    49,    76,    76,    46,    47,    35,    56,
+      49,    65,     3,     4,     5,     6,     7,     8,    10,    42,
+      43,    44,    45,    56,    46,    64,    68,    46,    47,    46,
+      47,    65,    70,    65,    67,    50,    65,    65,    65,    65,
+      65,    65,    65,    65,    65,    65,    65,    65,    50,    76,
+      65,    65,    47,    35,    50,    68,    35,    46,    47,    47,
+      67,    51,    64,    65,    71,    72,    35,    52,    11,    12,
+      13,    32,    65,    66,    68,    73,    76,    64,    49,    49,
+      49,    65,    47,    76,    65,    66,    65,    47,    46,    47,
+      50,    65,    50,    65,    51,    47,    51,    47,    71,    65,
+      71,    52,    50,    52,    74,    51,     9,    75,    71,    11,
+      51,    52,    49,    71,    65,    52,    50,    51,    71,    52
 };
 
 /* YYR1[RULE-NUM] -- Symbol kind of the left-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr1[] =
 {
-       0,    59,    60,    60,    61,    61,    61,    61,    62,    63,
-      63,    63,    63,    63,    64,    64,    64,    64,    64,    64,
-      64,    64,    64,    64,    64,    64,    64,    64,    64,    64,
-      64,    64,    64,    64,    65,    65,    66,    66,    66,    67,
-      67,    67,    67,    67,    67,    67,    67,    67,    67,    68,
-      68,    68,    69,    69,    69,    70,    70,    70,    70,    70,
-      70,    70,    71,    72,    72,    72,    73,    73
+       0,    60,    61,    61,    62,    62,    62,    62,    62,    62,
+      62,    62,    62,    62,    62,    62,    63,    64,    64,    64,
+      64,    64,    65,    65,    65,    65,    65,    65,    65,    65,
+      65,    65,    65,    65,    65,    65,    65,    65,    65,    65,
+      65,    66,    66,    67,    67,    67,    68,    68,    68,    68,
+      68,    68,    68,    68,    68,    68,    69,    69,    69,    70,
+      70,    70,    71,    72,    72,    72,    72,    72,    72,    72,
+      73,    74,    74,    75,    75,    76,    76
 };
 
 /* YYR2[RULE-NUM] -- Number of symbols on the right-hand side of rule RULE-NUM.  */
 static const yytype_int8 yyr2[] =
 {
-       0,     2,     0,     1,     0,     2,     4,     6,     9,     0,
-       2,     4,     4,     6,     0,     3,     4,     1,     1,     1,
-       3,     3,     3,     3,     3,     1,     1,     4,     3,     3,
-       3,     3,     3,     3,     3,     5,     0,     1,     3,     0,
-       2,     2,     2,     2,     2,     2,     2,     2,     2,     0,
-       3,     1,     0,     1,     3,     0,     4,     3,     2,     1,
-       8,    11,     9,     0,     9,     4,     1,     4
+       0,     2,     0,     1,     0,     2,     4,     6,     3,     5,
+       7,     3,     5,     7,     4,     4,     9,     0,     2,     4,
+       4,     6,     3,     1,     1,     1,     3,     3,     3,     3,
+       3,     3,     1,     1,     4,     3,     3,     3,     3,     3,
+       3,     3,     5,     0,     1,     3,     0,     2,     2,     2,
+       2,     2,     2,     2,     2,     2,     0,     3,     1,     0,
+       1,     3,     1,     0,     4,     3,     2,     2,     8,    11,
+       9,     0,     9,     0,     4,     1,     4
 };
 
 
@@ -1290,391 +1329,451 @@ yyreduce:
   switch (yyn)
     {
   case 2: /* program: %empty  */
-#line 49 "parser.y"
+#line 75 "parser.y"
     { (yyval.decl_ptr) = 0; }
-#line 1296 "parser.tab.c"
+#line 1335 "parser.tab.c"
     break;
 
   case 3: /* program: declaration  */
-#line 50 "parser.y"
-                  { code = (yyvsp[0].decl_ptr); }
-#line 1302 "parser.tab.c"
+#line 76 "parser.y"
+                  { ctx->code = decl_list_reverse((yyvsp[0].decl_ptr)); }
+#line 1341 "parser.tab.c"
     break;
 
   case 4: /* declaration: %empty  */
-#line 54 "parser.y"
+#line 82 "parser.y"
     { (yyval.decl_ptr) = 0; }
-#line 1308 "parser.tab.c"
+#line 1347 "parser.tab.c"
     break;
 
-  case 5: /* declaration: function_decl declaration  */
-#line 55 "parser.y"
-                                { (yyvsp[-1].decl_ptr)->next = (yyvsp[0].decl_ptr); (yyval.decl_ptr) = (yyvsp[-1].decl_ptr); }
-#line 1314 "parser.tab.c"
+  case 5: /* declaration: declaration function_decl  */
+#line 83 "parser.y"
+                                { (yyvsp[0].decl_ptr)->next = (yyvsp[-1].decl_ptr); (yyval.decl_ptr) = (yyvsp[0].decl_ptr); }
+#line 1353 "parser.tab.c"
     break;
 
-  case 6: /* declaration: type ident SEMICOLON declaration  */
-#line 56 "parser.y"
-                                       { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-3].type_ptr), (yyvsp[-2].ident_ptr), 0, (yyvsp[0].decl_ptr)); }
-#line 1320 "parser.tab.c"
+  case 6: /* declaration: declaration type ident SEMICOLON  */
+#line 84 "parser.y"
+                                       { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-2].type_ptr), (yyvsp[-1].ident_ptr), 0, (yyvsp[-3].decl_ptr)); }
+#line 1359 "parser.tab.c"
+    break;
+
+  case 7: /* declaration: declaration type ident ASSIGN exp SEMICOLON  */
+#line 85 "parser.y"
+                                                  { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-4].type_ptr), (yyvsp[-3].ident_ptr), (yyvsp[-1].expr_ptr), (yyvsp[-5].decl_ptr)); }
+#line 1365 "parser.tab.c"
     break;
 
-  case 7: /* declaration: type ident ASSIGN exp SEMICOLON declaration  */
-#line 57 "parser.y"
-                                                  { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-5].type_ptr), (yyvsp[-4].ident_ptr), (yyvsp[-2].expr_ptr), (yyvsp[0].decl_ptr)); }
-#line 1326 "parser.tab.c"
+  case 8: /* declaration: declaration PUBLIC function_decl  */
+#line 86 "parser.y"
+                                       { (yyvsp[0].decl_ptr)->exported = 1; (yyvsp[0].decl_ptr)->next = (yyvsp[-2].decl_ptr); (yyval.decl_ptr) = (yyvsp[0].decl_ptr); }
+#line 1371 "parser.tab.c"
+    break;
+
+  case 9: /* declaration: declaration PUBLIC type ident SEMICOLON  */
+#line 87 "parser.y"
+                                              { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-2].type_ptr), (yyvsp[-1].ident_ptr), 0, (yyvsp[-4].decl_ptr)); (yyval.decl_ptr)->exported = 1; }
+#line 1377 "parser.tab.c"
+    break;
+
+  case 10: /* declaration: declaration PUBLIC type ident ASSIGN exp SEMICOLON  */
+#line 88 "parser.y"
+                                                         { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-4].type_ptr), (yyvsp[-3].ident_ptr), (yyvsp[-1].expr_ptr), (yyvsp[-6].decl_ptr)); (yyval.decl_ptr)->exported = 1; }
+#line 1383 "parser.tab.c"
+    break;
+
+  case 11: /* declaration: declaration PRIVATE function_decl  */
+#line 89 "parser.y"
+                                        { (yyvsp[0].decl_ptr)->next = (yyvsp[-2].decl_ptr); (yyval.decl_ptr) = (yyvsp[0].decl_ptr); }
+#line 1389 "parser.tab.c"
     break;
 
-  case 8: /* function_decl: FUNCTION ident LPAREN param RPAREN type LCBRACKET statement RCBRACKET  */
-#line 61 "parser.y"
+  case 12: /* declaration: declaration PRIVATE type ident SEMICOLON  */
+#line 90 "parser.y"
+                                               { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-2].type_ptr), (yyvsp[-1].ident_ptr), 0, (yyvsp[-4].decl_ptr)); }
+#line 1395 "parser.tab.c"
+    break;
+
+  case 13: /* declaration: declaration PRIVATE type ident ASSIGN exp SEMICOLON  */
+#line 91 "parser.y"
+                                                          { (yyval.decl_ptr) = decl_create_global_variable_value((yyvsp[-4].type_ptr), (yyvsp[-3].ident_ptr), (yyvsp[-1].expr_ptr), (yyvsp[-6].decl_ptr)); }
+#line 1401 "parser.tab.c"
+    break;
+
+  case 14: /* declaration: declaration MODULE IDENTIFIER SEMICOLON  */
+#line 92 "parser.y"
+                                              { module_name((yyvsp[-1].string_val)); (yyval.decl_ptr) = (yyvsp[-3].decl_ptr); }
+#line 1407 "parser.tab.c"
+    break;
+
+  case 15: /* declaration: declaration INCLUDE IDENTIFIER SEMICOLON  */
+#line 93 "parser.y"
+                                               { module_include((yyvsp[-1].string_val)); (yyval.decl_ptr) = (yyvsp[-3].decl_ptr); }
+#line 1413 "parser.tab.c"
+    break;
+
+  case 16: /* function_decl: FUNCTION ident LPAREN param RPAREN type LCBRACKET statement RCBRACKET  */
+#line 97 "parser.y"
                                                                           { (yyval.decl_ptr) = decl_create_function((yyvsp[-7].ident_ptr), (yyvsp[-5].function_param_ptr), (yyvsp[-3].type_ptr), (yyvsp[-1].stmt_ptr)); }
-#line 1332 "parser.tab.c"
+#line 1419 "parser.tab.c"
     break;
 
-  case 9: /* param: %empty  */
-#line 65 "parser.y"
+  case 17: /* param: %empty  */
+#line 101 "parser.y"
     { (yyval.function_param_ptr) = 0; }
-#line 1338 "parser.tab.c"
+#line 1425 "parser.tab.c"
     break;
 
-  case 10: /* param: type ident  */
-#line 66 "parser.y"
+  case 18: /* param: type ident  */
+#line 102 "parser.y"
                  { (yyval.function_param_ptr) = function_create_param((yyvsp[0].ident_ptr), (yyvsp[-1].type_ptr), 0, 0); }
-#line 1344 "parser.tab.c"
+#line 1431 "parser.tab.c"
     break;
 
-  case 11: /* param: type ident ASSIGN exp  */
-#line 67 "parser.y"
+  case 19: /* param: type ident ASSIGN exp  */
+#line 103 "parser.y"
                             { (yyval.function_param_ptr) = function_create_param((yyvsp[-2].ident_ptr), (yyvsp[-3].type_ptr), (yyvsp[0].expr_ptr), 0); }
-#line 1350 "parser.tab.c"
+#line 1437 "parser.tab.c"
     break;
 
-  case 12: /* param: type ident COMMA param  */
-#line 68 "parser.y"
+  case 20: /* param: type ident COMMA param  */
+#line 104 "parser.y"
                              { (yyval.function_param_ptr) = function_create_param((yyvsp[-2].ident_ptr), (yyvsp[-3].type_ptr), 0, (yyvsp[0].function_param_ptr)); }
-#line 1356 "parser.tab.c"
+#line 1443 "parser.tab.c"
     break;
 
-  case 13: /* param: type ident ASSIGN exp COMMA param  */
-#line 69 "parser.y"
+  case 21: /* param: type ident ASSIGN exp COMMA param  */
+#line 105 "parser.y"
                                         { (yyval.function_param_ptr) = function_create_param((yyvsp[-4].ident_ptr), (yyvsp[-5].type_ptr), (yyvsp[-2].expr_ptr), (yyvsp[0].function_param_ptr)); }
-#line 1362 "parser.tab.c"
+#line 1449 "parser.tab.c"
     break;
 
-  case 15: /* exp: LPAREN exp RPAREN  */
-#line 73 "parser.y"
-                        {(yyval.expr_ptr) = (yyvsp[-1].expr_ptr);}
-#line 1368 "parser.tab.c"
-    break;
-
-  case 16: /* exp: IDENTIFIER LBRACKET NUM RBRACKET  */
-#line 74 "parser.y"
-                                           { (yyval.expr_ptr) = expr_create_name((yyvsp[-3].string_val), (yyvsp[-1].int_val)); }
-#line 1374 "parser.tab.c"
+  case 22: /* exp: LPAREN exp RPAREN  */
+#line 109 "parser.y"
+                      {(yyval.expr_ptr) = (yyvsp[-1].expr_ptr);}
+#line 1455 "parser.tab.c"
     break;
 
-  case 17: /* exp: IDENTIFIER  */
-#line 75 "parser.y"
-                 { (yyval.expr_ptr) = expr_create_name((yyvsp[0].string_val), 0); }
-#line 1380 "parser.tab.c"
+  case 23: /* exp: ident  */
+#line 110 "parser.y"
+                       { (yyval.expr_ptr) = expr_create_identifier((yyvsp[0].ident_ptr)); }
+#line 1461 "parser.tab.c"
     break;
 
-  case 18: /* exp: NUM  */
-#line 77 "parser.y"
+  case 24: /* exp: NUM  */
+#line 112 "parser.y"
           { (yyval.expr_ptr) = expr_create_integer((yyvsp[0].int_val)); }
-#line 1386 "parser.tab.c"
+#line 1467 "parser.tab.c"
     break;
 
-  case 19: /* exp: STRING_VALUE  */
-#line 78 "parser.y"
+  case 25: /* exp: STRING_VALUE  */
+#line 113 "parser.y"
                    { (yyval.expr_ptr) = 0; }
-#line 1392 "parser.tab.c"
+#line 1473 "parser.tab.c"
     break;
 
-  case 20: /* exp: ident ASSIGN exp  */
-#line 79 "parser.y"
+  case 26: /* exp: ident ASSIGN exp  */
+#line 114 "parser.y"
                        { (yyval.expr_ptr) = expr_create_assign((yyvsp[-2].ident_ptr), (yyvsp[0].expr_ptr)); }
-#line 1398 "parser.tab.c"
+#line 1479 "parser.tab.c"
     break;
 
-  case 21: /* exp: exp PLUS exp  */
-#line 80 "parser.y"
+  case 27: /* exp: exp PLUS exp  */
+#line 115 "parser.y"
                    { (yyval.expr_ptr) = expr_create_add((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1404 "parser.tab.c"
+#line 1485 "parser.tab.c"
     break;
 
-  case 22: /* exp: exp MINUS exp  */
-#line 81 "parser.y"
+  case 28: /* exp: exp MINUS exp  */
+#line 116 "parser.y"
                     { (yyval.expr_ptr) = expr_create_sub((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1410 "parser.tab.c"
+#line 1491 "parser.tab.c"
     break;
 
-  case 23: /* exp: exp TIMES exp  */
-#line 82 "parser.y"
+  case 29: /* exp: exp TIMES exp  */
+#line 117 "parser.y"
                     { (yyval.expr_ptr) = expr_create_mul((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1416 "parser.tab.c"
+#line 1497 "parser.tab.c"
     break;
 
-  case 24: /* exp: exp DIVIDE exp  */
-#line 83 "parser.y"
+  case 30: /* exp: exp POINTER exp  */
+#line 118 "parser.y"
+                      { (yyval.expr_ptr) = expr_create_mul((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
+#line 1503 "parser.tab.c"
+    break;
+
+  case 31: /* exp: exp DIVIDE exp  */
+#line 119 "parser.y"
                      { (yyval.expr_ptr) = expr_create_div((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1422 "parser.tab.c"
+#line 1509 "parser.tab.c"
     break;
 
-  case 25: /* exp: FALSE_  */
-#line 84 "parser.y"
+  case 32: /* exp: FALSE_  */
+#line 120 "parser.y"
              { (yyval.expr_ptr) = expr_create_bool(0); }
-#line 1428 "parser.tab.c"
+#line 1515 "parser.tab.c"
     break;
 
-  case 26: /* exp: TRUE_  */
-#line 85 "parser.y"
+  case 33: /* exp: TRUE_  */
+#line 121 "parser.y"
             { (yyval.expr_ptr) = expr_create_bool(1); }
-#line 1434 "parser.tab.c"
+#line 1521 "parser.tab.c"
     break;
 
-  case 27: /* exp: ident LPAREN arguments RPAREN  */
-#line 86 "parser.y"
-                                    { (yyval.expr_ptr) = expr_create_call((yyvsp[-3].ident_ptr), (yyvsp[-1].expr_function_arg_ptr)); }
-#line 1440 "parser.tab.c"
+  case 34: /* exp: IDENTIFIER LPAREN arguments RPAREN  */
+#line 122 "parser.y"
+                                         { (yyval.expr_ptr) = expr_create_call(ident_create((yyvsp[-3].string_val), 0), (yyvsp[-1].expr_function_arg_ptr)); }
+#line 1527 "parser.tab.c"
     break;
 
-  case 28: /* exp: exp EQUAL exp  */
-#line 87 "parser.y"
+  case 35: /* exp: exp EQUAL exp  */
+#line 123 "parser.y"
                     { (yyval.expr_ptr) = expr_create_equal((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1446 "parser.tab.c"
+#line 1533 "parser.tab.c"
     break;
 
-  case 29: /* exp: exp NOT_EQUAL exp  */
-#line 88 "parser.y"
+  case 36: /* exp: exp NOT_EQUAL exp  */
+#line 124 "parser.y"
                         { (yyval.expr_ptr) = expr_create_not_equal((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1452 "parser.tab.c"
+#line 1539 "parser.tab.c"
     break;
 
-  case 30: /* exp: exp GREATER exp  */
-#line 89 "parser.y"
+  case 37: /* exp: exp GREATER exp  */
+#line 125 "parser.y"
                       { (yyval.expr_ptr) = expr_create_greater((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1458 "parser.tab.c"
+#line 1545 "parser.tab.c"
     break;
 
-  case 31: /* exp: exp LESS exp  */
-#line 90 "parser.y"
+  case 38: /* exp: exp LESS exp  */
+#line 126 "parser.y"
                    { (yyval.expr_ptr) = expr_create_less((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1464 "parser.tab.c"
+#line 1551 "parser.tab.c"
     break;
 
-  case 32: /* exp: exp GREATER_EQUAL exp  */
-#line 91 "parser.y"
+  case 39: /* exp: exp GREATER_EQUAL exp  */
+#line 127 "parser.y"
                             { (yyval.expr_ptr) = expr_create_greater_equal((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1470 "parser.tab.c"
+#line 1557 "parser.tab.c"
     break;
 
-  case 33: /* exp: exp LESS_EQUAL exp  */
-#line 92 "parser.y"
+  case 40: /* exp: exp LESS_EQUAL exp  */
+#line 128 "parser.y"
                          { (yyval.expr_ptr) = expr_create_less_equal((yyvsp[-2].expr_ptr), (yyvsp[0].expr_ptr)); }
-#line 1476 "parser.tab.c"
+#line 1563 "parser.tab.c"
     break;
 
-  case 34: /* decl: type ident SEMICOLON  */
-#line 96 "parser.y"
+  case 41: /* decl: type ident SEMICOLON  */
+#line 132 "parser.y"
                          { (yyval.decl_ptr) = decl_create_local_variable_value((yyvsp[-2].type_ptr), (yyvsp[-1].ident_ptr), 0, 0); }
-#line 1482 "parser.tab.c"
+#line 1569 "parser.tab.c"
     break;
 
-  case 35: /* decl: type ident ASSIGN exp SEMICOLON  */
-#line 97 "parser.y"
+  case 42: /* decl: type ident ASSIGN exp SEMICOLON  */
+#line 133 "parser.y"
                                       { (yyval.decl_ptr) = decl_create_local_variable_value((yyvsp[-4].type_ptr), (yyvsp[-3].ident_ptr), (yyvsp[-1].expr_ptr), 0); }
-#line 1488 "parser.tab.c"
+#line 1575 "parser.tab.c"
     break;
 
-  case 36: /* arguments: %empty  */
-#line 101 "parser.y"
+  case 43: /* arguments: %empty  */
+#line 137 "parser.y"
     { (yyval.expr_function_arg_ptr) = 0; }
-#line 1494 "parser.tab.c"
+#line 1581 "parser.tab.c"
     break;
 
-  case 37: /* arguments: exp  */
-#line 102 "parser.y"
+  case 44: /* arguments: exp  */
+#line 138 "parser.y"
           {(yyval.expr_function_arg_ptr) = expr_function_create_arg((yyvsp[0].expr_ptr), 0); }
-#line 1500 "parser.tab.c"
+#line 1587 "parser.tab.c"
     break;
 
-  case 38: /* arguments: exp COMMA arguments  */
-#line 103 "parser.y"
+  case 45: /* arguments: exp COMMA arguments  */
+#line 139 "parser.y"
                           { (yyval.expr_function_arg_ptr) = expr_function_create_arg((yyvsp[-2].expr_ptr), (yyvsp[0].expr_function_arg_ptr)); }
-#line 1506 "parser.tab.c"
+#line 1593 "parser.tab.c"
     break;
 
-  case 39: /* type: %empty  */
-#line 107 "parser.y"
+  case 46: /* type: %empty  */
+#line 143 "parser.y"
     { (yyval.type_ptr) = 0;}
-#line 1512 "parser.tab.c"
+#line 1599 "parser.tab.c"
     break;
 
-  case 40: /* type: VOID type_specifier  */
-#line 108 "parser.y"
+  case 47: /* type: VOID type_specifier  */
+#line 144 "parser.y"
                           { (yyval.type_ptr) = type_create_primitive(PRIMITIVE_VOID, (yyvsp[0].type_spec_ptr)); }
-#line 1518 "parser.tab.c"
+#line 1605 "parser.tab.c"
     break;
 
-  case 41: /* type: ident type_specifier  */
-#line 109 "parser.y"
+  case 48: /* type: ident type_specifier  */
+#line 145 "parser.y"
                            { (yyval.type_ptr) = (yyvsp[-1].ident_ptr); }
-#line 1524 "parser.tab.c"
+#line 1611 "parser.tab.c"
     break;
 
-  case 42: /* type: I1 type_specifier  */
-#line 110 "parser.y"
+  case 49: /* type: I1 type_specifier  */
+#line 146 "parser.y"
                         { (yyval.type_ptr) = type_create_primitive(PRIMITIVE_INTEGER_8, (yyvsp[0].type_spec_ptr)); }
-#line 1530 "parser.tab.c"
+#line 1617 "parser.tab.c"
     break;
 
-  case 43: /* type: I2 type_specifier  */
-#line 111 "parser.y"
+  case 50: /* type: I2 type_specifier  */
+#line 147 "parser.y"
                         { (yyval.type_ptr) = type_create_primitive(PRIMITIVE_INTEGER_16, (yyvsp[0].type_spec_ptr)); }
-#line 1536 "parser.tab.c"
+#line 1623 "parser.tab.c"
     break;
 
-  case 44: /* type: I4 type_specifier  */
-#line 112 "parser.y"
+  case 51: /* type: I4 type_specifier  */
+#line 148 "parser.y"
                         { (yyval.type_ptr) = type_create_primitive(PRIMITIVE_INTEGER_32, (yyvsp[0].type_spec_ptr)); }
-#line 1542 "parser.tab.c"
+#line 1629 "parser.tab.c"
     break;
 
-  case 45: /* type: I8 type_specifier  */
-#line 113 "parser.y"
+  case 52: /* type: I8 type_specifier  */
+#line 149 "parser.y"
                         { (yyval.type_ptr) = type_create_primitive(PRIMITIVE_INTEGER_64, (yyvsp[0].type_spec_ptr)); }
-#line 1548 "parser.tab.c"
+#line 1635 "parser.tab.c"
     break;
 
-  case 46: /* type: BOOLEAN type_specifier  */
-#line 114 "parser.y"
+  case 53: /* type: BOOLEAN type_specifier  */
+#line 150 "parser.y"
                              { (yyval.type_ptr) = type_create_primitive(PRIMITIVE_BOOL, (yyvsp[0].type_spec_ptr)); }
-#line 1554 "parser.tab.c"
+#line 1641 "parser.tab.c"
     break;
 
-  case 47: /* type: CHARACTER type_specifier  */
-#line 115 "parser.y"
+  case 54: /* type: CHARACTER type_specifier  */
+#line 151 "parser.y"
                                { (yyval.type_ptr) = type_create_primitive(PRIMITIVE_CHAR, (yyvsp[0].type_spec_ptr)); }
-#line 1560 "parser.tab.c"
+#line 1647 "parser.tab.c"
     break;
 
-  case 48: /* type: STRING type_specifier  */
-#line 116 "parser.y"
+  case 55: /* type: STRING type_specifier  */
+#line 152 "parser.y"
                             { (yyval.type_ptr) = 0; }
-#line 1566 "parser.tab.c"
+#line 1653 "parser.tab.c"
     break;
 
-  case 49: /* type_specifier: %empty  */
-#line 120 "parser.y"
+  case 56: /* type_specifier: %empty  */
+#line 156 "parser.y"
     { (yyval.type_spec_ptr) = 0; }
-#line 1572 "parser.tab.c"
+#line 1659 "parser.tab.c"
     break;
 
-  case 50: /* type_specifier: LBRACKET array_subscript RBRACKET  */
-#line 121 "parser.y"
+  case 57: /* type_specifier: LBRACKET array_subscript RBRACKET  */
+#line 157 "parser.y"
                                         { (yyval.type_spec_ptr) = type_spec_create_array((yyvsp[-1].array_sub_ptr)); }
-#line 1578 "parser.tab.c"
+#line 1665 "parser.tab.c"
     break;
 
-  case 51: /* type_specifier: POINTER  */
-#line 122 "parser.y"
+  case 58: /* type_specifier: POINTER  */
+#line 158 "parser.y"
               { (yyval.type_spec_ptr) = type_spec_create_pointer(); }
-#line 1584 "parser.tab.c"
+#line 1671 "parser.tab.c"
     break;
 
-  case 53: /* array_subscript: NUM  */
-#line 125 "parser.y"
+  case 60: /* array_subscript: NUM  */
+#line 161 "parser.y"
           { (yyval.array_sub_ptr) = array_sub_create((yyvsp[0].int_val), 0); }
-#line 1590 "parser.tab.c"
+#line 1677 "parser.tab.c"
     break;
 
-  case 54: /* array_subscript: NUM COMMA array_subscript  */
-#line 126 "parser.y"
+  case 61: /* array_subscript: NUM COMMA array_subscript  */
+#line 162 "parser.y"
                                 { (yyval.array_sub_ptr) = array_sub_create((yyvsp[-2].int_val), (yyvsp[0].array_sub_ptr)); }
-#line 1596 "parser.tab.c"
+#line 1683 "parser.tab.c"
     break;
 
-  case 55: /* statement: %empty  */
-#line 129 "parser.y"
+  case 62: /* statement: statement_list  */
+#line 165 "parser.y"
+                   { (yyval.stmt_ptr) = stmt_list_reverse((yyvsp[0].stmt_ptr)); }
+#line 1689 "parser.tab.c"
+    break;
+
+  case 63: /* statement_list: %empty  */
+#line 169 "parser.y"
     { (yyval.stmt_ptr) = 0; }
-#line 1602 "parser.tab.c"
+#line 1695 "parser.tab.c"
     break;
 
-  case 56: /* statement: RETURN exp SEMICOLON statement  */
-#line 130 "parser.y"
-                                     { (yyval.stmt_ptr) = stmt_create_return((yyvsp[-2].expr_ptr)); }
-#line 1608 "parser.tab.c"
+  case 64: /* statement_list: statement_list RETURN exp SEMICOLON  */
+#line 170 "parser.y"
+                                          { (yyval.stmt_ptr) = stmt_create_return((yyvsp[-1].expr_ptr)); (yyval.stmt_ptr)->next = (yyvsp[-3].stmt_ptr); }
+#line 1701 "parser.tab.c"
     break;
 
-  case 57: /* statement: exp SEMICOLON statement  */
-#line 131 "parser.y"
-                              { (yyval.stmt_ptr) = stmt_create_expr((yyvsp[-2].expr_ptr), (yyvsp[0].stmt_ptr)); }
-#line 1614 "parser.tab.c"
+  case 65: /* statement_list: statement_list exp SEMICOLON  */
+#line 171 "parser.y"
+                                   { (yyval.stmt_ptr) = stmt_create_expr((yyvsp[-1].expr_ptr), (yyvsp[-2].stmt_ptr)); }
+#line 1707 "parser.tab.c"
     break;
 
-  case 58: /* statement: decl statement  */
-#line 132 "parser.y"
-                     { (yyval.stmt_ptr) = stmt_create_decl((yyvsp[-1].decl_ptr), (yyvsp[0].stmt_ptr)); }
-#line 1620 "parser.tab.c"
+  case 66: /* statement_list: statement_list decl  */
+#line 172 "parser.y"
+                          { (yyval.stmt_ptr) = stmt_create_decl((yyvsp[0].decl_ptr), (yyvsp[-1].stmt_ptr)); }
+#line 1713 "parser.tab.c"
     break;
 
-  case 59: /* statement: if_statement  */
-#line 133 "parser.y"
-                   { (yyval.stmt_ptr) = (yyvsp[0].stmt_ptr); }
-#line 1626 "parser.tab.c"
+  case 67: /* statement_list: statement_list if_statement  */
+#line 173 "parser.y"
+                                  { (yyvsp[0].stmt_ptr)->next = (yyvsp[-1].stmt_ptr); (yyval.stmt_ptr) = (yyvsp[0].stmt_ptr); }
+#line 1719 "parser.tab.c"
     break;
 
-  case 60: /* statement: WHILE LPAREN exp RPAREN LCBRACKET statement RCBRACKET statement  */
-#line 134 "parser.y"
-                                                                      { (yyval.stmt_ptr) = stmt_create_while((yyvsp[-5].expr_ptr), (yyvsp[-2].stmt_ptr), (yyvsp[0].stmt_ptr)); }
-#line 1632 "parser.tab.c"
+  case 68: /* statement_list: statement_list WHILE LPAREN exp RPAREN LCBRACKET statement RCBRACKET  */
+#line 174 "parser.y"
+                                                                           { (yyval.stmt_ptr) = stmt_create_while((yyvsp[-4].expr_ptr), (yyvsp[-1].stmt_ptr), (yyvsp[-7].stmt_ptr)); }
+#line 1725 "parser.tab.c"
     break;
 
-  case 61: /* statement: FOR LPAREN decl exp SEMICOLON exp RPAREN LCBRACKET statement RCBRACKET statement  */
-#line 135 "parser.y"
-                                                                                       { (yyval.stmt_ptr) = stmt_create_for((yyvsp[-8].decl_ptr), (yyvsp[-7].expr_ptr), (yyvsp[-5].expr_ptr), (yyvsp[-2].stmt_ptr), (yyvsp[0].stmt_ptr)); }
-#line 1638 "parser.tab.c"
+  case 69: /* statement_list: statement_list FOR LPAREN decl exp SEMICOLON exp RPAREN LCBRACKET statement RCBRACKET  */
+#line 175 "parser.y"
+                                                                                            { (yyval.stmt_ptr) = stmt_create_for((yyvsp[-7].decl_ptr), (yyvsp[-6].expr_ptr), (yyvsp[-4].expr_ptr), (yyvsp[-1].stmt_ptr), (yyvsp[-10].stmt_ptr)); }
+#line 1731 "parser.tab.c"
     break;
 
-  case 62: /* if_statement: IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET else_if_statement statement  */
-#line 139 "parser.y"
-                                                                                   { (yyval.stmt_ptr) = stmt_create_if((yyvsp[-6].expr_ptr), (yyvsp[-3].stmt_ptr), (yyvsp[-1].stmt_ptr), (yyvsp[0].stmt_ptr)); }
-#line 1644 "parser.tab.c"
+  case 70: /* if_statement: IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET else_if_statement else_statement  */
+#line 179 "parser.y"
+                                                                                        { (yyval.stmt_ptr) = stmt_create_if((yyvsp[-6].expr_ptr), (yyvsp[-3].stmt_ptr), stmt_else_chain_reverse((yyvsp[-1].stmt_ptr), (yyvsp[0].stmt_ptr)), 0); }
+#line 1737 "parser.tab.c"
     break;
 
-  case 63: /* else_if_statement: %empty  */
-#line 143 "parser.y"
+  case 71: /* else_if_statement: %empty  */
+#line 183 "parser.y"
     { (yyval.stmt_ptr) = 0; }
-#line 1650 "parser.tab.c"
+#line 1743 "parser.tab.c"
     break;
 
-  case 64: /* else_if_statement: ELSE IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET else_if_statement  */
-#line 144 "parser.y"
-                                                                                { (yyval.stmt_ptr) = stmt_create_else_if((yyvsp[-5].expr_ptr), (yyvsp[-2].stmt_ptr), (yyvsp[0].stmt_ptr)); }
-#line 1656 "parser.tab.c"
+  case 72: /* else_if_statement: else_if_statement ELSE IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET  */
+#line 184 "parser.y"
+                                                                                { (yyval.stmt_ptr) = stmt_create_else_if((yyvsp[-4].expr_ptr), (yyvsp[-1].stmt_ptr), (yyvsp[-8].stmt_ptr)); }
+#line 1749 "parser.tab.c"
     break;
 
-  case 65: /* else_if_statement: ELSE LCBRACKET statement RCBRACKET  */
-#line 145 "parser.y"
+  case 73: /* else_statement: %empty  */
+#line 188 "parser.y"
+    { (yyval.stmt_ptr) = 0; }
+#line 1755 "parser.tab.c"
+    break;
+
+  case 74: /* else_statement: ELSE LCBRACKET statement RCBRACKET  */
+#line 189 "parser.y"
                                          { (yyval.stmt_ptr) = stmt_create_else((yyvsp[-1].stmt_ptr)); }
-#line 1662 "parser.tab.c"
+#line 1761 "parser.tab.c"
     break;
 
-  case 66: /* ident: IDENTIFIER  */
-#line 149 "parser.y"
+  case 75: /* ident: IDENTIFIER  */
+#line 193 "parser.y"
                { (yyval.ident_ptr) = ident_create((yyvsp[0].string_val), 0); }
-#line 1668 "parser.tab.c"
+#line 1767 "parser.tab.c"
     break;
 
-  case 67: /* ident: IDENTIFIER LBRACKET NUM RBRACKET  */
-#line 150 "parser.y"
-                                       { (yyval.ident_ptr) = ident_create((yyvsp[-3].string_val), (yyvsp[-1].int_val)); }
-#line 1674 "parser.tab.c"
+  case 76: /* ident: IDENTIFIER LBRACKET exp RBRACKET  */
+#line 194 "parser.y"
+                                       { (yyval.ident_ptr) = ident_create_index((yyvsp[-3].string_val), (yyvsp[-1].expr_ptr)); }
+#line 1773 "parser.tab.c"
     break;
 
 
-#line 1678 "parser.tab.c"
+#line 1777 "parser.tab.c"
 
       default: break;
     }
@@ -1867,40 +1966,657 @@ yyreturnlab:
   return yyresult;
 }
 
-#line 154 "parser.y"
+#line 198 "parser.y"
 
 
 void yyerror(const char* msg) {
-    fprintf(stderr, "Parser error: %s\n", msg);
+    fprintf(ctx->diagnostics, "Parser error: %s\n", msg);
+}
+
+// The scanner and the parser keep their state in globals, so units are parsed
+// one at a time. Everything after parsing runs in the unit's own context.
+pthread_mutex_t parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct hend_context * context_create(struct hend_session * session)
+{
+    struct hend_context * c = calloc(1, sizeof(*c));
+    if (!c)
+    {
+        printf("Memory allocation failed for context.\n");
+        exit(1);
+    }
+
+    if (session)
+    {
+        c->session = session;
+        c->arena = session->arena;
+        c->interned = session->interned;
+        c->types = session->types;
+        c->scope = session->scope;
+    }
+    else
+    {
+        c->arena = arena_create();
+        c->interned = calloc(1, sizeof(*c->interned));
+        c->types = calloc(1, sizeof(*c->types));
+        c->scope = scope_stack_create();
+    }
+    c->emitter = emitter_create();
+    c->report = calloc(1, sizeof(*c->report));
+    c->source = calloc(1, sizeof(*c->source));
+
+    return c;
+}
+
+void context_release(struct hend_context * c)
+{
+    free(c->source);
+    free(c->report);
+    emitter_release(c->emitter);
+    if (c->session)
+    {
+        // The bindings point into the arena, which is emptied with them.
+        scope_stack_reset(c->scope);
+        arena_reset(c->arena);
+    }
+    else
+    {
+        scope_stack_release(c->scope);
+        type_table_release(c->types);
+        intern_table_release(c->interned);
+        arena_release(c->arena);
+    }
+    free(c);
+}
+
+hend_session * hend_session_create(void)
+{
+    hend_session * s = calloc(1, sizeof(*s));
+    if (!s)
+    {
+        printf("Memory allocation failed for session.\n");
+        exit(1);
+    }
+
+    s->arena = arena_create();
+    s->interned = calloc(1, sizeof(*s->interned));
+    s->types = calloc(1, sizeof(*s->types));
+    s->scope = scope_stack_create();
+
+    return s;
+}
+
+void hend_session_release(hend_session * s)
+{
+    if (!s) return;
+
+    scope_stack_release(s->scope);
+    type_table_release(s->types);
+    intern_table_release(s->interned);
+    arena_release(s->arena);
+    free(s);
+}
+
+// Types refer to interned names, so the two tables start over together.
+void session_trim(hend_session * s)
+{
+    size_t reserved = 0;
+    if (s->interned->storage) reserved += s->interned->storage->reserved;
+    if (s->types->storage) reserved += s->types->storage->reserved;
+    if (reserved < SESSION_CACHE_LIMIT) return;
+
+    type_table_release(s->types);
+    intern_table_release(s->interned);
+    s->interned = calloc(1, sizeof(*s->interned));
+    s->types = calloc(1, sizeof(*s->types));
+}
+
+// The emitter's buffer, the object and the requested reports become the
+// caller's output.
+void compile_output(const hend_options * options, hend_output * output, int build)
+{
+    // The emitter's buffer becomes the output, terminated for callers that
+    // want a string but without counting the terminator.
+    report_begin("emit");
+    *emit_reserve(1) = '\0';
+    output->assembly = ctx->emitter->buffer;
+    output->assembly_length = ctx->emitter->length;
+    ctx->emitter->buffer = 0;
+    report_output(output->assembly_length);
+
+    // Jumps into the text are patched now; everything else is left to the
+    // linker.
+    struct object * o = ctx->emitter->object;
+    if (o && !build && !ctx->error)
+    {
+        int missing = object_finish(o);
+        if (missing)
+        {
+            fprintf(ctx->diagnostics, "error: %i references to undefined labels.\n", missing);
+            ctx->error = 1;
+        }
+        else if (object_write(o, &output->object, &output->object_length))
+        {
+            fprintf(ctx->diagnostics, "error: could not write the object.\n");
+            ctx->error = 1;
+        }
+        report_output(output->object_length);
+    }
+    report_end();
+
+    if (options->memory_report || options->time_report != HEND_REPORT_NONE)
+    {
+        FILE * out = open_memstream(&output->report, &output->report_length);
+        if (options->memory_report)
+        {
+            arena_report(ctx->arena, out);
+        }
+        report_print(out);
+        fclose(out);
+    }
+
+    output->errors = build || ctx->error;
+}
+
+int hend_compile(const char * src, size_t len, const hend_options * options, hend_output * output)
+{
+    return hend_session_compile(0, src, len, options, output);
+}
+
+int hend_session_compile(hend_session * session, const char * src, size_t len, const hend_options * options, hend_output * output)
+{
+    static const hend_options defaults;
+    if (!options) options = &defaults;
+    memset(output, 0, sizeof(*output));
+
+    if (session)
+    {
+        session_trim(session);
+    }
+
+    struct hend_context * outer = ctx;
+    ctx = context_create(session);
+    ctx->report->format = options->time_report;
+    ctx->jobs = options->jobs;
+    if (options->object)
+    {
+        ctx->emitter->object = object_create();
+    }
+    ctx->diagnostics = open_memstream(&output->diagnostics, &output->diagnostics_length);
+
+    // Flex writes into the buffer it scans, so a source that may not be
+    // touched is copied into one that ends in the two NUL bytes it wants.
+    char * text = (char *)src;
+    if (!options->in_place)
+    {
+        text = malloc(len + 2);
+        memcpy(text, src, len);
+        text[len] = '\0';
+        text[len + 1] = '\0';
+    }
+    ctx->source->data = text;
+    ctx->source->length = len;
+
+    scope_enter();
+
+    pthread_mutex_lock(&parse_lock);
+    report_begin("parse");
+    struct yy_buffer_state * buffer = yy_scan_buffer(text, len + 2);
+    int build = buffer ? yyparse() : 1;
+    if (buffer)
+    {
+        yy_delete_buffer(buffer);
+    }
+    report_end();
+    pthread_mutex_unlock(&parse_lock);
+
+    if (options->cache && !build && !ctx->error)
+    {
+        report_begin("cache");
+        ctx->cache = options->cache;
+        cache_lookup(ctx->code, options->cache);
+    }
+
+    report_begin("resolve");
+    if (!ctx->error)
+    decl_resolve(ctx->code, 0);
+    report_begin("typecheck");
+    if (!ctx->error)
+    decl_typecheck(ctx->code);
+    report_begin("fold");
+    if (!ctx->error)
+    decl_fold(ctx->code);
+
+    report_begin("codegen");
+    if (!build && !ctx->error)
+    code_gen(ctx->code);
+    report_output(ctx->emitter->length);
+
+    compile_output(options, output, build);
+
+    fclose(ctx->diagnostics);
+    if (text != src)
+    {
+        free(text);
+    }
+    context_release(ctx);
+    ctx = outer;
+
+    return output->errors;
 }
 
-int main() {
+// Programs
+//
+// hend_compile_files() takes each file through parsing and then through
+// resolve and typecheck on a pool of threads, one module at a time per
+// thread, and generates code for the whole program once every module is
+// resolved. Parsing itself still takes parse_lock; reading the files,
+// taking their interfaces, resolving and checking them do not. In between,
+// on one thread, every include is matched to its module, which may be an
+// interface loaded with -I.
+
+struct program
+{
+    struct module * modules;
+    int count;
+    const hend_options * options;
 
+    // Modules loaded from interfaces.
+    struct module ** loaded;
+    int loaded_count;
 
-    code = malloc(sizeof(*code));
-    scope = malloc(sizeof(*scope));
-    scope->top = 0;
+    void (*phase)(struct program * p, struct module * m);
+};
+
+// Reads and parses the module, then takes its interface.
+void program_parse(struct program * p, struct module * m)
+{
+    ctx = m->context;
+    ctx->module = m;
+    ctx->diagnostics = open_memstream(&m->diagnostics, &m->diagnostics_length);
+
+    if (source_map(ctx->source, m->path))
+    {
+        fprintf(ctx->diagnostics, "error: could not read %s\n", m->path);
+        m->failed = 1;
+        return;
+    }
 
     scope_enter();
 
-    yyrestart(stdin);
+    pthread_mutex_lock(&parse_lock);
+    struct yy_buffer_state * buffer = yy_scan_buffer(ctx->source->data, ctx->source->length + 2);
+    m->failed = buffer ? yyparse() : 1;
+    if (buffer)
+    {
+        yy_delete_buffer(buffer);
+    }
+    pthread_mutex_unlock(&parse_lock);
 
-    int build = yyparse();
+    // Without `mod` a module is named after its file.
+    if (!m->name)
+    {
+        const char * base = strrchr(m->path, '/');
+        base = base ? base + 1 : m->path;
+        const char * dot = strchr(base, '.');
+        m->name = intern(base, dot ? (size_t)(dot - base) : strlen(base));
+    }
 
-    if (!error)
-    decl_resolve(code, 0);
-    if (!error)
-    decl_typecheck(code);
+    module_interface(m);
+}
 
-    file = fopen("assembly.asm", "w+");
+// The module called name: one of the files, or an interface loaded before,
+// or else loaded now. Null, with the reason reported, if there is none.
+struct module * program_module(struct program * p, const char * name)
+{
+    struct module * m = module_find(p->modules, p->count, name);
+    for (int i = 0; !m && i < p->loaded_count; i++)
+    {
+        if (p->loaded[i]->name == name) m = p->loaded[i];
+    }
+    if (m) return m;
 
-    code_gen(code);
+    int failed = p->options->interfaces ? module_load(&m, p->options->interfaces, name) : -1;
+    if (failed == -2)
+    {
+        fprintf(ctx->diagnostics, "error: %s/%s.hmi is not the interface of module %s.\n", p->options->interfaces, name, name);
+        return 0;
+    }
+    if (failed)
+    {
+        fprintf(ctx->diagnostics, "error: module %s is not part of the program.\n", name);
+        return 0;
+    }
 
-    fclose(file);
+    struct module ** grown = realloc(p->loaded, (p->loaded_count + 1) * sizeof(*grown));
+    if (!grown)
+    {
+        printf("Memory allocation failed for modules.\n");
+        exit(1);
+    }
+    p->loaded = grown;
+    p->loaded[p->loaded_count++] = m;
+    return m;
+}
 
-    
+void program_link(struct program * p)
+{
+    struct hend_context * outer = ctx;
+    for (int i = 0; i < p->count; i++)
+    {
+        struct module * m = &p->modules[i];
+        ctx = m->context;
+        if (m->failed || ctx->error) continue;
 
-    if (build || error)
+        for (struct module_include * include = m->includes; include && !ctx->error; include = include->next)
+        {
+            include->module = program_module(p, include->name);
+            if (!include->module)
+            {
+                ctx->error = 1;
+            }
+        }
+    }
+    ctx = outer;
+}
+
+void program_resolve(struct program * p, struct module * m)
+{
+    ctx = m->context;
+    if (m->failed || ctx->error) return;
+
+    module_import(m);
+    if (p->options->cache && !ctx->error)
+    {
+        cache_lookup(ctx->code, p->options->cache);
+    }
+    if (!ctx->error)
+    decl_resolve(ctx->code, 0);
+    if (!ctx->error)
+    decl_typecheck(ctx->code);
+    if (!ctx->error)
+    decl_fold(ctx->code);
+
+    if (p->options->interfaces && !ctx->error && module_interface_store(m, p->options->interfaces))
+    {
+        fprintf(ctx->diagnostics, "error: could not write the interface of module %s to %s.\n", m->name, p->options->interfaces);
+        ctx->error = 1;
+    }
+}
+
+void program_work(void * arg, int worker, int item)
+{
+    struct program * p = arg;
+    p->phase(p, &p->modules[item]);
+}
+
+void program_run(struct program * p, void (*phase)(struct program * p, struct module * m))
+{
+    p->phase = phase;
+    pool_run(pool_workers(p->options->jobs, p->count), p->count, program_work, p);
+}
+
+int hend_compile_files(const char * const * paths, int count, const hend_options * options, hend_output * output)
+{
+    static const hend_options defaults;
+    if (!options) options = &defaults;
+    memset(output, 0, sizeof(*output));
+
+    pthread_mutex_t interned_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t types_lock = PTHREAD_MUTEX_INITIALIZER;
+    hend_session * shared = hend_session_create();
+    shared->interned->lock = &interned_lock;
+    shared->types->lock = &types_lock;
+
+    struct hend_context * outer = ctx;
+    ctx = context_create(shared);
+    ctx->report->format = options->time_report;
+    ctx->jobs = options->jobs;
+    if (options->object)
+    {
+        ctx->emitter->object = object_create();
+    }
+    ctx->diagnostics = open_memstream(&output->diagnostics, &output->diagnostics_length);
+
+    struct program p = { calloc(count, sizeof(*p.modules)), count, options };
+    for (int i = 0; i < count; i++)
+    {
+        struct module * m = &p.modules[i];
+        m->path = paths[i];
+        m->session.arena = arena_create();
+        m->session.interned = shared->interned;
+        m->session.types = shared->types;
+        m->session.scope = scope_stack_create();
+        m->context = context_create(&m->session);
+    }
+
+    report_begin("parse");
+    program_run(&p, program_parse);
+    report_begin("resolve");
+    program_link(&p);
+    program_run(&p, program_resolve);
+    report_end();
+
+    // Each module's messages, under its file name, in the order given.
+    int build = 0;
+    for (int i = 0; i < count; i++)
+    {
+        struct module * m = &p.modules[i];
+        fclose(m->context->diagnostics);
+
+        const char * line = m->diagnostics;
+        const char * end = line + m->diagnostics_length;
+        while (line < end)
+        {
+            const char * next = memchr(line, '\n', end - line);
+            next = next ? next + 1 : end;
+            fprintf(ctx->diagnostics, "%s: %.*s", m->path, (int)(next - line), line);
+            line = next;
+        }
+        free(m->diagnostics);
+
+        build |= m->failed;
+        ctx->error |= m->context->error;
+    }
+
+    report_begin("codegen");
+    if (!build && !ctx->error && !module_duplicates(p.modules, count))
+    {
+        // One list, in the order the files were given.
+        struct decl * code = 0;
+        struct decl ** tail = &code;
+        for (int i = 0; i < count; i++)
+        {
+            *tail = p.modules[i].context->code;
+            while (*tail)
+            {
+                tail = &(*tail)->next;
+            }
+        }
+
+        for (int i = 0; i < p.loaded_count; i++)
+        {
+            module_externs(p.loaded[i]);
+        }
+
+        ctx->cache = options->cache;
+        code_gen(code);
+    }
+    else if (!build)
+    {
+        ctx->error = 1;
+    }
+    report_output(ctx->emitter->length);
+
+    compile_output(options, output, build);
+
+    fclose(ctx->diagnostics);
+    for (int i = 0; i < count; i++)
+    {
+        struct module * m = &p.modules[i];
+        source_release(m->context->source);
+        context_release(m->context);
+        scope_stack_release(m->session.scope);
+        arena_release(m->session.arena);
+    }
+    free(p.modules);
+    free(p.loaded);
+    context_release(ctx);
+    ctx = outer;
+
+    shared->interned->lock = 0;
+    shared->types->lock = 0;
+    hend_session_release(shared);
+
+    return output->errors;
+}
+
+void hend_output_release(hend_output * output)
+{
+    free(output->assembly);
+    free(output->object);
+    free(output->diagnostics);
+    free(output->report);
+    memset(output, 0, sizeof(*output));
+}
+
+int hend_run(const char * object, size_t length, int * status)
+{
+    struct jit j;
+    if (jit_load(&j, object, length)) return -1;
+
+    void * entry = jit_symbol(&j, "main");
+    if (!entry)
+    {
+        jit_release(&j);
+        return -1;
+    }
+    *status = jit_call(entry);
+
+    jit_release(&j);
+    return 0;
+}
+
+#ifndef HEND_LIBRARY
+
+int main(int argc, char ** argv) {
+
+    hend_options options = { 0 };
+    const char ** inputs = calloc(argc, sizeof(*inputs));
+    int input_count = 0;
+    const char * input = 0;
+    const char * server = 0;
+    int run = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-m"))
+        {
+            options.memory_report = 1;
+        }
+        else if (!strcmp(argv[i], "-ftime-report"))
+        {
+            options.time_report = HEND_REPORT_TEXT;
+        }
+        else if (!strcmp(argv[i], "-ftime-report=json"))
+        {
+            options.time_report = HEND_REPORT_JSON;
+        }
+        else if (!strcmp(argv[i], "-c"))
+        {
+            options.object = 1;
+        }
+        else if (!strcmp(argv[i], "--run"))
+        {
+            options.object = 1;
+            run = 1;
+        }
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+        {
+            input = argv[++i];
+            inputs[input_count++] = input;
+        }
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            options.jobs = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-I") && i + 1 < argc)
+        {
+            options.interfaces = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--cache") && i + 1 < argc)
+        {
+            options.cache = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--daemon"))
+        {
+            server = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : HEND_SOCKET;
+        }
+    }
+
+    if (server)
+    {
+        if (hend_serve(server, sysconf(_SC_NPROCESSORS_ONLN)))
+        {
+            printf("error: could not listen on %s\n", server);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Several -i make one program, a module per file; so does one -i that
+    // reads or writes module interfaces.
+    hend_output output;
+    int failed;
+    if (input_count > 1 || (input_count && options.interfaces))
+    {
+        failed = hend_compile_files(inputs, input_count, &options, &output);
+    }
+    else
+    {
+        // Either way the source lands in a buffer the scanner can use in place.
+        struct source source = { 0 };
+        if (input ? source_map(&source, input) : source_read(&source, stdin))
+        {
+            printf("error: could not read %s\n", input ? input : "stdin");
+            return 1;
+        }
+        options.in_place = 1;
+
+        failed = hend_compile(source.data, source.length, &options, &output);
+        source_release(&source);
+    }
+    free(inputs);
+
+    fwrite(output.diagnostics, 1, output.diagnostics_length, stdout);
+    if (options.object && !run)
+    {
+        if (!failed && output_write("assembly.o", output.object, output.object_length))
+        {
+            printf("error: could not write assembly.o\n");
+        }
+    }
+    else if (!run && output_write("assembly.asm", output.assembly, output.assembly_length))
+    {
+        printf("error: could not write assembly.asm\n");
+    }
+    fwrite(output.report, 1, output.report_length, stderr);
+
+    // A program that is run exits with its own status, and its output is
+    // not followed by the banner.
+    if (run && !failed)
+    {
+        int status = 0;
+        if (hend_run(output.object, output.object_length, &status))
+        {
+            printf("error: could not load the program\n");
+            status = 1;
+        }
+        hend_output_release(&output);
+        return status;
+    }
+    hend_output_release(&output);
+
+    if (failed)
     {
         printf("********************Build Succesfull!***********************\n");
     }
@@ -1911,3 +2627,5 @@ int main() {
 
     return 0;
 }
+
+#endif
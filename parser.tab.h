@@ -109,7 +109,8 @@ extern int yydebug;
     LBRACKET = 310,                /* LBRACKET  */
     RBRACKET = 311,                /* RBRACKET  */
     STRING_VALUE = 312,            /* STRING_VALUE  */
-    STRING = 313                   /* STRING  */
+    STRING = 313,                  /* STRING  */
+    NAME = 314                     /* NAME  */
   };
   typedef enum yytokentype yytoken_kind_t;
 #endif
@@ -118,11 +119,15 @@ extern int yydebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 11 "parser.y"
+#line 24 "parser.y"
 
     int int_val;
     double double_val;
     char* string_val;
+    struct {
+        const char * text;
+        int length;
+    } view_val;
     struct ident* ident_ptr;
     struct type* type_ptr;
     struct expr* expr_ptr;
@@ -133,7 +138,7 @@ union YYSTYPE
     struct array_sub * array_sub_ptr;
     struct type_spec * type_spec_ptr;
 
-#line 137 "parser.tab.h"
+#line 142 "parser.tab.h"
 
 };
 typedef union YYSTYPE YYSTYPE;
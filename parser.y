@@ -1,10 +1,23 @@
 %{
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "hend.h"
 #include "AST/AbstractSyntaxTree.c"
 
-struct decl * code;
+struct yy_buffer_state * yy_scan_buffer(char * base, size_t size);
+void yy_delete_buffer(struct yy_buffer_state * buffer);
+
+int yylex(void);
+
+// Tokens are pulled one at a time by the parser, so lexing is timed here.
+int report_yylex()
+{
+    return report_lex(yylex);
+}
+#define yylex report_yylex
 
 %}
 
@@ -12,6 +25,10 @@ struct decl * code;
     int int_val;
     double double_val;
     char* string_val;
+    struct {
+        const char * text;
+        int length;
+    } view_val;
     struct ident* ident_ptr;
     struct type* type_ptr;
     struct expr* expr_ptr;
@@ -25,6 +42,13 @@ struct decl * code;
 
 %token EQUAL GREATER LESS GREATER_EQUAL LESS_EQUAL NOT_EQUAL ELSE POINTER IF FOR WHILE QUOTE TRUE_ FALSE_ CHARACTER BOOLEAN ERROR I1 I2 I4 I8 UI1 UI2 UI4 UI8 F4 F8 STRUCT MODULE RETURN EXTEND REQUIREMENT COMMA CONSTRUCTOR VOID OBJECT INCLUDE NUM IDENTIFIER PLUS MINUS TIMES DIVIDE ASSIGN SEMICOLON FUNCTION LPAREN RPAREN LCBRACKET RCBRACKET PUBLIC PRIVATE LBRACKET RBRACKET STRING_VALUE STRING
 
+%right ASSIGN
+%left EQUAL NOT_EQUAL
+%left GREATER LESS GREATER_EQUAL LESS_EQUAL
+%left PLUS MINUS
+%left TIMES POINTER DIVIDE
+%nonassoc NAME /* a name followed by '*' is multiplied, not a pointer type */
+
 %type <decl_ptr> program
 %type <decl_ptr> declaration
 %type <decl_ptr> function_decl
@@ -34,27 +58,39 @@ struct decl * code;
 %type <expr_function_arg_ptr> arguments
 %type <type_ptr> type
 %type <stmt_ptr> statement
+%type <stmt_ptr> statement_list
 %type <ident_ptr> ident
 %type <int_val> NUM
 %type <string_val> IDENTIFIER
-%type <string_val> STRING_VALUE
+%type <view_val> STRING_VALUE
 %type <array_sub_ptr> array_subscript
 %type <type_spec_ptr> type_specifier
 %type <stmt_ptr> else_if_statement
+%type <stmt_ptr> else_statement
 %type <stmt_ptr> if_statement
 
 %%
 
 program:
     { $$ = 0; }
-    | declaration { code = $1; }
+    | declaration { ctx->code = decl_list_reverse($1); }
     ;
 
+/* Lists are built left-recursively, newest first, and reversed once when
+   complete so the parser stack stays flat however long they get. */
 declaration:
     { $$ = 0; }
-    | function_decl declaration { $1->next = $2; $$ = $1; }
-    | type ident SEMICOLON declaration { $$ = decl_create_global_variable_value($1, $2, 0, $4); }
-    | type ident ASSIGN exp SEMICOLON declaration { $$ = decl_create_global_variable_value($1, $2, $4, $6); }
+    | declaration function_decl { $2->next = $1; $$ = $2; }
+    | declaration type ident SEMICOLON { $$ = decl_create_global_variable_value($2, $3, 0, $1); }
+    | declaration type ident ASSIGN exp SEMICOLON { $$ = decl_create_global_variable_value($2, $3, $5, $1); }
+    | declaration PUBLIC function_decl { $3->exported = 1; $3->next = $1; $$ = $3; }
+    | declaration PUBLIC type ident SEMICOLON { $$ = decl_create_global_variable_value($3, $4, 0, $1); $$->exported = 1; }
+    | declaration PUBLIC type ident ASSIGN exp SEMICOLON { $$ = decl_create_global_variable_value($3, $4, $6, $1); $$->exported = 1; }
+    | declaration PRIVATE function_decl { $3->next = $1; $$ = $3; }
+    | declaration PRIVATE type ident SEMICOLON { $$ = decl_create_global_variable_value($3, $4, 0, $1); }
+    | declaration PRIVATE type ident ASSIGN exp SEMICOLON { $$ = decl_create_global_variable_value($3, $4, $6, $1); }
+    | declaration MODULE IDENTIFIER SEMICOLON { module_name($3); $$ = $1; }
+    | declaration INCLUDE IDENTIFIER SEMICOLON { module_include($3); $$ = $1; }
     ;
 
 function_decl:
@@ -70,9 +106,8 @@ param:
     ;
 
 exp:
-    | LPAREN exp RPAREN {$$ = $2;}
-        | IDENTIFIER LBRACKET NUM RBRACKET { $$ = expr_create_name($1, $3); }
-    | IDENTIFIER { $$ = expr_create_name($1, 0); }
+    LPAREN exp RPAREN {$$ = $2;}
+    | ident %prec NAME { $$ = expr_create_identifier($1); }
 
     | NUM { $$ = expr_create_integer($1); }
     | STRING_VALUE { $$ = 0; }
@@ -80,10 +115,11 @@ exp:
     | exp PLUS exp { $$ = expr_create_add($1, $3); }
     | exp MINUS exp { $$ = expr_create_sub($1, $3); }
     | exp TIMES exp { $$ = expr_create_mul($1, $3); }
+    | exp POINTER exp { $$ = expr_create_mul($1, $3); } /* '*' always lexes as POINTER */
     | exp DIVIDE exp { $$ = expr_create_div($1, $3); }
     | FALSE_ { $$ = expr_create_bool(0); }
     | TRUE_ { $$ = expr_create_bool(1); }
-    | ident LPAREN arguments RPAREN { $$ = expr_create_call($1, $3); }
+    | IDENTIFIER LPAREN arguments RPAREN { $$ = expr_create_call(ident_create($1, 0), $3); }
     | exp EQUAL exp { $$ = expr_create_equal($1, $3); }
     | exp NOT_EQUAL exp { $$ = expr_create_not_equal($1, $3); }
     | exp GREATER exp { $$ = expr_create_greater($1, $3); }
@@ -126,64 +162,689 @@ array_subscript:
     | NUM COMMA array_subscript { $$ = array_sub_create($1, $3); }
 
 statement:
+    statement_list { $$ = stmt_list_reverse($1); }
+    ;
+
+statement_list:
     { $$ = 0; }
-    | RETURN exp SEMICOLON statement { $$ = stmt_create_return($2); }
-    | exp SEMICOLON statement { $$ = stmt_create_expr($1, $3); }
-    | decl statement { $$ = stmt_create_decl($1, $2); }
-    | if_statement { $$ = $1; }
-    | WHILE LPAREN exp RPAREN LCBRACKET statement RCBRACKET statement { $$ = stmt_create_while($3, $6, $8); }
-    | FOR LPAREN decl exp SEMICOLON exp RPAREN LCBRACKET statement RCBRACKET statement { $$ = stmt_create_for($3, $4, $6, $9, $11); } 
+    | statement_list RETURN exp SEMICOLON { $$ = stmt_create_return($3); $$->next = $1; }
+    | statement_list exp SEMICOLON { $$ = stmt_create_expr($2, $1); }
+    | statement_list decl { $$ = stmt_create_decl($2, $1); }
+    | statement_list if_statement { $2->next = $1; $$ = $2; }
+    | statement_list WHILE LPAREN exp RPAREN LCBRACKET statement RCBRACKET { $$ = stmt_create_while($4, $7, $1); }
+    | statement_list FOR LPAREN decl exp SEMICOLON exp RPAREN LCBRACKET statement RCBRACKET { $$ = stmt_create_for($4, $5, $7, $10, $1); }
     ;
 
 if_statement:
-    IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET else_if_statement statement { $$ = stmt_create_if($3, $6, $8, $9); }
+    IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET else_if_statement else_statement { $$ = stmt_create_if($3, $6, stmt_else_chain_reverse($8, $9), 0); }
     ;
 
 else_if_statement:
     { $$ = 0; }
-    | ELSE IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET else_if_statement { $$ = stmt_create_else_if($4, $7, $9); }
+    | else_if_statement ELSE IF LPAREN exp RPAREN LCBRACKET statement RCBRACKET { $$ = stmt_create_else_if($5, $8, $1); }
+    ;
+
+else_statement:
+    { $$ = 0; }
     | ELSE LCBRACKET statement RCBRACKET { $$ = stmt_create_else($3); }
     ;
 
 ident:
     IDENTIFIER { $$ = ident_create($1, 0); }
-    | IDENTIFIER LBRACKET NUM RBRACKET { $$ = ident_create($1, $3); }
+    | IDENTIFIER LBRACKET exp RBRACKET { $$ = ident_create_index($1, $3); }
     ;
 
 
 %%
 
 void yyerror(const char* msg) {
-    fprintf(stderr, "Parser error: %s\n", msg);
+    fprintf(ctx->diagnostics, "Parser error: %s\n", msg);
 }
 
-int main() {
+// The scanner and the parser keep their state in globals, so units are parsed
+// one at a time. Everything after parsing runs in the unit's own context.
+pthread_mutex_t parse_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct hend_context * context_create(struct hend_session * session)
+{
+    struct hend_context * c = calloc(1, sizeof(*c));
+    if (!c)
+    {
+        printf("Memory allocation failed for context.\n");
+        exit(1);
+    }
+
+    if (session)
+    {
+        c->session = session;
+        c->arena = session->arena;
+        c->interned = session->interned;
+        c->types = session->types;
+        c->scope = session->scope;
+    }
+    else
+    {
+        c->arena = arena_create();
+        c->interned = calloc(1, sizeof(*c->interned));
+        c->types = calloc(1, sizeof(*c->types));
+        c->scope = scope_stack_create();
+    }
+    c->emitter = emitter_create();
+    c->report = calloc(1, sizeof(*c->report));
+    c->source = calloc(1, sizeof(*c->source));
 
+    return c;
+}
 
-    code = malloc(sizeof(*code));
-    scope = malloc(sizeof(*scope));
-    scope->top = 0;
+void context_release(struct hend_context * c)
+{
+    free(c->source);
+    free(c->report);
+    emitter_release(c->emitter);
+    if (c->session)
+    {
+        // The bindings point into the arena, which is emptied with them.
+        scope_stack_reset(c->scope);
+        arena_reset(c->arena);
+    }
+    else
+    {
+        scope_stack_release(c->scope);
+        type_table_release(c->types);
+        intern_table_release(c->interned);
+        arena_release(c->arena);
+    }
+    free(c);
+}
+
+hend_session * hend_session_create(void)
+{
+    hend_session * s = calloc(1, sizeof(*s));
+    if (!s)
+    {
+        printf("Memory allocation failed for session.\n");
+        exit(1);
+    }
+
+    s->arena = arena_create();
+    s->interned = calloc(1, sizeof(*s->interned));
+    s->types = calloc(1, sizeof(*s->types));
+    s->scope = scope_stack_create();
+
+    return s;
+}
+
+void hend_session_release(hend_session * s)
+{
+    if (!s) return;
+
+    scope_stack_release(s->scope);
+    type_table_release(s->types);
+    intern_table_release(s->interned);
+    arena_release(s->arena);
+    free(s);
+}
+
+// Types refer to interned names, so the two tables start over together.
+void session_trim(hend_session * s)
+{
+    size_t reserved = 0;
+    if (s->interned->storage) reserved += s->interned->storage->reserved;
+    if (s->types->storage) reserved += s->types->storage->reserved;
+    if (reserved < SESSION_CACHE_LIMIT) return;
+
+    type_table_release(s->types);
+    intern_table_release(s->interned);
+    s->interned = calloc(1, sizeof(*s->interned));
+    s->types = calloc(1, sizeof(*s->types));
+}
+
+// The emitter's buffer, the object and the requested reports become the
+// caller's output.
+void compile_output(const hend_options * options, hend_output * output, int build)
+{
+    // The emitter's buffer becomes the output, terminated for callers that
+    // want a string but without counting the terminator.
+    report_begin("emit");
+    *emit_reserve(1) = '\0';
+    output->assembly = ctx->emitter->buffer;
+    output->assembly_length = ctx->emitter->length;
+    ctx->emitter->buffer = 0;
+    report_output(output->assembly_length);
+
+    // Jumps into the text are patched now; everything else is left to the
+    // linker.
+    struct object * o = ctx->emitter->object;
+    if (o && !build && !ctx->error)
+    {
+        int missing = object_finish(o);
+        if (missing)
+        {
+            fprintf(ctx->diagnostics, "error: %i references to undefined labels.\n", missing);
+            ctx->error = 1;
+        }
+        else if (object_write(o, &output->object, &output->object_length))
+        {
+            fprintf(ctx->diagnostics, "error: could not write the object.\n");
+            ctx->error = 1;
+        }
+        report_output(output->object_length);
+    }
+    report_end();
+
+    if (options->memory_report || options->time_report != HEND_REPORT_NONE)
+    {
+        FILE * out = open_memstream(&output->report, &output->report_length);
+        if (options->memory_report)
+        {
+            arena_report(ctx->arena, out);
+        }
+        report_print(out);
+        fclose(out);
+    }
+
+    output->errors = build || ctx->error;
+}
+
+int hend_compile(const char * src, size_t len, const hend_options * options, hend_output * output)
+{
+    return hend_session_compile(0, src, len, options, output);
+}
+
+int hend_session_compile(hend_session * session, const char * src, size_t len, const hend_options * options, hend_output * output)
+{
+    static const hend_options defaults;
+    if (!options) options = &defaults;
+    memset(output, 0, sizeof(*output));
+
+    if (session)
+    {
+        session_trim(session);
+    }
+
+    struct hend_context * outer = ctx;
+    ctx = context_create(session);
+    ctx->report->format = options->time_report;
+    ctx->jobs = options->jobs;
+    if (options->object)
+    {
+        ctx->emitter->object = object_create();
+    }
+    ctx->diagnostics = open_memstream(&output->diagnostics, &output->diagnostics_length);
+
+    // Flex writes into the buffer it scans, so a source that may not be
+    // touched is copied into one that ends in the two NUL bytes it wants.
+    char * text = (char *)src;
+    if (!options->in_place)
+    {
+        text = malloc(len + 2);
+        memcpy(text, src, len);
+        text[len] = '\0';
+        text[len + 1] = '\0';
+    }
+    ctx->source->data = text;
+    ctx->source->length = len;
+
+    scope_enter();
+
+    pthread_mutex_lock(&parse_lock);
+    report_begin("parse");
+    struct yy_buffer_state * buffer = yy_scan_buffer(text, len + 2);
+    int build = buffer ? yyparse() : 1;
+    if (buffer)
+    {
+        yy_delete_buffer(buffer);
+    }
+    report_end();
+    pthread_mutex_unlock(&parse_lock);
+
+    if (options->cache && !build && !ctx->error)
+    {
+        report_begin("cache");
+        ctx->cache = options->cache;
+        cache_lookup(ctx->code, options->cache);
+    }
+
+    report_begin("resolve");
+    if (!ctx->error)
+    decl_resolve(ctx->code, 0);
+    report_begin("typecheck");
+    if (!ctx->error)
+    decl_typecheck(ctx->code);
+    report_begin("fold");
+    if (!ctx->error)
+    decl_fold(ctx->code);
+
+    report_begin("codegen");
+    if (!build && !ctx->error)
+    code_gen(ctx->code);
+    report_output(ctx->emitter->length);
+
+    compile_output(options, output, build);
+
+    fclose(ctx->diagnostics);
+    if (text != src)
+    {
+        free(text);
+    }
+    context_release(ctx);
+    ctx = outer;
+
+    return output->errors;
+}
+
+// Programs
+//
+// hend_compile_files() takes each file through parsing and then through
+// resolve and typecheck on a pool of threads, one module at a time per
+// thread, and generates code for the whole program once every module is
+// resolved. Parsing itself still takes parse_lock; reading the files,
+// taking their interfaces, resolving and checking them do not. In between,
+// on one thread, every include is matched to its module, which may be an
+// interface loaded with -I.
+
+struct program
+{
+    struct module * modules;
+    int count;
+    const hend_options * options;
+
+    // Modules loaded from interfaces.
+    struct module ** loaded;
+    int loaded_count;
+
+    void (*phase)(struct program * p, struct module * m);
+};
+
+// Reads and parses the module, then takes its interface.
+void program_parse(struct program * p, struct module * m)
+{
+    ctx = m->context;
+    ctx->module = m;
+    ctx->diagnostics = open_memstream(&m->diagnostics, &m->diagnostics_length);
+
+    if (source_map(ctx->source, m->path))
+    {
+        fprintf(ctx->diagnostics, "error: could not read %s\n", m->path);
+        m->failed = 1;
+        return;
+    }
 
     scope_enter();
 
-    yyrestart(stdin);
+    pthread_mutex_lock(&parse_lock);
+    struct yy_buffer_state * buffer = yy_scan_buffer(ctx->source->data, ctx->source->length + 2);
+    m->failed = buffer ? yyparse() : 1;
+    if (buffer)
+    {
+        yy_delete_buffer(buffer);
+    }
+    pthread_mutex_unlock(&parse_lock);
+
+    // Without `mod` a module is named after its file.
+    if (!m->name)
+    {
+        const char * base = strrchr(m->path, '/');
+        base = base ? base + 1 : m->path;
+        const char * dot = strchr(base, '.');
+        m->name = intern(base, dot ? (size_t)(dot - base) : strlen(base));
+    }
+
+    module_interface(m);
+}
+
+// The module called name: one of the files, or an interface loaded before,
+// or else loaded now. Null, with the reason reported, if there is none.
+struct module * program_module(struct program * p, const char * name)
+{
+    struct module * m = module_find(p->modules, p->count, name);
+    for (int i = 0; !m && i < p->loaded_count; i++)
+    {
+        if (p->loaded[i]->name == name) m = p->loaded[i];
+    }
+    if (m) return m;
 
-    int build = yyparse();
+    int failed = p->options->interfaces ? module_load(&m, p->options->interfaces, name) : -1;
+    if (failed == -2)
+    {
+        fprintf(ctx->diagnostics, "error: %s/%s.hmi is not the interface of module %s.\n", p->options->interfaces, name, name);
+        return 0;
+    }
+    if (failed)
+    {
+        fprintf(ctx->diagnostics, "error: module %s is not part of the program.\n", name);
+        return 0;
+    }
 
-    if (!error)
-    decl_resolve(code, 0);
-    if (!error)
-    decl_typecheck(code);
+    struct module ** grown = realloc(p->loaded, (p->loaded_count + 1) * sizeof(*grown));
+    if (!grown)
+    {
+        printf("Memory allocation failed for modules.\n");
+        exit(1);
+    }
+    p->loaded = grown;
+    p->loaded[p->loaded_count++] = m;
+    return m;
+}
 
-    file = fopen("assembly.asm", "w+");
+void program_link(struct program * p)
+{
+    struct hend_context * outer = ctx;
+    for (int i = 0; i < p->count; i++)
+    {
+        struct module * m = &p->modules[i];
+        ctx = m->context;
+        if (m->failed || ctx->error) continue;
+
+        for (struct module_include * include = m->includes; include && !ctx->error; include = include->next)
+        {
+            include->module = program_module(p, include->name);
+            if (!include->module)
+            {
+                ctx->error = 1;
+            }
+        }
+    }
+    ctx = outer;
+}
 
-    code_gen(code);
+void program_resolve(struct program * p, struct module * m)
+{
+    ctx = m->context;
+    if (m->failed || ctx->error) return;
 
-    fclose(file);
+    module_import(m);
+    if (p->options->cache && !ctx->error)
+    {
+        cache_lookup(ctx->code, p->options->cache);
+    }
+    if (!ctx->error)
+    decl_resolve(ctx->code, 0);
+    if (!ctx->error)
+    decl_typecheck(ctx->code);
+    if (!ctx->error)
+    decl_fold(ctx->code);
+
+    if (p->options->interfaces && !ctx->error && module_interface_store(m, p->options->interfaces))
+    {
+        fprintf(ctx->diagnostics, "error: could not write the interface of module %s to %s.\n", m->name, p->options->interfaces);
+        ctx->error = 1;
+    }
+}
+
+void program_work(void * arg, int worker, int item)
+{
+    struct program * p = arg;
+    p->phase(p, &p->modules[item]);
+}
+
+void program_run(struct program * p, void (*phase)(struct program * p, struct module * m))
+{
+    p->phase = phase;
+    pool_run(pool_workers(p->options->jobs, p->count), p->count, program_work, p);
+}
+
+int hend_compile_files(const char * const * paths, int count, const hend_options * options, hend_output * output)
+{
+    static const hend_options defaults;
+    if (!options) options = &defaults;
+    memset(output, 0, sizeof(*output));
+
+    pthread_mutex_t interned_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_t types_lock = PTHREAD_MUTEX_INITIALIZER;
+    hend_session * shared = hend_session_create();
+    shared->interned->lock = &interned_lock;
+    shared->types->lock = &types_lock;
+
+    struct hend_context * outer = ctx;
+    ctx = context_create(shared);
+    ctx->report->format = options->time_report;
+    ctx->jobs = options->jobs;
+    if (options->object)
+    {
+        ctx->emitter->object = object_create();
+    }
+    ctx->diagnostics = open_memstream(&output->diagnostics, &output->diagnostics_length);
+
+    struct program p = { calloc(count, sizeof(*p.modules)), count, options };
+    for (int i = 0; i < count; i++)
+    {
+        struct module * m = &p.modules[i];
+        m->path = paths[i];
+        m->session.arena = arena_create();
+        m->session.interned = shared->interned;
+        m->session.types = shared->types;
+        m->session.scope = scope_stack_create();
+        m->context = context_create(&m->session);
+    }
+
+    report_begin("parse");
+    program_run(&p, program_parse);
+    report_begin("resolve");
+    program_link(&p);
+    program_run(&p, program_resolve);
+    report_end();
+
+    // Each module's messages, under its file name, in the order given.
+    int build = 0;
+    for (int i = 0; i < count; i++)
+    {
+        struct module * m = &p.modules[i];
+        fclose(m->context->diagnostics);
+
+        const char * line = m->diagnostics;
+        const char * end = line + m->diagnostics_length;
+        while (line < end)
+        {
+            const char * next = memchr(line, '\n', end - line);
+            next = next ? next + 1 : end;
+            fprintf(ctx->diagnostics, "%s: %.*s", m->path, (int)(next - line), line);
+            line = next;
+        }
+        free(m->diagnostics);
+
+        build |= m->failed;
+        ctx->error |= m->context->error;
+    }
+
+    report_begin("codegen");
+    if (!build && !ctx->error && !module_duplicates(p.modules, count))
+    {
+        // One list, in the order the files were given.
+        struct decl * code = 0;
+        struct decl ** tail = &code;
+        for (int i = 0; i < count; i++)
+        {
+            *tail = p.modules[i].context->code;
+            while (*tail)
+            {
+                tail = &(*tail)->next;
+            }
+        }
+
+        for (int i = 0; i < p.loaded_count; i++)
+        {
+            module_externs(p.loaded[i]);
+        }
+
+        ctx->cache = options->cache;
+        code_gen(code);
+    }
+    else if (!build)
+    {
+        ctx->error = 1;
+    }
+    report_output(ctx->emitter->length);
 
-    
+    compile_output(options, output, build);
 
-    if (build || error)
+    fclose(ctx->diagnostics);
+    for (int i = 0; i < count; i++)
+    {
+        struct module * m = &p.modules[i];
+        source_release(m->context->source);
+        context_release(m->context);
+        scope_stack_release(m->session.scope);
+        arena_release(m->session.arena);
+    }
+    free(p.modules);
+    free(p.loaded);
+    context_release(ctx);
+    ctx = outer;
+
+    shared->interned->lock = 0;
+    shared->types->lock = 0;
+    hend_session_release(shared);
+
+    return output->errors;
+}
+
+void hend_output_release(hend_output * output)
+{
+    free(output->assembly);
+    free(output->object);
+    free(output->diagnostics);
+    free(output->report);
+    memset(output, 0, sizeof(*output));
+}
+
+int hend_run(const char * object, size_t length, int * status)
+{
+    struct jit j;
+    if (jit_load(&j, object, length)) return -1;
+
+    void * entry = jit_symbol(&j, "main");
+    if (!entry)
+    {
+        jit_release(&j);
+        return -1;
+    }
+    *status = jit_call(entry);
+
+    jit_release(&j);
+    return 0;
+}
+
+#ifndef HEND_LIBRARY
+
+int main(int argc, char ** argv) {
+
+    hend_options options = { 0 };
+    const char ** inputs = calloc(argc, sizeof(*inputs));
+    int input_count = 0;
+    const char * input = 0;
+    const char * server = 0;
+    int run = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-m"))
+        {
+            options.memory_report = 1;
+        }
+        else if (!strcmp(argv[i], "-ftime-report"))
+        {
+            options.time_report = HEND_REPORT_TEXT;
+        }
+        else if (!strcmp(argv[i], "-ftime-report=json"))
+        {
+            options.time_report = HEND_REPORT_JSON;
+        }
+        else if (!strcmp(argv[i], "-c"))
+        {
+            options.object = 1;
+        }
+        else if (!strcmp(argv[i], "--run"))
+        {
+            options.object = 1;
+            run = 1;
+        }
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+        {
+            input = argv[++i];
+            inputs[input_count++] = input;
+        }
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            options.jobs = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-I") && i + 1 < argc)
+        {
+            options.interfaces = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--cache") && i + 1 < argc)
+        {
+            options.cache = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--daemon"))
+        {
+            server = i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : HEND_SOCKET;
+        }
+    }
+
+    if (server)
+    {
+        if (hend_serve(server, sysconf(_SC_NPROCESSORS_ONLN)))
+        {
+            printf("error: could not listen on %s\n", server);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Several -i make one program, a module per file; so does one -i that
+    // reads or writes module interfaces.
+    hend_output output;
+    int failed;
+    if (input_count > 1 || (input_count && options.interfaces))
+    {
+        failed = hend_compile_files(inputs, input_count, &options, &output);
+    }
+    else
+    {
+        // Either way the source lands in a buffer the scanner can use in place.
+        struct source source = { 0 };
+        if (input ? source_map(&source, input) : source_read(&source, stdin))
+        {
+            printf("error: could not read %s\n", input ? input : "stdin");
+            return 1;
+        }
+        options.in_place = 1;
+
+        failed = hend_compile(source.data, source.length, &options, &output);
+        source_release(&source);
+    }
+    free(inputs);
+
+    fwrite(output.diagnostics, 1, output.diagnostics_length, stdout);
+    if (options.object && !run)
+    {
+        if (!failed && output_write("assembly.o", output.object, output.object_length))
+        {
+            printf("error: could not write assembly.o\n");
+        }
+    }
+    else if (!run && output_write("assembly.asm", output.assembly, output.assembly_length))
+    {
+        printf("error: could not write assembly.asm\n");
+    }
+    fwrite(output.report, 1, output.report_length, stderr);
+
+    // A program that is run exits with its own status, and its output is
+    // not followed by the banner.
+    if (run && !failed)
+    {
+        int status = 0;
+        if (hend_run(output.object, output.object_length, &status))
+        {
+            printf("error: could not load the program\n");
+            status = 1;
+        }
+        hend_output_release(&output);
+        return status;
+    }
+    hend_output_release(&output);
+
+    if (failed)
     {
         printf("********************Build Succesfull!***********************\n");
     }
@@ -194,3 +855,5 @@ int main() {
 
     return 0;
 }
+
+#endif
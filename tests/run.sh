@@ -0,0 +1,75 @@
+#!/bin/sh
+# Language tests.
+#
+#   tests/run.sh [test ...]
+#
+# Every test in tests is a .hend program and the output it has to print,
+# name.expected. Each program is run through both backends:
+#
+#   assembly  compiler, nasm, gcc -no-pie, then the executable
+#   object    compiler -c --run, which encodes the program and runs it in
+#             process
+#
+# and what it prints is compared with the expected output. Blank lines are
+# left out of the object backend's output, since the compiler writes some of
+# its own there. A program has to exit with 0, or with the status in
+# name.status if there is one. The assembly backend is skipped when nasm is
+# not installed.
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+OUT=${TEST_DIR:-/tmp/hend-tests}
+
+mkdir -p "$OUT"
+if [ -z "$COMPILER" ]; then
+    COMPILER="$OUT/compiler"
+    (cd "$ROOT" && gcc -O2 -w -o "$COMPILER" lex.yy.c parser.tab.c -lpthread -ldl) || exit 1
+fi
+
+BACKENDS="assembly object"
+if ! command -v nasm > /dev/null 2>&1; then
+    echo "nasm not found; skipping the assembly backend"
+    BACKENDS=object
+fi
+
+TESTS=${*:-$(cd "$ROOT/tests" && ls *.hend | sed 's/\.hend$//')}
+
+# Builds $1 in $OUT; fails if the compiler reports an error.
+build() {
+    "$COMPILER" -i "$ROOT/tests/$1.hend" > "$OUT/$1.log" 2>&1 \
+        && ! grep -q "error\|ran out of registers" "$OUT/$1.log" \
+        && nasm -f elf64 assembly.asm -o "$1.o" \
+        && gcc -no-pie -o "$1" "$1.o"
+}
+
+failed=0
+for test in $TESTS; do
+    expected=0
+    [ -f "$ROOT/tests/$test.status" ] && expected=$(cat "$ROOT/tests/$test.status")
+
+    for backend in $BACKENDS; do
+        if [ "$backend" = assembly ]; then
+            if ! (cd "$OUT" && build "$test") > /dev/null 2>&1; then
+                printf "FAILED  %-12s %s\n    does not compile\n" "$test" "$backend"
+                failed=$((failed + 1))
+                continue
+            fi
+            "$OUT/$test" > "$OUT/$test.out" 2>&1
+            status=$?
+        else
+            (cd "$OUT" && "$COMPILER" -c --run -i "$ROOT/tests/$test.hend") > "$OUT/$test.log" 2>&1
+            status=$?
+            grep -v '^$' "$OUT/$test.log" > "$OUT/$test.out"
+        fi
+
+        if cmp -s "$OUT/$test.out" "$ROOT/tests/$test.expected" && [ "$status" -eq "$expected" ]; then
+            printf "ok      %-12s %s\n" "$test" "$backend"
+        else
+            printf "FAILED  %-12s %s\n" "$test" "$backend"
+            diff "$ROOT/tests/$test.expected" "$OUT/$test.out" | sed 's/^/    /'
+            [ "$status" -eq "$expected" ] || echo "    exited with $status, not $expected"
+            failed=$((failed + 1))
+        fi
+    done
+done
+
+[ "$failed" -eq 0 ]